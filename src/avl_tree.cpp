@@ -4,8 +4,8 @@
 #include <iostream>
 
 /* AVL Node Constructor. */
-AVLTree::AVLNode::AVLNode(int k, int v)
-    : key(k), value(v), left(nullptr), right(nullptr), height(1)
+AVLTree::AVLNode::AVLNode(int k, int v, uint64_t s)
+    : key(k), value(v), sequence(s), left(nullptr), right(nullptr), height(1)
 {
 }
 
@@ -96,30 +96,47 @@ AVLTree::minValueNode(AVLNode *node)
 /* Perform in-order traversal of the AVL tree. */
 void
 AVLTree::inorderTraversal(AVLNode *node,
-                          std::vector<std::pair<int, int>> &result, int key1,
-                          int key2)
+                          std::vector<std::pair<int, int>> &result,
+                          std::vector<uint64_t> *sequences, int key1,
+                          int key2) const
 {
     if (node == nullptr) return;
 
     // Go left if key1 is less than the current key
     if (key1 < node->key)
     {
-        inorderTraversal(node->left, result, key1, key2);
+        inorderTraversal(node->left, result, sequences, key1, key2);
     }
 
     // Add to result if the key is within the range
     if (key1 <= node->key && node->key <= key2)
     {
         result.push_back({node->key, node->value});
+        if (sequences != nullptr)
+        {
+            sequences->push_back(node->sequence);
+        }
     }
 
     // Go right if key2 is greater than the current key
     if (key2 > node->key)
     {
-        inorderTraversal(node->right, result, key1, key2);
+        inorderTraversal(node->right, result, sequences, key1, key2);
     }
 }
 
+/* Visit the entries of the subtree in ascending key order. */
+void
+AVLTree::forEach(AVLNode *node,
+                 const std::function<void(int, int)> &callback) const
+{
+    if (node == nullptr) return;
+
+    forEach(node->left, callback);
+    callback(node->key, node->value);
+    forEach(node->right, callback);
+}
+
 /* Recursively clear all nodes in the tree. */
 void
 AVLTree::clear(AVLNode *node)
@@ -133,22 +150,23 @@ AVLTree::clear(AVLNode *node)
 
 /* Insert a new key-value pair node into the AVL tree. */
 AVLTree::AVLNode *
-AVLTree::insert(AVLNode *node, int key, int value)
+AVLTree::insert(AVLNode *node, int key, int value, uint64_t sequence)
 {
     // Perform a normal BST Insertion.
     if (!node)
     {
         current_size_++;
-        return new AVLNode(key, value);
+        return new AVLNode(key, value, sequence);
     }
 
     if (key < node->key)
-        node->left = insert(node->left, key, value);
+        node->left = insert(node->left, key, value, sequence);
     else if (key > node->key)
-        node->right = insert(node->right, key, value);
+        node->right = insert(node->right, key, value, sequence);
     else
     {
         node->value = value;
+        node->sequence = sequence;
         return node;
     }
 
@@ -182,14 +200,14 @@ AVLTree::insert(AVLNode *node, int key, int value)
 }
 
 void
-AVLTree::insert(int key, int value)
+AVLTree::insert(int key, int value, uint64_t sequence)
 {
-    root = insert(root, key, value);
+    root = insert(root, key, value, sequence);
 }
 
 /* Search for a value accociated with the given key. */
 int
-AVLTree::search(int key)
+AVLTree::search(int key, uint64_t *sequence) const
 {
     AVLNode *curr = root;
     while (curr)
@@ -199,7 +217,13 @@ AVLTree::search(int key)
         else if (key > curr->key)
             curr = curr->right;
         else
+        {
+            if (sequence != nullptr)
+            {
+                *sequence = curr->sequence;
+            }
             return curr->value;
+        }
     }
 
     return -1;
@@ -207,13 +231,20 @@ AVLTree::search(int key)
 
 /* Get the key-value pairs within the specified range. */
 std::vector<std::pair<int, int>>
-AVLTree::scan(int key1, int key2)
+AVLTree::scan(int key1, int key2, std::vector<uint64_t> *sequences) const
 {
     std::vector<std::pair<int, int>> result;
-    inorderTraversal(root, result, key1, key2);
+    inorderTraversal(root, result, sequences, key1, key2);
     return result;
 }
 
+/* Visit every entry in ascending key order without copying them. */
+void
+AVLTree::forEach(const std::function<void(int, int)> &callback) const
+{
+    forEach(root, callback);
+}
+
 void
 AVLTree::clear()
 {
@@ -224,7 +255,7 @@ AVLTree::clear()
 
 /* Get the current number of AVL Tree entries. */
 int
-AVLTree::GetSize()
+AVLTree::GetSize() const
 {
     return current_size_;
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef AVL_TREE_H
 #define AVL_TREE_H
 
+#include <cstdint>
+#include <functional>
 #include <utility>
 #include <vector>
 
@@ -11,11 +13,12 @@ class AVLTree
     {
         int key;
         int value;
+        uint64_t sequence;  // of the write that stored the value
         AVLNode *left;
         AVLNode *right;
         int height;
 
-        AVLNode(int k, int v);
+        AVLNode(int k, int v, uint64_t s);
     };
 
     AVLNode *root;
@@ -28,18 +31,26 @@ class AVLTree
     AVLNode *leftRotate(AVLNode *x);
     AVLNode *minValueNode(AVLNode *node);
     void inorderTraversal(AVLNode *node,
-                          std::vector<std::pair<int, int> > &result, int key1,
-                          int key2);
+                          std::vector<std::pair<int, int> > &result,
+                          std::vector<uint64_t> *sequences, int key1,
+                          int key2) const;
+    void forEach(AVLNode *node,
+                 const std::function<void(int, int)> &callback) const;
     void clear(AVLNode *node);
-    AVLNode *insert(AVLNode *node, int key, int value);
+    AVLNode *insert(AVLNode *node, int key, int value, uint64_t sequence);
 
    public:
     AVLTree();
 
-    int GetSize();
-    void insert(int key, int value);
-    int search(int key);
-    std::vector<std::pair<int, int> > scan(int key1, int key2);
+    int GetSize() const;
+    void insert(int key, int value, uint64_t sequence = 0);
+    // If sequence is given, it is set to the sequence number of the value.
+    int search(int key, uint64_t *sequence = nullptr) const;
+    // If sequences is given, the sequence number of every pair is appended.
+    std::vector<std::pair<int, int> > scan(
+        int key1, int key2, std::vector<uint64_t> *sequences = nullptr) const;
+    // Visit every entry in ascending key order.
+    void forEach(const std::function<void(int, int)> &callback) const;
 
     void clear();
 };
@@ -3,9 +3,13 @@
 #include <vector>
 
 #include "../config.h"
+#include "b_tree_builder.h"
 #include "b_tree_page.h"
+#include "leaf_compression.h"
 
-BTree::BTree(const std::vector<std::pair<int, int>>& data)
+BTree::BTree(const std::vector<std::pair<int, int>>& data,
+             bool compress_leaf_pages)
+    : compress_leaf_pages_(compress_leaf_pages)
 {
     std::vector<int> max_keys;
     ConstructLeafPages(data, max_keys);
@@ -16,17 +20,37 @@ void
 BTree::ConstructLeafPages(const std::vector<std::pair<int, int>>& data,
                           std::vector<int>& max_keys)
 {
+    auto add_leaf_page = [&](const std::vector<std::pair<int, int>>& keys)
+    {
+        BTreePage leaf_page(keys);
+        leaf_page.SetPageType(BTreePageType::LEAF_PAGE);
+        leaf_page.SetSize(keys.size());
+        if (compress_leaf_pages_)
+        {
+            leaf_page.SetPageFormat(BTreePageFormat::COMPRESSED);
+        }
+        leaf_pages_.push_back(leaf_page);
+        max_keys.push_back(leaf_page.GetMaxKey());
+    };
+
     std::vector<std::pair<int, int>> keys;
+    CompressedLeafSizer sizer;
     for (const auto& pair : data)
     {
+        // A compressed page is full once the next pair no longer fits
+        if (compress_leaf_pages_ && !sizer.TryAdd(pair.first, pair.second))
+        {
+            add_leaf_page(keys);
+            keys.clear();
+            sizer.Reset();
+            sizer.TryAdd(pair.first, pair.second);
+        }
+
         keys.push_back(pair);
-        if (keys.size() == MAX_PAGE_KV_PAIRS || &pair == &data.back())
+        if ((!compress_leaf_pages_ && keys.size() == MAX_PAGE_KV_PAIRS) ||
+            &pair == &data.back())
         {
-            BTreePage leaf_page(keys);
-            leaf_page.SetPageType(BTreePageType::LEAF_PAGE);
-            leaf_page.SetSize(keys.size());
-            leaf_pages_.push_back(leaf_page);
-            max_keys.push_back(leaf_page.GetMaxKey());
+            add_leaf_page(keys);
             keys.clear();
         }
     }
@@ -91,17 +115,17 @@ BTree::ConstructInternalNodes(std::vector<int>& max_keys)
 void
 BTree::SaveBTreeToDisk(const std::string& filename)
 {
-    // Save each internal page to disk.
-    for (const auto& internal_page : internal_pages_)
-    {
-        internal_page.WriteToDisk(filename);
-    }
-
-    // Save each leaf page to disk.
+    // Stream the leaves through the builder, which lays out and writes the
+    // pages
+    BTreeBuilder builder(filename, compress_leaf_pages_);
     for (const auto& leaf_page : leaf_pages_)
     {
-        leaf_page.WriteToDisk(filename);
+        for (const auto& pair : leaf_page.GetKeyValues())
+        {
+            builder.Add(pair.first, pair.second);
+        }
     }
+    builder.Finish();
 }
 
 std::vector<BTreePage>
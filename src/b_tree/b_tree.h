@@ -12,9 +12,12 @@ class BTree
 {
    public:
     // Constructor that transforms a list of key-value pairs into a BTree.
-    explicit BTree(const std::vector<std::pair<int, int>>& data);
+    // Compressed leaf pages hold as many pairs as fit in a page.
+    explicit BTree(const std::vector<std::pair<int, int>>& data,
+                   bool compress_leaf_pages = false);
 
-    // Save the BTree to disk for a given filename.
+    // Save the BTree to disk for a given filename, in the layout written by
+    // BTreeBuilder.
     void SaveBTreeToDisk(const std::string& filename);
 
     // Testing Only:
@@ -24,6 +27,7 @@ class BTree
    private:
     std::vector<BTreePage> internal_pages_;
     std::vector<BTreePage> leaf_pages_;
+    bool compress_leaf_pages_;
 
     void ConstructLeafPages(const std::vector<std::pair<int, int>>& data,
                             std::vector<int>& max_keys);
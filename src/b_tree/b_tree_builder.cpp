@@ -0,0 +1,277 @@
+#include "b_tree_builder.h"
+
+#include <fcntl.h>   // For open
+#include <unistd.h>  // For close, pwrite
+
+#include <algorithm>
+#include <cstdlib>  // For posix_memalign
+#include <cstring>  // For memcpy, memset
+#include <stdexcept>
+
+#include "../config.h"
+#include "../io/io_engine.h"
+
+BTreeBuilder::BTreeBuilder(const std::string &filename,
+                           bool compress_leaf_pages,
+                           LeafFilterBlock *leaf_filter_block,
+                           RateLimiter *rate_limiter, bool direct_io)
+    : filename_(filename),
+      compress_leaf_pages_(compress_leaf_pages),
+      leaf_filter_block_(leaf_filter_block),
+      rate_limiter_(rate_limiter),
+      fd_(-1),
+      num_entries_(0),
+      next_page_id_(0),
+      write_buffer_(nullptr),
+      buffered_pages_(0),
+      buffer_start_page_id_(0)
+{
+    fd_ = OpenUncached(filename, O_WRONLY | O_CREAT | O_TRUNC, direct_io);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error("Failed to create BTree file: " + filename);
+    }
+
+    void *aligned_buffer;
+    if (posix_memalign(&aligned_buffer, PAGE_SIZE,
+                       SST_WRITE_BUFFER_PAGES * PAGE_SIZE) != 0)
+    {
+        close(fd_);
+        throw std::runtime_error("Failed to allocate aligned memory");
+    }
+    write_buffer_ = static_cast<std::byte *>(aligned_buffer);
+
+    if (leaf_filter_block_ != nullptr)
+    {
+        leaf_filter_block_->SetFirstLeafPageId(0);
+    }
+}
+
+BTreeBuilder::~BTreeBuilder()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+    free(write_buffer_);
+}
+
+void
+BTreeBuilder::Add(int key, int value)
+{
+    // A compressed leaf is full once the next pair no longer fits
+    if (compress_leaf_pages_ && !sizer_.TryAdd(key, value))
+    {
+        FlushLeaf();
+        sizer_.TryAdd(key, value);
+    }
+
+    if (num_entries_ == 0)
+    {
+        footer_.min_key = key;
+    }
+    footer_.max_key = key;
+    leaf_pairs_.push_back({key, value});
+    num_entries_++;
+
+    if (!compress_leaf_pages_ && leaf_pairs_.size() == MAX_PAGE_KV_PAIRS)
+    {
+        FlushLeaf();
+    }
+}
+
+void
+BTreeBuilder::SetMaxSequence(uint64_t max_sequence)
+{
+    footer_.max_sequence = max_sequence;
+}
+
+void
+BTreeBuilder::Finish()
+{
+    FlushLeaf();
+    footer_.num_leaf_pages = next_page_id_;
+    footer_.num_entries = num_entries_;
+
+    // Close the partially built nodes from the bottom up. The node on the
+    // top level is the root, so it is the last one and gets no parent.
+    for (size_t level = 0; level < levels_.size(); level++)
+    {
+        if (level + 1 < levels_.size())
+        {
+            CloseNode(level);
+        }
+        else
+        {
+            internal_nodes_.push_back({level + 1, std::move(levels_[level])});
+        }
+    }
+
+    // The internal nodes go right after the last leaf
+    int first_internal_page_id = next_page_id_;
+    for (const auto &node : internal_nodes_)
+    {
+        AppendPage(MakeInternalPage(node, first_internal_page_id));
+    }
+    footer_.num_internal_pages = internal_nodes_.size();
+    footer_.root_page_id = internal_nodes_.empty() ? -1 : next_page_id_ - 1;
+
+    if (leaf_filter_block_ != nullptr)
+    {
+        std::vector<char> filter_block;
+        leaf_filter_block_->SerializeToBuffer(filter_block);
+        footer_.filter_block_offset =
+            static_cast<uint64_t>(next_page_id_) * PAGE_SIZE;
+        footer_.filter_block_size = filter_block.size();
+        AppendBytes(filter_block.data(), filter_block.size());
+    }
+
+    footer_.SerializeToBuffer(NextBufferedPage());
+    FlushWriteBuffer();
+
+    close(fd_);
+    fd_ = -1;
+}
+
+int
+BTreeBuilder::GetNumEntries() const
+{
+    return num_entries_;
+}
+
+const SstFooter &
+BTreeBuilder::GetFooter() const
+{
+    return footer_;
+}
+
+void
+BTreeBuilder::FlushLeaf()
+{
+    if (leaf_pairs_.empty())
+    {
+        return;
+    }
+
+    BTreePage page(leaf_pairs_);
+    page.SetPageType(BTreePageType::LEAF_PAGE);
+    page.SetSize(leaf_pairs_.size());
+    if (compress_leaf_pages_)
+    {
+        page.SetPageFormat(BTreePageFormat::COMPRESSED);
+    }
+
+    int page_id = next_page_id_;
+    AppendPage(page);
+
+    if (leaf_filter_block_ != nullptr)
+    {
+        leaf_filter_block_->AddLeaf(leaf_pairs_);
+    }
+    AddToLevel(0, leaf_pairs_.back().first, page_id);
+
+    leaf_pairs_.clear();
+    sizer_.Reset();
+}
+
+void
+BTreeBuilder::AddToLevel(size_t level, int max_key, int child)
+{
+    if (levels_.size() <= level)
+    {
+        levels_.emplace_back();
+    }
+
+    // Only close a full node once another child arrives, so that the last
+    // node of the top level can still become the root
+    if (levels_[level].size() == MAX_PAGE_KV_PAIRS)
+    {
+        CloseNode(level);
+    }
+    levels_[level].push_back({max_key, child});
+}
+
+void
+BTreeBuilder::CloseNode(size_t level)
+{
+    int max_key = levels_[level].back().first;
+    int node_index = internal_nodes_.size();
+    internal_nodes_.push_back({level + 1, std::move(levels_[level])});
+    levels_[level].clear();
+    AddToLevel(level + 1, max_key, node_index);
+}
+
+BTreePage
+BTreeBuilder::MakeInternalPage(const InternalNode &node,
+                               int first_internal_page_id) const
+{
+    // Nodes on the first internal level point at leaves, whose page ids are
+    // final. Higher nodes point at other internal nodes by index.
+    std::vector<std::pair<int, int>> entries = node.entries;
+    if (node.level > 1)
+    {
+        for (auto &entry : entries)
+        {
+            entry.second += first_internal_page_id;
+        }
+    }
+
+    BTreePage page(entries);
+    page.SetPageType(BTreePageType::INTERNAL_PAGE);
+    page.SetSize(entries.size());
+    return page;
+}
+
+void
+BTreeBuilder::AppendPage(const BTreePage &page)
+{
+    page.SerializeToBuffer(NextBufferedPage());
+}
+
+void
+BTreeBuilder::AppendBytes(const char *data, size_t size)
+{
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE)
+    {
+        std::byte *page = NextBufferedPage();
+        size_t num_bytes = std::min<size_t>(PAGE_SIZE, size - offset);
+        std::memcpy(page, data + offset, num_bytes);
+        std::memset(page + num_bytes, 0, PAGE_SIZE - num_bytes);
+    }
+}
+
+std::byte *
+BTreeBuilder::NextBufferedPage()
+{
+    if (buffered_pages_ == SST_WRITE_BUFFER_PAGES)
+    {
+        FlushWriteBuffer();
+    }
+
+    std::byte *page = write_buffer_ + buffered_pages_ * PAGE_SIZE;
+    buffered_pages_++;
+    next_page_id_++;
+    return page;
+}
+
+void
+BTreeBuilder::FlushWriteBuffer()
+{
+    if (buffered_pages_ > 0)
+    {
+        size_t num_bytes = buffered_pages_ * PAGE_SIZE;
+        off_t offset = static_cast<off_t>(buffer_start_page_id_) * PAGE_SIZE;
+        if (rate_limiter_ != nullptr)
+        {
+            rate_limiter_->Request(num_bytes);
+        }
+        ssize_t written = pwrite(fd_, write_buffer_, num_bytes, offset);
+        if (written != static_cast<ssize_t>(num_bytes))
+        {
+            throw std::runtime_error("Failed to write pages to disk: " +
+                                     filename_);
+        }
+    }
+    buffer_start_page_id_ = next_page_id_;
+    buffered_pages_ = 0;
+}
@@ -0,0 +1,104 @@
+#ifndef B_TREE_BUILDER_H
+#define B_TREE_BUILDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../bloom_filter/leaf_filter_block.h"
+#include "../compaction/rate_limiter.h"
+#include "b_tree_page.h"
+#include "leaf_compression.h"
+#include "sst_footer.h"
+
+/** Streaming B-tree writer.
+ *
+ *  Consumes key-value pairs in ascending key order and writes the B-tree
+ *  while they arrive. Only the current leaf and one partially built node per
+ *  internal level are kept in memory. Finished pages are collected in an
+ *  aligned buffer of SST_WRITE_BUFFER_PAGES pages and written with a single
+ *  pwrite through one open file descriptor. Only whole aligned pages are
+ *  written, so the file can be opened with O_DIRECT.
+ *
+ *  The file is written front to back in the layout described in
+ *  sst_footer.h: the leaves from page 0 in key order, then the internal
+ *  nodes with the root last, the leaf filter block and the footer. Since an
+ *  internal node cannot be written before the leaves are done, the completed
+ *  ones (one per MAX_PAGE_KV_PAIRS children) are held until Finish.
+ */
+class BTreeBuilder
+{
+   public:
+    // If leaf_filter_block is given, it is filled with the leaf filters. If
+    // rate_limiter is given, every write waits for its bytes. With
+    // direct_io, the file is written with O_DIRECT where the file system
+    // supports it.
+    explicit BTreeBuilder(const std::string& filename,
+                          bool compress_leaf_pages = false,
+                          LeafFilterBlock* leaf_filter_block = nullptr,
+                          RateLimiter* rate_limiter = nullptr,
+                          bool direct_io = false);
+    ~BTreeBuilder();
+
+    BTreeBuilder(const BTreeBuilder&) = delete;
+    BTreeBuilder& operator=(const BTreeBuilder&) = delete;
+
+    // Keys must be added in strictly ascending order.
+    void Add(int key, int value);
+
+    // Record the largest sequence number of the entries in the footer.
+    void SetMaxSequence(uint64_t max_sequence);
+
+    // Write the remaining pages, the leaf filter block and the footer, and
+    // close the file.
+    void Finish();
+
+    int GetNumEntries() const;
+    // Valid after Finish.
+    const SstFooter& GetFooter() const;
+
+   private:
+    // An internal node that is complete but not written yet. Nodes above
+    // the first internal level refer to their children by their index in
+    // internal_nodes_ until the page ids are known.
+    struct InternalNode
+    {
+        size_t level;
+        std::vector<std::pair<int, int>> entries;
+    };
+
+    void FlushLeaf();
+    void AddToLevel(size_t level, int max_key, int child);
+    void CloseNode(size_t level);
+    BTreePage MakeInternalPage(const InternalNode& node,
+                               int first_internal_page_id) const;
+    void AppendPage(const BTreePage& page);
+    // Append raw bytes, padded with zeros to whole pages.
+    void AppendBytes(const char* data, size_t size);
+    std::byte* NextBufferedPage();
+    void FlushWriteBuffer();
+
+    std::string filename_;
+    bool compress_leaf_pages_;
+    LeafFilterBlock* leaf_filter_block_;
+    RateLimiter* rate_limiter_;
+    int fd_;
+    int num_entries_;
+    SstFooter footer_;
+
+    std::vector<std::pair<int, int>> leaf_pairs_;
+    CompressedLeafSizer sizer_;
+
+    // (max key, child) of the node being built on each internal level
+    std::vector<std::vector<std::pair<int, int>>> levels_;
+    std::vector<InternalNode> internal_nodes_;
+
+    int next_page_id_;
+    std::byte* write_buffer_;
+    size_t buffered_pages_;
+    int buffer_start_page_id_;
+};
+
+#endif
@@ -5,34 +5,61 @@
 #include <fcntl.h>   // For open, O_DIRECT
 #include <unistd.h>  // For close, read
 
+#include <algorithm>
 #include <chrono>
+#include <climits>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>  // For posix_memalign
 #include <cstring>  // For memset
+#include <exception>
 #include <fstream>
+#include <future>
 #include <iomanip>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
 #include "../config.h"
+#include "b_tree_builder.h"
 #include "b_tree_page.h"
+#include "merge_kernel.h"
 
 BTreeManager::BTreeManager(const std::string &filename, int largest_lsm_level,
                            BufferPool &buffer_pool)
     : filename_(filename),
       largest_lsm_level_(largest_lsm_level),
       remove_tombstones_(false),
-      buffer_pool_(buffer_pool)
+      buffer_pool_(buffer_pool),
+      pages_read_(0),
+      io_engine_(IoEngine::Default())
+{
+    footer_.ReadFromFile(filename);
+}
+
+BTreeManager::BTreeManager(const std::string &filename, int largest_lsm_level,
+                           BufferPool &buffer_pool, const SstFooter &footer,
+                           std::shared_ptr<IoFile> file,
+                           std::shared_ptr<MappedFile> mapped_file)
+    : filename_(filename),
+      largest_lsm_level_(largest_lsm_level),
+      remove_tombstones_(false),
+      buffer_pool_(buffer_pool),
+      footer_(footer),
+      pages_read_(0),
+      io_engine_(file ? file->GetEngine() : IoEngine::Default()),
+      file_(std::move(file)),
+      mapped_file_(std::move(mapped_file))
 {
 }
 
 int
 BTreeManager::Get(int key)
 {
-    BTreePage page = TraverseToKey(key);
+    BTreePageView page = TraverseToKey(key);
     if (page.IsLeafPage())
     {
         return page.Get(key);
@@ -47,9 +74,188 @@ BTreeManager::Scan(int start_key, int end_key)
 }
 
 std::string
-BTreeManager::Merge(const std::string &filename_to_merge)
+BTreeManager::Merge(const std::string &filename_to_merge,
+                    LeafFilterBlock *leaf_filter_block,
+                    bool compress_leaf_pages)
 {
-    return MergeBTreeFromFile(filename_to_merge);
+    // Check if they each have the same level. if not, return an error
+    int level = GetFileLevel(filename_);
+    if (level != GetFileLevel(filename_to_merge))
+    {
+        throw std::runtime_error("Cannot merge B-trees of different levels");
+    }
+
+    // Tombstones can be dropped once nothing older is left below
+    MergeOptions options;
+    options.build_leaf_filters = leaf_filter_block != nullptr;
+    options.compress_leaf_pages = compress_leaf_pages;
+    std::vector<MergeOutput> outputs = MergeMany(
+        {filename_to_merge}, level + 1, level + 1 > largest_lsm_level_, options);
+    if (leaf_filter_block != nullptr)
+    {
+        *leaf_filter_block = outputs.front().leaf_filter_block;
+    }
+    return outputs.front().filename;
+}
+
+std::vector<MergeOutput>
+BTreeManager::MergeMany(const std::vector<std::string> &filenames_to_merge,
+                        int output_level, bool drop_tombstones,
+                        const MergeOptions &options)
+{
+    std::vector<std::string> filenames = {filename_};
+    filenames.insert(filenames.end(), filenames_to_merge.begin(),
+                     filenames_to_merge.end());
+
+    remove_tombstones_ = drop_tombstones;
+    merge_options_ = options;
+
+    // The outputs of a merge share the filename, followed by the index of
+    // their key range if the merge is split
+    std::string merge_filename = DetermineMergeFilename(output_level);
+    if (!options.output_dir.empty())
+    {
+        merge_filename = options.output_dir + "/" + merge_filename;
+    }
+    std::string output_prefix =
+        merge_filename.substr(0, merge_filename.size() - 4);
+    std::vector<int> bounds =
+        ChooseSubcompactionBounds(filenames, options.max_subcompactions);
+    if (bounds.empty())
+    {
+        return MergeBTreeFromFiles(filenames, output_prefix, INT_MIN,
+                                   static_cast<int64_t>(INT_MAX) + 1);
+    }
+
+    // Subrange i holds the keys in [bounds[i - 1], bounds[i]). The subranges
+    // only read the input files and write their own outputs, so they do not
+    // share any state.
+    size_t num_subranges = bounds.size() + 1;
+    std::vector<std::vector<MergeOutput>> subrange_outputs(num_subranges);
+    std::vector<std::exception_ptr> errors(num_subranges);
+    std::vector<std::thread> threads;
+    std::unique_ptr<TaskGroup> tasks;
+    if (options.scheduler != nullptr)
+    {
+        tasks = std::make_unique<TaskGroup>(*options.scheduler,
+                                            TaskPriority::COMPACTION);
+    }
+    for (size_t i = 0; i < num_subranges; i++)
+    {
+        int64_t start_key = i == 0 ? INT_MIN : bounds[i - 1];
+        int64_t end_key = i == bounds.size() ? static_cast<int64_t>(INT_MAX) + 1
+                                             : bounds[i];
+        std::stringstream subrange_prefix;
+        subrange_prefix << output_prefix << "_" << std::setfill('0')
+                        << std::setw(4) << i;
+        auto merge_subrange =
+            [&, i, start_key, end_key, prefix = subrange_prefix.str()]()
+        {
+            try
+            {
+                subrange_outputs[i] =
+                    MergeBTreeFromFiles(filenames, prefix, start_key, end_key);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        };
+        if (tasks != nullptr)
+        {
+            tasks->Submit(merge_subrange);
+        }
+        else
+        {
+            threads.emplace_back(merge_subrange);
+        }
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    if (tasks != nullptr)
+    {
+        tasks->Wait();
+    }
+
+    // Install the outputs of all the subranges together, or none of them
+    std::vector<MergeOutput> outputs;
+    for (size_t i = 0; i < num_subranges; i++)
+    {
+        outputs.insert(outputs.end(),
+                       std::make_move_iterator(subrange_outputs[i].begin()),
+                       std::make_move_iterator(subrange_outputs[i].end()));
+    }
+    for (const auto &error : errors)
+    {
+        if (error)
+        {
+            for (const auto &output : outputs)
+            {
+                std::remove(output.filename.c_str());
+            }
+            std::rethrow_exception(error);
+        }
+    }
+    return outputs;
+}
+
+/* Split the key space of a merge into ranges of about the same number of
+   leaves, using the first keys of evenly spaced leaves of the largest input
+   as boundaries. Returns no boundaries if the merge is too small to split. */
+std::vector<int>
+BTreeManager::ChooseSubcompactionBounds(
+    const std::vector<std::string> &filenames, int max_subcompactions) const
+{
+    std::vector<int> bounds;
+    if (max_subcompactions <= 1)
+    {
+        return bounds;
+    }
+
+    std::string largest_filename;
+    SstFooter largest_footer;
+    for (const auto &filename : filenames)
+    {
+        SstFooter footer;
+        footer.ReadFromFile(filename);
+        if (footer.num_leaf_pages > largest_footer.num_leaf_pages)
+        {
+            largest_filename = filename;
+            largest_footer = footer;
+        }
+    }
+
+    // Files without a footer do not say where their leaves are
+    int num_subranges =
+        std::min(max_subcompactions,
+                 largest_footer.num_leaf_pages / MIN_SUBCOMPACTION_LEAF_PAGES);
+    for (int i = 1; i < num_subranges; i++)
+    {
+        int page_id =
+            largest_footer.first_leaf_page_id +
+            static_cast<int>(static_cast<int64_t>(i) *
+                             largest_footer.num_leaf_pages / num_subranges);
+        BTreePageView page = ReadPageFromDisk(page_id, largest_filename);
+        if (page.IsLeafPage() &&
+            (bounds.empty() || page.GetMinKey() > bounds.back()))
+        {
+            bounds.push_back(page.GetMinKey());
+        }
+    }
+    return bounds;
+}
+
+int
+BTreeManager::GetFromLeafPage(int leaf_page_id, int key) const
+{
+    BTreePageView page = GetPageFromBufferOrDisk(filename_, leaf_page_id);
+    if (page.IsLeafPage())
+    {
+        return page.Get(key);
+    }
+    return -1;
 }
 
 int
@@ -60,18 +266,24 @@ BTreeManager::BinarySearchGet(int key) const
     // the number of pages. Then load in the middle page, check the min and max
     // key, use that to determine which page to load next. Continue until we
     // find the key or reach a leaf page.
-    std::ifstream file(filename_, std::ios::binary);
-    if (!file.is_open())
+    // The footer knows where the leaves are
+    int left = footer_.first_leaf_page_id;
+    int right = footer_.first_leaf_page_id + footer_.num_leaf_pages - 1;
+    if (footer_.num_leaf_pages < 0)
     {
-        throw std::runtime_error("Failed to open B-tree file: " + filename_);
-    }
-
-    file.seekg(0, std::ios::end);
-    int file_size = file.tellg();
-    int num_pages = file_size / PAGE_SIZE;
+        // Older files put the internal nodes first and end with the leaves
+        std::ifstream file(filename_, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open B-tree file: " +
+                                     filename_);
+        }
 
-    int left = 0;
-    int right = num_pages - 1;
+        file.seekg(0, std::ios::end);
+        int file_size = file.tellg();
+        left = FindFirstLeafPageId(filename_);
+        right = file_size / PAGE_SIZE - 1;
+    }
 
     while (left <= right)
     {
@@ -79,10 +291,10 @@ BTreeManager::BinarySearchGet(int key) const
 
         // check if this filename+mid exists in the buffer pool
         // before reading from disk
-        BTreePage page = GetPageFromBufferOrDisk(filename_, mid);
-        page.GetMaxKey();
+        BTreePageView page = GetPageFromBufferOrDisk(filename_, mid);
 
-        // if page is an internal page, consider it to be -1 (less than any key)
+        // the range only holds leaves, but skip anything else as if it were
+        // greater than any key
         if (page.GetPageType() == BTreePageType::INTERNAL_PAGE)
         {
             right = mid - 1;
@@ -107,105 +319,201 @@ BTreeManager::BinarySearchGet(int key) const
     return -1;
 }
 
-BTreePage
-BTreeManager::ReadPageFromDisk(int page_id, const std::string &filename) const
+std::vector<int>
+BTreeManager::MultiGet(const std::vector<int> &keys,
+                       const LeafFilterBlock *leaf_filter_block) const
 {
-    // Open the file with no cache
-    int fd = open(filename.c_str(), O_RDONLY);
-    if (fd < 0)
+    std::vector<int> results(keys.size(), -1);
+    if (keys.empty())
     {
-        throw std::runtime_error("Failed to open B-tree file: " + filename);
+        return results;
     }
-    #ifdef __APPLE__
-        // macOS-specific code for disabling caching
-        fcntl(fd, F_NOCACHE, 1);
-    #elif defined(__linux__)
-        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
-    #endif
 
-    // Allocate aligned memory for the buffer
-    void *aligned_buffer;
-    if (posix_memalign(&aligned_buffer, PAGE_SIZE, PAGE_SIZE) != 0)
+    if (leaf_filter_block == nullptr)
     {
-        close(fd);
-        throw std::runtime_error("Failed to allocate aligned memory");
-    }
-    std::memset(aligned_buffer, 0, PAGE_SIZE);
-
-    // Calculate the offset for the requested page
-    off_t offset = static_cast<off_t>(page_id) * PAGE_SIZE;
+        // Walk down the tree one level at a time. The keys are sorted, so
+        // the keys that route to the same child of a page are consecutive,
+        // and every page on the way is read once for all of them. The
+        // children of a level are read from disk together as one batch.
+        struct Group
+        {
+            BTreePageView page;
+            size_t begin;
+            size_t end;
+        };
+        std::vector<Group> groups = {{GetRootPage(), 0, keys.size()}};
+        while (!groups.empty())
+        {
+            std::vector<int> child_page_ids;
+            std::vector<Group> children;
+            for (const Group &group : groups)
+            {
+                if (group.page.IsLeafPage())
+                {
+                    for (size_t i = group.begin; i < group.end; i++)
+                    {
+                        results[i] = group.page.Get(keys[i]);
+                    }
+                    continue;
+                }
+                if (!group.page.IsInternalPage())
+                {
+                    continue;
+                }
 
-    // Read the page data
-    ssize_t bytes_read = pread(fd, aligned_buffer, PAGE_SIZE, offset);
-    if (bytes_read <= 0)
-    {
-        // Cleanup and return an empty page if the read failed
-        free(aligned_buffer);
-        close(fd);
+                size_t i = group.begin;
+                while (i < group.end)
+                {
+                    int child_page_id = group.page.FindChildPage(keys[i]);
+                    if (child_page_id == -1)
+                    {
+                        // This key and all the larger ones are past the max
+                        // key
+                        break;
+                    }
+                    size_t group_end = i + 1;
+                    while (group_end < group.end &&
+                           group.page.FindChildPage(keys[group_end]) ==
+                               child_page_id)
+                    {
+                        group_end++;
+                    }
+                    child_page_ids.push_back(child_page_id);
+                    children.push_back({BTreePageView(), i, group_end});
+                    i = group_end;
+                }
+            }
 
-        return BTreePage();
+            std::vector<BTreePageView> pages =
+                GetPagesFromBufferOrDisk(child_page_ids);
+            for (size_t i = 0; i < children.size(); i++)
+            {
+                children[i].page = std::move(pages[i]);
+            }
+            groups = std::move(children);
+        }
+        return results;
     }
 
-    std::byte *buffer_ptr = static_cast<std::byte *>(aligned_buffer);
-
-    // Read in the page type (4 bytes)
-    BTreePageType page_type =
-        *reinterpret_cast<const BTreePageType *>(buffer_ptr);
-    buffer_ptr += sizeof(BTreePageType);
-    if (page_type == BTreePageType::INVALID_PAGE)
+    // With leaf filters, the fence pointers give the leaf of every key
+    // directly. Sorted keys that share a leaf are next to each other, so
+    // the distinct leaves are read once, in one batch.
+    std::vector<int> leaf_page_ids(keys.size());
+    std::vector<int> distinct_leaf_page_ids;
+    for (size_t i = 0; i < keys.size(); i++)
     {
-        free(aligned_buffer);
-        close(fd);
-        return BTreePage();
+        leaf_page_ids[i] = leaf_filter_block->FindLeafPage(keys[i]);
+        if (leaf_page_ids[i] != INVALID_PAGE_ID &&
+            (distinct_leaf_page_ids.empty() ||
+             distinct_leaf_page_ids.back() != leaf_page_ids[i]))
+        {
+            distinct_leaf_page_ids.push_back(leaf_page_ids[i]);
+        }
     }
+    std::vector<BTreePageView> leaves =
+        GetPagesFromBufferOrDisk(distinct_leaf_page_ids);
 
-    // Read in the size of the page (4 bytes)
-    int size = *reinterpret_cast<const int *>(buffer_ptr);
-    buffer_ptr += sizeof(int);
-    if (size == 0)
+    size_t leaf = 0;
+    for (size_t i = 0; i < keys.size(); i++)
     {
-        free(aligned_buffer);
-        close(fd);
-        return BTreePage();
+        if (leaf_page_ids[i] == INVALID_PAGE_ID)
+        {
+            continue;
+        }
+        while (distinct_leaf_page_ids[leaf] != leaf_page_ids[i])
+        {
+            leaf++;
+        }
+        if (leaves[leaf].IsLeafPage())
+        {
+            results[i] = leaves[leaf].Get(keys[i]);
+        }
     }
 
-    // Read in the key-value pairs (8 bytes each pair)
-    int num_pairs = size;
-    std::vector<std::pair<int, int>> pairs;
-    for (int i = 0; i < num_pairs; i++)
+    return results;
+}
+
+const IoFile &
+BTreeManager::GetFile() const
+{
+    // Opened once for all the reads of this manager. Merge threads may
+    // read at the same time.
+    std::call_once(file_opened_,
+                   [this]()
+                   {
+                       if (!file_)
+                       {
+                           file_ = io_engine_.OpenFile(filename_);
+                       }
+                   });
+    return *file_;
+}
+
+BTreePageView
+BTreeManager::ReadPageFromDisk(int page_id, const std::string &filename) const
+{
+    if (filename == filename_)
     {
-        int key = *reinterpret_cast<const int *>(buffer_ptr);
-        buffer_ptr += sizeof(int);
-        int value = *reinterpret_cast<const int *>(buffer_ptr);
-        buffer_ptr += sizeof(int);
-        pairs.emplace_back(key, value);
+        return ReadPageFromDisk(page_id, GetFile());
     }
+    std::shared_ptr<IoFile> file = io_engine_.OpenFile(filename);
+    return ReadPageFromDisk(page_id, *file);
+}
 
-    if (pairs.empty())
+BTreePageView
+BTreeManager::ReadPageFromDisk(int page_id, const IoFile &file) const
+{
+    // Allocate an aligned frame for the page
+    PageFrame frame = AllocatePageFrame();
+
+    // Calculate the offset for the requested page
+    off_t offset = static_cast<off_t>(page_id) * PAGE_SIZE;
+
+    // Read the page data
+    ssize_t bytes_read = file.Read(frame.get(), PAGE_SIZE, offset);
+    if (bytes_read <= 0)
     {
-        free(aligned_buffer);
-        close(fd);
-        return BTreePage();
+        // Return an empty page if the read failed
+        return BTreePageView();
     }
 
-    // Create a new BTreePage object
-    BTreePage page(pairs);
-    page.SetPageType(page_type);
-    page.SetSize(size);
-    page.SetPageId(page_id);
+    // The page is not decoded, the view reads the frame in place
+    return BTreePageView(std::move(frame), page_id);
+}
 
-    // Clean up
-    free(aligned_buffer);
-    close(fd);
+std::vector<BTreePageView>
+BTreeManager::ReadPagesFromDisk(const std::vector<int> &page_ids) const
+{
+    const IoFile &file = GetFile();
+    std::vector<PageFrame> frames;
+    std::vector<IoRequest> requests;
+    for (int page_id : page_ids)
+    {
+        frames.push_back(AllocatePageFrame());
+        requests.push_back({&file, frames.back().get(), PAGE_SIZE,
+                            static_cast<off_t>(page_id) * PAGE_SIZE});
+    }
+    io_engine_.Read(requests);
 
-    return page;
+    std::vector<BTreePageView> pages;
+    for (size_t i = 0; i < page_ids.size(); i++)
+    {
+        if (requests[i].result <= 0)
+        {
+            // An empty page if the read failed
+            pages.emplace_back();
+            continue;
+        }
+        pages.emplace_back(std::move(frames[i]), page_ids[i]);
+    }
+    return pages;
 }
 
-BTreePage
+BTreePageView
 BTreeManager::TraverseToKey(int key) const
 {
     // Start at the root page
-    BTreePage page = GetPageFromBufferOrDisk(filename_, 0);
+    BTreePageView page = GetRootPage();
     while (!page.IsLeafPage())
     {
         // Fine the child of the root that leads us to the key and read it
@@ -217,7 +525,7 @@ BTreeManager::TraverseToKey(int key) const
         // If the page is invalid, return an empty page
         if (page.GetPageType() == BTreePageType::INVALID_PAGE)
         {
-            return BTreePage();
+            return BTreePageView();
         }
     }
 
@@ -230,7 +538,7 @@ BTreeManager::TraverseRange(int start_key, int end_key) const
     std::vector<std::pair<int, int>> result;
 
     // Start at the root page
-    BTreePage page = GetPageFromBufferOrDisk(filename_, 0);
+    BTreePageView page = GetRootPage();
     while (!page.IsLeafPage())
     {
         // Find the child of the root that leads us to the start key and read it
@@ -246,6 +554,19 @@ BTreeManager::TraverseRange(int start_key, int end_key) const
         }
     }
 
+    // Once a scan has moved through a few leaves, it is likely to go on, so
+    // the leaves after it are read ahead in growing windows, up to the leaf
+    // that holds end_key. The footer tells where the leaves are; without it
+    // there is no readahead.
+    int end_leaf_page_id =
+        footer_.num_leaf_pages >= 0
+            ? footer_.first_leaf_page_id + footer_.num_leaf_pages
+            : INVALID_PAGE_ID;
+    bool end_leaf_found = false;
+    int leaves_scanned = 0;
+    int readahead_pages = SCAN_READAHEAD_MIN_PAGES;
+    std::deque<BTreePageView> leaves_ahead;
+
     // page is a leaf that contains the start key. Scan the range
     while (page.IsLeafPage())
     {
@@ -260,6 +581,36 @@ BTreeManager::TraverseRange(int start_key, int end_key) const
         }
 
         int next_page_id = page.GetPageId() + 1;
+        leaves_scanned++;
+        if (leaves_ahead.empty() && end_leaf_page_id != INVALID_PAGE_ID &&
+            leaves_scanned >= SCAN_READAHEAD_TRIGGER_LEAVES)
+        {
+            if (!end_leaf_found)
+            {
+                int last_leaf_page_id = FindLeafPageId(end_key);
+                if (last_leaf_page_id != INVALID_PAGE_ID)
+                {
+                    end_leaf_page_id =
+                        std::min(end_leaf_page_id, last_leaf_page_id + 1);
+                }
+                end_leaf_found = true;
+            }
+            if (next_page_id >= end_leaf_page_id)
+            {
+                break;
+            }
+            leaves_ahead = ReadAheadLeaves(
+                next_page_id,
+                std::min(end_leaf_page_id, next_page_id + readahead_pages));
+            readahead_pages =
+                std::min(2 * readahead_pages, SCAN_READAHEAD_MAX_PAGES);
+        }
+        if (!leaves_ahead.empty())
+        {
+            page = std::move(leaves_ahead.front());
+            leaves_ahead.pop_front();
+            continue;
+        }
 
         // check if this filename+next_page_id exists in the buffer pool
         // before reading from disk
@@ -269,321 +620,351 @@ BTreeManager::TraverseRange(int start_key, int end_key) const
     return result;
 }
 
-std::string
-BTreeManager::MergeBTreeFromFile(const std::string &filename_to_merge)
+/* Internal pages are never leaves, and the leaves are stored consecutively,
+   so a child id in the leaf range of the footer is the leaf itself. */
+int
+BTreeManager::FindLeafPageId(int key) const
 {
-    // Determine the filename for the merged B-tree
-    std::string merge_filename =
-        DetermineMergeFilename(filename_, filename_to_merge);
-
-    std::string temp_leaf_filename = "temp_leaf_file.sst";
-    std::string temp_internal_filename = "temp_internal_file.sst";
-
-    // Step 1: Open two input buffers for the two B-trees. This is done on the
-    // fly in the merge process to avoid loading the entire B-tree into memory.
-
-    // Step 2: Find the leaf pages of each BTree to start the merge
-    int page_id = 0;
-    int page_id_to_merge = 0;
-    BTreePage page = ReadPageFromDisk(page_id, filename_);
-    BTreePage page_to_merge =
-        ReadPageFromDisk(page_id_to_merge, filename_to_merge);
-
-    while (!page.IsLeafPage())
+    int first_leaf_page_id = footer_.first_leaf_page_id;
+    int end_leaf_page_id = first_leaf_page_id + footer_.num_leaf_pages;
+    BTreePageView page = GetRootPage();
+    while (page.GetPageType() != BTreePageType::INVALID_PAGE)
     {
-        page_id = page.FindChildPage(INT_MIN);
-        page = ReadPageFromDisk(page_id, filename_);
+        if (page.IsLeafPage())
+        {
+            return page.GetPageId();
+        }
+        int child_page_id = page.FindChildPage(key);
+        if (child_page_id >= first_leaf_page_id &&
+            child_page_id < end_leaf_page_id)
+        {
+            return child_page_id;
+        }
+        page = GetPageFromBufferOrDisk(filename_, child_page_id);
     }
+    return INVALID_PAGE_ID;
+}
 
-    while (!page_to_merge.IsLeafPage())
+std::deque<BTreePageView>
+BTreeManager::ReadAheadLeaves(int first_page_id, int end_page_id) const
+{
+    std::deque<BTreePageView> pages(end_page_id - first_page_id);
+    if (mapped_file_)
     {
-        page_id_to_merge = page_to_merge.FindChildPage(INT_MIN);
-        page_to_merge = ReadPageFromDisk(page_id_to_merge, filename_to_merge);
+        // Let the kernel fault the window in while the scan works
+        mapped_file_->WillNeed(first_page_id, end_page_id - first_page_id);
+        for (int page_id = first_page_id; page_id < end_page_id; page_id++)
+        {
+            pages[page_id - first_page_id] = GetMappedPage(page_id);
+        }
+        return pages;
     }
 
-    std::vector<std::pair<int, int>> merged_pairs;
-    std::vector<int> internal_node_max_keys;
-
-    auto pairs = page.GetKeyValues();
-    auto pairs_to_merge = page_to_merge.GetKeyValues();
-    auto it1 = pairs.begin();
-    auto it2 = pairs_to_merge.begin();
-
-    // Step 3: Merge the leaf pages into a new BTreePage
-    while (page.IsLeafPage() && page_to_merge.IsLeafPage())
+    int page_id = first_page_id;
+    while (page_id < end_page_id)
     {
-        while (it1 != pairs.end() && it2 != pairs_to_merge.end())
+        if (buffer_pool_.TryGetPage(filename_, page_id,
+                                    &pages[page_id - first_page_id]))
         {
-            if (it1->first < it2->first)
-            {
-                merged_pairs.push_back(*it1);
-                ++it1;
-            }
-            else if (it1->first > it2->first)
-            {
-                merged_pairs.push_back(*it2);
-                ++it2;
-            }
-            else
-            {
-                // If the keys are the same, choose the value from the
-                // newer page
-                merged_pairs.push_back(*it1);
-                ++it1;
-                ++it2;
-            }
-
-            // remove tombstones if it's the last level
-            if (remove_tombstones_ && merged_pairs.back().second == INT_MAX)
-            {
-                merged_pairs.pop_back();
-            }
-
-            // Once we hit the max size, write the page to disk
-            if (merged_pairs.size() == MAX_PAGE_KV_PAIRS)
-            {
-                WriteLeafPage(temp_leaf_filename, merged_pairs,
-                              internal_node_max_keys);
-                merged_pairs.clear();
-            }
+            page_id++;
+            continue;
         }
 
-        // Handle when an iterator reaches the end
-        if (it1 == pairs.end() && page.IsLeafPage())
+        // Read the run of leaves up to the next cached one at once
+        int run_end = page_id + 1;
+        BTreePageView cached;
+        while (run_end < end_page_id &&
+               !buffer_pool_.TryGetPage(filename_, run_end, &cached))
         {
-            page_id += 1;
-            page = ReadPageFromDisk(page_id, filename_);
-            pairs = page.GetKeyValues();
-            it1 = pairs.begin();
+            run_end++;
         }
-
-        if (it2 == pairs_to_merge.end() && page_to_merge.IsLeafPage())
+        size_t num_bytes = static_cast<size_t>(run_end - page_id) * PAGE_SIZE;
+        void *aligned_buffer;
+        if (posix_memalign(&aligned_buffer, PAGE_SIZE, num_bytes) != 0)
+        {
+            throw std::runtime_error("Failed to allocate aligned memory");
+        }
+        std::unique_ptr<std::byte, decltype(&free)> buffer(
+            static_cast<std::byte *>(aligned_buffer), &free);
+        ssize_t bytes_read = GetFile().Read(
+            buffer.get(), num_bytes, static_cast<off_t>(page_id) * PAGE_SIZE);
+        int num_pages = bytes_read <= 0 ? 0 : bytes_read / PAGE_SIZE;
+        pages_read_ += num_pages;
+
+        // Each page gets its own frame, so that a cached page does not keep
+        // the whole run in memory
+        for (int i = 0; i < num_pages; i++)
+        {
+            PageFrame frame = AllocatePageFrame();
+            std::memcpy(frame.get(),
+                        buffer.get() + static_cast<size_t>(i) * PAGE_SIZE,
+                        PAGE_SIZE);
+            BTreePageView page(std::move(frame), page_id + i);
+            buffer_pool_.AddPage(filename_, page_id + i, page, true);
+            pages[page_id + i - first_page_id] = std::move(page);
+        }
+        if (num_pages < run_end - page_id)
+        {
+            // The file ended early, the scan stops at the invalid pages
+            break;
+        }
+        if (run_end < end_page_id)
         {
-            page_id_to_merge += 1;
-            page_to_merge =
-                ReadPageFromDisk(page_id_to_merge, filename_to_merge);
-            pairs_to_merge = page_to_merge.GetKeyValues();
-            it2 = pairs_to_merge.begin();
+            pages[run_end - first_page_id] = cached;
         }
+        page_id = run_end + 1;
     }
+    return pages;
+}
 
-    // At this point, we may have a page or page_to_merge that is not a leaf
-    // and one that is and has many more leaves. So check if one is still a leaf
-    // then loop through until we no longer have a leaf
-    while (page.IsLeafPage())
+std::vector<MergeOutput>
+BTreeManager::MergeBTreeFromFiles(const std::vector<std::string> &filenames,
+                                  const std::string &output_prefix,
+                                  int64_t start_key, int64_t end_key) const
+{
+    std::vector<MergeOutput> outputs;
+    try
+    {
+        MergeRangeIntoOutputs(filenames, output_prefix, start_key, end_key,
+                              outputs);
+    }
+    catch (...)
     {
-        while (it1 != pairs.end())
+        // Leave no finished or partly written output behind for the next
+        // Open to pick up
+        for (const auto &output : outputs)
         {
-            merged_pairs.push_back(*it1);
-            ++it1;
-            // remove tombstones if it's the last level
-            if (remove_tombstones_ && merged_pairs.back().second == INT_MAX)
-            {
-                merged_pairs.pop_back();
-            }
+            std::remove(output.filename.c_str());
+        }
+        throw;
+    }
+    return outputs;
+}
 
-            // Once we hit the max size, write the page to disk
-            if (merged_pairs.size() == MAX_PAGE_KV_PAIRS)
-            {
-                WriteLeafPage(temp_leaf_filename, merged_pairs,
-                              internal_node_max_keys);
-                merged_pairs.clear();
-            }
+void
+BTreeManager::MergeRangeIntoOutputs(const std::vector<std::string> &filenames,
+                                    const std::string &output_prefix,
+                                    int64_t start_key, int64_t end_key,
+                                    std::vector<MergeOutput> &outputs) const
+{
+    // The output is written once, front to back, by the builder. The Bloom
+    // filters are filled as the keys are written.
+    std::unique_ptr<BTreeBuilder> builder;
+    LeafFilterBlock leaf_filter_block;
+    auto start_output = [&]()
+    {
+        std::string filename = output_prefix + ".sst";
+        if (merge_options_.max_file_entries > 0)
+        {
+            std::stringstream partition_filename;
+            partition_filename << output_prefix << "_" << std::setfill('0')
+                               << std::setw(4) << outputs.size() << ".sst";
+            filename = partition_filename.str();
         }
+        outputs.push_back(
+            {filename, BloomFilter(BLOOM_FILTER_BITS), LeafFilterBlock()});
+        leaf_filter_block = LeafFilterBlock();
+        builder = std::make_unique<BTreeBuilder>(
+            filename, merge_options_.compress_leaf_pages,
+            merge_options_.build_leaf_filters ? &leaf_filter_block : nullptr,
+            merge_options_.rate_limiter, merge_options_.direct_io);
+        builder->SetMaxSequence(merge_options_.max_sequence);
+    };
+    auto finish_output = [&]()
+    {
+        builder->Finish();
+        outputs.back().leaf_filter_block = leaf_filter_block;
+    };
+    start_output();
 
-        if (it1 == pairs.end())
+    // Step 1: Open a cursor on the first pair of the range in every input.
+    // Only one leaf per input is held in memory.
+
+    std::vector<MergeCursor> cursors;
+    for (const auto &filename : filenames)
+    {
+        MergeCursor cursor{
+            filename, nullptr, INVALID_PAGE_ID, nullptr, {}, {}, 0};
+        if (SeekMergeCursor(cursor, static_cast<int>(start_key)))
         {
-            page_id += 1;
-            page = ReadPageFromDisk(page_id, filename_);
-            pairs = page.GetKeyValues();
-            it1 = pairs.begin();
+            cursors.push_back(std::move(cursor));
         }
     }
 
-    while (page_to_merge.IsLeafPage())
+    // Step 2: Merge the inputs in batches. The next leaf of every input
+    // starts past the last key of its current leaf, so all the pairs up to
+    // the smallest of those last keys are already in memory. The slices of
+    // the batch are merged from the newest input to the oldest, which keeps
+    // the newest value of a key first, and the older values and dropped
+    // tombstones are then removed with the dedupe kernel.
+    std::vector<int> batch_keys;
+    std::vector<int> batch_values;
+    std::vector<int> merged_keys;
+    std::vector<int> merged_values;
+    while (!cursors.empty())
     {
-        while (it2 != pairs_to_merge.end())
+        int64_t batch_max_key = end_key - 1;
+        for (const MergeCursor &cursor : cursors)
         {
-            merged_pairs.push_back(*it2);
-            ++it2;
-            // remove tombstones if it's the last level
-            if (remove_tombstones_ && merged_pairs.back().second == INT_MAX)
-            {
-                merged_pairs.pop_back();
-            }
-
-            // Once we hit the max size, write the page to disk
-            if (merged_pairs.size() == MAX_PAGE_KV_PAIRS)
-            {
-                WriteLeafPage(temp_leaf_filename, merged_pairs,
-                              internal_node_max_keys);
-                merged_pairs.clear();
-            }
+            batch_max_key =
+                std::min<int64_t>(batch_max_key, cursor.keys.back());
         }
 
-        if (it2 == pairs_to_merge.end())
+        batch_keys.clear();
+        batch_values.clear();
+        for (MergeCursor &cursor : cursors)
         {
-            page_id_to_merge += 1;
-            page_to_merge =
-                ReadPageFromDisk(page_id_to_merge, filename_to_merge);
-            pairs_to_merge = page_to_merge.GetKeyValues();
-            it2 = pairs_to_merge.begin();
+            size_t slice_end =
+                std::upper_bound(cursor.keys.begin() + cursor.pos,
+                                 cursor.keys.end(), batch_max_key) -
+                cursor.keys.begin();
+            size_t slice_size = slice_end - cursor.pos;
+            merged_keys.resize(batch_keys.size() + slice_size);
+            merged_values.resize(batch_keys.size() + slice_size);
+            MergeSortedRuns(batch_keys.data(), batch_values.data(),
+                            batch_keys.size(), &cursor.keys[cursor.pos],
+                            &cursor.values[cursor.pos], slice_size,
+                            merged_keys.data(), merged_values.data());
+            batch_keys.swap(merged_keys);
+            batch_values.swap(merged_values);
+            cursor.pos = slice_end;
         }
-    }
 
-    // write any remaining pairs to disk
-    if (!merged_pairs.empty())
-    {
-        // loop through pairs and remove tombstones if it's the last level
-        if (remove_tombstones_)
+        // Inputs that are used up, or past the key range, are done
+        cursors.erase(std::remove_if(cursors.begin(), cursors.end(),
+                                     [&](MergeCursor &cursor)
+                                     {
+                                         return !AdvanceMergeCursor(cursor) ||
+                                                cursor.keys[cursor.pos] >=
+                                                    end_key;
+                                     }),
+                      cursors.end());
+
+        // remove tombstones if it's the last level
+        merged_keys.resize(batch_keys.size());
+        merged_values.resize(batch_keys.size());
+        size_t num_pairs = DedupeMergedRun(
+            batch_keys.data(), batch_values.data(), batch_keys.size(),
+            remove_tombstones_, merged_keys.data(), merged_values.data());
+
+        for (size_t i = 0; i < num_pairs; i++)
         {
-            auto it = merged_pairs.begin();
-            while (it != merged_pairs.end())
+            if (merge_options_.max_file_entries > 0 &&
+                static_cast<uint64_t>(builder->GetNumEntries()) ==
+                    merge_options_.max_file_entries)
             {
-                if (it->second == INT_MAX)
-                {
-                    it = merged_pairs.erase(it);
-                }
-                else
-                {
-                    ++it;
-                }
+                finish_output();
+                start_output();
             }
+            builder->Add(merged_keys[i], merged_values[i]);
+            outputs.back().bloom_filter.Insert(merged_keys[i]);
         }
-        WriteLeafPage(temp_leaf_filename, merged_pairs, internal_node_max_keys);
-    }
-
-    // Using the max keys from the internal nodes, construct the internal nodes
-    ConstructInternalNodes(temp_internal_filename, internal_node_max_keys);
-
-    // combine the internal and leaf pages into a single file
-    std::ifstream temp_leaf_file(temp_leaf_filename, std::ios::binary);
-    std::ifstream temp_internal_file(temp_internal_filename, std::ios::binary);
-    std::ofstream output_file(merge_filename, std::ios::binary);
-    if (!temp_leaf_file.is_open() || !temp_internal_file.is_open() ||
-        !output_file.is_open())
-    {
-        throw std::runtime_error("Failed to open temporary files");
     }
 
-    // Copy the contents of the temporary files to the output file
-    temp_internal_file.seekg(0, std::ios::beg);
-    output_file << temp_internal_file.rdbuf();
-    temp_leaf_file.seekg(0, std::ios::beg);
-    output_file << temp_leaf_file.rdbuf();
-
-    // Close the files and remove the temporary files
-    output_file.close();
-    temp_leaf_file.close();
-    temp_internal_file.close();
-    std::remove(temp_leaf_filename.c_str());
-    std::remove(temp_internal_filename.c_str());
-
-    return merge_filename;
+    finish_output();
 }
 
-void
-BTreeManager::WriteLeafPage(std::string &filename,
-                            std::vector<std::pair<int, int>> &keys,
-                            std::vector<int> &internal_node_max_keys)
+/* Point the cursor at the first pair with a key not less than the given one.
+   Returns false if the input has no such pair. */
+bool
+BTreeManager::SeekMergeCursor(MergeCursor &cursor, int key) const
 {
-    BTreePage page(keys);
-    page.SetPageType(BTreePageType::LEAF_PAGE);
-    page.SetSize(keys.size());
-    page.WriteToDisk(filename);
-
-    // Add the max key to the internal node
-    internal_node_max_keys.push_back(page.GetMaxKey());
-}
-
-void
-BTreeManager::ConstructInternalNodes(std::string &filename,
-                                     std::vector<int> &max_keys)
-{
-    // Holds all layers of internal nodes
-    std::vector<std::vector<BTreePage>> internal_page_layers;
-    std::vector<int> internal_node_max_keys;
-
-    // Loop until only one node remains in the current layer
-    while (!max_keys.empty())
+    SstFooter footer = footer_;
+    if (cursor.filename != filename_)
     {
-        std::vector<BTreePage> internal_pages;
-
-        // Construct internal nodes for the current layer
-        for (size_t i = 0; i < max_keys.size(); i += MAX_PAGE_KV_PAIRS)
-        {
-            std::vector<std::pair<int, int>> keys;
-
-            for (size_t j = i; j < i + MAX_PAGE_KV_PAIRS && j < max_keys.size();
-                 j++)
-            {
-                keys.push_back(
-                    {max_keys[j], -1});  // -1 is a placeholder for now
-            }
-
-            // Create and populate the internal node
-            BTreePage page(keys);
-            page.SetPageType(BTreePageType::INTERNAL_PAGE);
-            page.SetSize(keys.size());
-            internal_pages.push_back(page);
-
-            // Record the max key for the next layer
-            internal_node_max_keys.push_back(page.GetMaxKey());
-        }
+        footer.ReadFromFile(cursor.filename);
+    }
+    if (footer.root_page_id < 0)
+    {
+        return false;
+    }
 
-        // Save the current layer and prepare for the next
-        internal_page_layers.push_back(internal_pages);
-        max_keys = internal_node_max_keys;
-        internal_node_max_keys.clear();
-        if (max_keys.size() == 1)
+    // The pages are read directly, so that merge threads do not share the
+    // buffer pool. The file stays open for the reads ahead of the cursor.
+    if (cursor.filename == filename_)
+    {
+        GetFile();
+        cursor.file = file_;
+    }
+    else
+    {
+        cursor.file = io_engine_.OpenFile(cursor.filename);
+    }
+    int page_id = footer.root_page_id;
+    BTreePageView page = ReadPageFromDisk(page_id, *cursor.file);
+    while (page.IsInternalPage())
+    {
+        page_id = page.FindChildPage(key);
+        if (page_id == -1)
         {
-            break;
+            return false;
         }
+        page = ReadPageFromDisk(page_id, *cursor.file);
+    }
+    if (!page.IsLeafPage())
+    {
+        return false;
     }
 
-    // loop through the nodes and set the child_page_ids
-    // The root is 0 so the roots first child is 1, the second child is 2, etc.
-    // The next layer starts at the next available page_id
+    // Stream the leaves after this one. Files without a footer end with
+    // their leaves.
+    int end_page_id = footer.num_leaf_pages < 0
+                          ? -1
+                          : footer.first_leaf_page_id + footer.num_leaf_pages;
+    cursor.reader = std::make_unique<SequentialPageReader>(
+        cursor.file, page_id + 1, end_page_id,
+        merge_options_.rate_limiter);
+    cursor.page_id = page_id;
+    LoadMergeCursorLeaf(cursor, page);
+    cursor.pos = std::lower_bound(cursor.keys.begin(), cursor.keys.end(), key) -
+                 cursor.keys.begin();
+    return AdvanceMergeCursor(cursor);
+}
 
-    int child_page_id = 0;
-    // Loop through the layers of internal nodes in reverse order
-    for (size_t i = internal_page_layers.size(); i > 0; i--)
+/* Make sure the cursor points at a pair, reading the next leaf once the
+   current one is used up. Returns false when the input has no pairs left. */
+bool
+BTreeManager::AdvanceMergeCursor(MergeCursor &cursor) const
+{
+    while (cursor.pos >= cursor.keys.size())
     {
-        std::vector<BTreePage> internal_pages = internal_page_layers[i - 1];
-        for (auto page : internal_pages)
+        // The leaf pages are stored consecutively, and the first page after
+        // the last leaf is not a leaf
+        BTreePageView page = cursor.reader->NextPage();
+        cursor.page_id = page.GetPageId();
+        if (!page.IsLeafPage())
         {
-            // Set the child page ids for the internal node
-            for (size_t k = 0; k < static_cast<size_t>(page.GetSize()); k++)
-            {
-                child_page_id += 1;
-                page.SetValueAtIdx(k, child_page_id);
-            }
-
-            // Write the internal node to disk
-            page.WriteToDisk(filename);
+            return false;
         }
+        LoadMergeCursorLeaf(cursor, page);
+        cursor.pos = 0;
     }
+    return true;
 }
 
-std::string
-BTreeManager::DetermineMergeFilename(const std::string &filename1,
-                                     const std::string &filename2)
+void
+BTreeManager::LoadMergeCursorLeaf(MergeCursor &cursor,
+                                  const BTreePageView &page) const
 {
-    // Check if they each have the same level. if not, return an error
-    std::string level1 = filename1.substr(filename1.find("sst_") + 4, 4);
-    std::string level2 = filename2.substr(filename2.find("sst_") + 4, 4);
-    if (level1 != level2)
+    cursor.keys.clear();
+    cursor.values.clear();
+    for (const auto &pair : page.GetKeyValues())
     {
-        throw std::runtime_error("Cannot merge B-trees of different levels");
+        cursor.keys.push_back(pair.first);
+        cursor.values.push_back(pair.second);
     }
+}
 
-    // increment the level.
-    int new_level = std::stoi(level1) + 1;
-    if (new_level > largest_lsm_level_)
-    {
-        remove_tombstones_ = true;
-    }
+int
+BTreeManager::GetFileLevel(const std::string &filename) const
+{
+    // The filename is the format sst_level_timestamp.sst
+    return std::stoi(filename.substr(filename.find("sst_") + 4, 4));
+}
 
+std::string
+BTreeManager::DetermineMergeFilename(int new_level) const
+{
     // Create a new timestamp
     auto now = std::chrono::system_clock::now();
     auto now_ms = std::chrono::duration_cast<std::chrono::microseconds>(
@@ -598,13 +979,111 @@ BTreeManager::DetermineMergeFilename(const std::string &filename1,
     return new_filename.str();
 }
 
-BTreePage
+BTreePageView
 BTreeManager::GetPageFromBufferOrDisk(const std::string &filename,
                                       int page_id) const
 {
-    auto load_page_from_disk = [this](int page_id,
-                                      const std::string &filename) -> BTreePage
-    { return ReadPageFromDisk(page_id, filename); };
+    if (mapped_file_ && filename == filename_)
+    {
+        return GetMappedPage(page_id);
+    }
+
+    auto load_page_from_disk =
+        [this](int page_id, const std::string &filename) -> BTreePageView
+    {
+        pages_read_++;
+        return ReadPageFromDisk(page_id, filename);
+    };
 
     return buffer_pool_.GetPageFromId(filename, page_id, load_page_from_disk);
-};
\ No newline at end of file
+};
+
+std::vector<BTreePageView>
+BTreeManager::GetPagesFromBufferOrDisk(const std::vector<int> &page_ids) const
+{
+    std::vector<BTreePageView> pages(page_ids.size());
+    if (mapped_file_)
+    {
+        for (size_t i = 0; i < page_ids.size(); i++)
+        {
+            pages[i] = GetMappedPage(page_ids[i]);
+        }
+        return pages;
+    }
+
+    std::vector<size_t> missing;
+    std::vector<int> missing_page_ids;
+    for (size_t i = 0; i < page_ids.size(); i++)
+    {
+        if (!buffer_pool_.TryGetPage(filename_, page_ids[i], &pages[i]))
+        {
+            missing.push_back(i);
+            missing_page_ids.push_back(page_ids[i]);
+        }
+    }
+    if (missing.empty())
+    {
+        return pages;
+    }
+
+    pages_read_ += missing.size();
+    std::vector<BTreePageView> loaded = ReadPagesFromDisk(missing_page_ids);
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+        buffer_pool_.AddPage(filename_, missing_page_ids[i], loaded[i]);
+        pages[missing[i]] = std::move(loaded[i]);
+    }
+    return pages;
+}
+
+BTreePageView
+BTreeManager::GetMappedPage(int page_id) const
+{
+    PageFrame frame = mapped_file_->GetPage(page_id);
+    if (!frame)
+    {
+        return BTreePageView();
+    }
+    return BTreePageView(std::move(frame), page_id);
+}
+
+uint64_t
+BTreeManager::GetPagesRead() const
+{
+    return pages_read_;
+}
+
+BTreePageView
+BTreeManager::GetRootPage() const
+{
+    if (footer_.root_page_id < 0)
+    {
+        // The tree is empty
+        return BTreePageView();
+    }
+    return GetPageFromBufferOrDisk(filename_, footer_.root_page_id);
+}
+
+int
+BTreeManager::FindFirstLeafPageId(const std::string &filename) const
+{
+    SstFooter footer = footer_;
+    if (filename != filename_)
+    {
+        footer.ReadFromFile(filename);
+    }
+    if (footer.first_leaf_page_id >= 0)
+    {
+        return footer.first_leaf_page_id;
+    }
+
+    // Without a footer, follow the leftmost children down from the root
+    int page_id = footer.root_page_id;
+    BTreePageView page = ReadPageFromDisk(page_id, filename);
+    while (page.IsInternalPage())
+    {
+        page_id = page.FindChildPage(INT_MIN);
+        page = ReadPageFromDisk(page_id, filename);
+    }
+    return page_id;
+}
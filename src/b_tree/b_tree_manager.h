@@ -1,46 +1,181 @@
 #ifndef B_TREE_MANAGER_H
 #define B_TREE_MANAGER_H
 
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "../bloom_filter/bloom_filter.h"
+#include "../bloom_filter/leaf_filter_block.h"
 #include "../buffer_pool/buffer_pool.h"
+#include "../compaction/rate_limiter.h"
+#include "../io/io_engine.h"
+#include "../io/mapped_file.h"
+#include "../scheduler/task_scheduler.h"
 #include "b_tree_page.h"
+#include "b_tree_page_view.h"
+#include "sequential_page_reader.h"
+#include "sst_footer.h"
+
+// One output file of a merge, with the filters built while writing it.
+struct MergeOutput
+{
+    std::string filename;
+    BloomFilter bloom_filter;
+    LeafFilterBlock leaf_filter_block;  // empty unless leaf filters are built
+};
+
+// How the output of a merge is written.
+struct MergeOptions
+{
+    bool build_leaf_filters = false;
+    bool compress_leaf_pages = false;
+    // Split the output into files of at most this many entries with disjoint
+    // key ranges. 0 writes a single file.
+    uint64_t max_file_entries = 0;
+    // Split large merges into up to this many key ranges that are merged on
+    // their own threads.
+    int max_subcompactions = 1;
+    // If set, every page the merge reads or writes waits for its bytes.
+    RateLimiter* rate_limiter = nullptr;
+    // Recorded in the footer of every output, the largest sequence number
+    // of the inputs.
+    uint64_t max_sequence = 0;
+    // Write the outputs with O_DIRECT where the file system supports it.
+    bool direct_io = false;
+    // Directory the outputs are written to, so that merges of different
+    // databases never share a filename. Empty writes them to the working
+    // directory.
+    std::string output_dir;
+    // If set, the subranges are merged as tasks of this scheduler instead of
+    // on threads of their own.
+    TaskScheduler* scheduler = nullptr;
+};
 
 class BTreeManager
 {
    public:
     BTreeManager(const std::string& filename, int largest_lsm_level,
                  BufferPool& buffer_pool);
+    // Use a footer that was already read, to avoid reading it again. If file
+    // is given, pages are read through it and its engine, and the other
+    // files of a merge are opened with the same engine. Otherwise the file
+    // is opened with the default pread engine on the first read. If
+    // mapped_file is given, lookups and scans read the pages in place in
+    // the mapping instead, without the buffer pool.
+    BTreeManager(const std::string& filename, int largest_lsm_level,
+                 BufferPool& buffer_pool, const SstFooter& footer,
+                 std::shared_ptr<IoFile> file = nullptr,
+                 std::shared_ptr<MappedFile> mapped_file = nullptr);
     int Get(int key);
     int BinarySearchGet(int key) const;
+    // Look up a key in a known leaf page, skipping the internal nodes
+    int GetFromLeafPage(int leaf_page_id, int key) const;
+    // Look up a batch of keys sorted in ascending order. Every page on the
+    // way is read once for all the keys that route through it.
+    std::vector<int> MultiGet(
+        const std::vector<int>& keys,
+        const LeafFilterBlock* leaf_filter_block = nullptr) const;
     std::vector<std::pair<int, int>> Scan(int start_key, int end_key);
-    // Merge the BTree with another BTree file, return output filename
-    std::string Merge(const std::string& filename_to_merge);
+    // Merge the BTree with another BTree file, return output filename. If
+    // leaf_filter_block is given, it is filled with the merged leaf filters.
+    std::string Merge(const std::string& filename_to_merge,
+                      LeafFilterBlock* leaf_filter_block = nullptr,
+                      bool compress_leaf_pages = false);
+    // Merge the BTree with any number of older BTree files in a single pass
+    // into new files on output_level. The files are given newest first, and
+    // the newest value of a key wins. Tombstones are dropped if no older
+    // file is left outside the merge. The outputs are returned in key order.
+    std::vector<MergeOutput> MergeMany(
+        const std::vector<std::string>& filenames_to_merge, int output_level,
+        bool drop_tombstones, const MergeOptions& options = MergeOptions());
+
+    // Number of pages this manager has read from disk for lookups and
+    // scans, that were not in the buffer pool.
+    uint64_t GetPagesRead() const;
 
     // used for testing, would otherwise be private
-    BTreePage TraverseToKey(int key) const;
+    BTreePageView TraverseToKey(int key) const;
 
    private:
     std::string filename_;
     int largest_lsm_level_;
     bool remove_tombstones_;
     BufferPool& buffer_pool_;
-    BTreePage ReadPageFromDisk(int page_id, const std::string& filename) const;
+    SstFooter footer_;
+    MergeOptions merge_options_;
+    mutable uint64_t pages_read_;
+    IoEngine& io_engine_;
+    mutable std::shared_ptr<IoFile> file_;
+    mutable std::once_flag file_opened_;
+    std::shared_ptr<MappedFile> mapped_file_;
+    BTreePageView GetRootPage() const;
+    int FindFirstLeafPageId(const std::string& filename) const;
+    const IoFile& GetFile() const;
+    BTreePageView ReadPageFromDisk(int page_id,
+                                   const std::string& filename) const;
+    BTreePageView ReadPageFromDisk(int page_id, const IoFile& file) const;
+    // Read pages of this manager's file as one batch
+    std::vector<BTreePageView> ReadPagesFromDisk(
+        const std::vector<int>& page_ids) const;
 
     std::vector<std::pair<int, int>> TraverseRange(int start_key,
                                                    int end_key) const;
-    std::string MergeBTreeFromFile(const std::string& filename_to_merge);
-    std::string DetermineMergeFilename(const std::string& filename1,
-                                       const std::string& filename2);
-    void ConstructInternalNodes(std::string& filename,
-                                std::vector<int>& max_keys);
-    void WriteLeafPage(std::string& filename,
-                       std::vector<std::pair<int, int>>& keys,
-                       std::vector<int>& internal_node_max_keys);
-    BTreePage GetPageFromBufferOrDisk(const std::string& filename,
-                                      int page_id) const;
+    // Read the leaves in [first_page_id, end_page_id) ahead of a scan. The
+    // cached ones come from the buffer pool, and each run of missing ones is
+    // read with one large read and cached with low priority.
+    std::deque<BTreePageView> ReadAheadLeaves(int first_page_id,
+                                              int end_page_id) const;
+    // The id of the leaf a key belongs in, found through the internal pages
+    // without reading the leaf. Needs the leaf range of the footer.
+    int FindLeafPageId(int key) const;
+    // Reads the leaves of one input file in key order during a merge. The
+    // keys and values of the current leaf are kept in separate arrays for
+    // the merge kernel. The leaves after it are read ahead in large chunks.
+    struct MergeCursor
+    {
+        std::string filename;
+        std::shared_ptr<IoFile> file;
+        int page_id;
+        std::unique_ptr<SequentialPageReader> reader;
+        std::vector<int> keys;
+        std::vector<int> values;
+        size_t pos;
+    };
+    bool SeekMergeCursor(MergeCursor& cursor, int key) const;
+    bool AdvanceMergeCursor(MergeCursor& cursor) const;
+    void LoadMergeCursorLeaf(MergeCursor& cursor,
+                             const BTreePageView& page) const;
+    std::vector<int> ChooseSubcompactionBounds(
+        const std::vector<std::string>& filenames,
+        int max_subcompactions) const;
+    // Merge the keys in [start_key, end_key) into files named
+    // output_prefix.sst, or output_prefix_pppp.sst when split. If the merge
+    // fails, every file it wrote is removed.
+    std::vector<MergeOutput> MergeBTreeFromFiles(
+        const std::vector<std::string>& filenames,
+        const std::string& output_prefix, int64_t start_key,
+        int64_t end_key) const;
+    // Does the work of MergeBTreeFromFiles. Each output is added to outputs
+    // before its file is created.
+    void MergeRangeIntoOutputs(const std::vector<std::string>& filenames,
+                               const std::string& output_prefix,
+                               int64_t start_key, int64_t end_key,
+                               std::vector<MergeOutput>& outputs) const;
+    int GetFileLevel(const std::string& filename) const;
+    std::string DetermineMergeFilename(int new_level) const;
+    BTreePageView GetPageFromBufferOrDisk(const std::string& filename,
+                                          int page_id) const;
+    // A view of a page in the mapping of this manager's file
+    BTreePageView GetMappedPage(int page_id) const;
+    // Look up pages of this manager's file in the buffer pool, and read the
+    // ones that are missing from disk as one batch.
+    std::vector<BTreePageView> GetPagesFromBufferOrDisk(
+        const std::vector<int>& page_ids) const;
 };
 
 #endif
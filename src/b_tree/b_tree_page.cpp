@@ -16,16 +16,21 @@
 #include <vector>
 
 #include "../config.h"
+#include "leaf_compression.h"
 
 // Constructor for an empty, invalid page.
 BTreePage::BTreePage()
-    : page_type_(BTreePageType::INVALID_PAGE), size_(0), page_id_(-1)
+    : page_type_(BTreePageType::INVALID_PAGE),
+      format_(BTreePageFormat::PAX),
+      size_(0),
+      page_id_(-1)
 {
 }
 
 // Constructor to build a page from a list of key-value pairs.
 BTreePage::BTreePage(const std::vector<std::pair<int, int>> &key_value_pairs)
     : page_type_(BTreePageType::INVALID_PAGE),
+      format_(BTreePageFormat::PAX),
       size_(key_value_pairs.size()),
       page_id_(-1)
 {
@@ -66,6 +71,18 @@ BTreePage::GetPageType() const
     return page_type_;
 }
 
+void
+BTreePage::SetPageFormat(BTreePageFormat format)
+{
+    format_ = format;
+}
+
+BTreePageFormat
+BTreePage::GetPageFormat() const
+{
+    return format_;
+}
+
 void
 BTreePage::SetSize(int size)
 {
@@ -115,44 +132,7 @@ BTreePage::WriteToDisk(const std::string &filename) const
     }
     std::memset(aligned_buffer, 0, PAGE_SIZE);
 
-    std::byte *buffer_ptr = static_cast<std::byte *>(aligned_buffer);
-    int bytes_written = 0;
-
-    // Write the page type to the buffer
-    BTreePageType page_type = GetPageType();
-    std::memcpy(buffer_ptr, &page_type, sizeof(page_type));
-    buffer_ptr += sizeof(page_type);
-    bytes_written += sizeof(page_type);
-
-    // Write the size of the page to the buffer
-    int size = GetSize();
-    std::memcpy(buffer_ptr, &size, sizeof(size));
-    buffer_ptr += sizeof(size);
-    bytes_written += sizeof(size);
-
-    // Write the key-value pairs to the buffer
-    for (int i = 0; i < GetSize(); i++)
-    {
-        std::memcpy(buffer_ptr, &keys_[i], sizeof(keys_[i]));
-        buffer_ptr += sizeof(keys_[i]);
-        bytes_written += sizeof(keys_[i]);
-
-        std::memcpy(buffer_ptr, &values_[i], sizeof(values_[i]));
-        buffer_ptr += sizeof(values_[i]);
-        bytes_written += sizeof(values_[i]);
-    }
-
-    // Write the child page ID for internal nodes (if applicable)
-    if (page_type == BTreePageType::INTERNAL_PAGE)
-    {
-        std::memcpy(buffer_ptr, &values_.back(), sizeof(values_.back()));
-        buffer_ptr += sizeof(values_.back());
-        bytes_written += sizeof(values_.back());
-    }
-
-    // Zero-pad the rest of the buffer to PAGE_SIZE
-    unsigned int num_bytes_to_pad = PAGE_SIZE - bytes_written;
-    std::memset(buffer_ptr, 0, num_bytes_to_pad);
+    SerializeToBuffer(static_cast<std::byte *>(aligned_buffer));
 
     // Write the aligned buffer to disk
     ssize_t written =
@@ -169,6 +149,45 @@ BTreePage::WriteToDisk(const std::string &filename) const
     close(fd);
 }
 
+void
+BTreePage::SerializeToBuffer(std::byte *buffer) const
+{
+    std::memset(buffer, 0, PAGE_SIZE);
+    std::byte *buffer_ptr = buffer;
+
+    // Only leaf pages can be compressed
+    BTreePageFormat format = BTreePageFormat::PAX;
+    if (format_ == BTreePageFormat::COMPRESSED && IsLeafPage())
+    {
+        format = BTreePageFormat::COMPRESSED;
+    }
+
+    // Write the page type and the layout format to the buffer
+    uint32_t type_and_format = static_cast<uint32_t>(GetPageType()) |
+                               (static_cast<uint32_t>(format) << 16);
+    std::memcpy(buffer_ptr, &type_and_format, sizeof(type_and_format));
+    buffer_ptr += sizeof(type_and_format);
+
+    // Write the size of the page to the buffer
+    int size = GetSize();
+    std::memcpy(buffer_ptr, &size, sizeof(size));
+    buffer_ptr += sizeof(size);
+
+    if (format == BTreePageFormat::COMPRESSED)
+    {
+        EncodeCompressedLeaf(keys_.data(), values_.data(), size, buffer);
+        return;
+    }
+
+    // Write all the keys, then all the values. Internal nodes have one more
+    // value than keys for the right most child.
+    std::memcpy(buffer_ptr, keys_.data(), size * sizeof(int));
+    buffer_ptr += size * sizeof(int);
+
+    int num_values = IsInternalPage() ? size + 1 : size;
+    std::memcpy(buffer_ptr, values_.data(), num_values * sizeof(int));
+}
+
 int
 BTreePage::Get(int key) const
 {
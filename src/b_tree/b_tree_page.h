@@ -1,6 +1,7 @@
 #ifndef B_TREE_PAGE_H
 #define B_TREE_PAGE_H
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -12,6 +13,16 @@ enum class BTreePageType
     LEAF_PAGE = 2,
 };
 
+// Layout of the key/value arrays on disk. The format is stored in the upper
+// 16 bits of the page type field, so pages written before the field existed
+// read as INTERLEAVED.
+enum class BTreePageFormat
+{
+    INTERLEAVED = 0,  // (key, value) pairs
+    PAX = 1,          // all keys followed by all values
+    COMPRESSED = 2,   // bit-packed key deltas and values, leaf pages only
+};
+
 class BTreePage
 {
    public:
@@ -24,6 +35,10 @@ class BTreePage
     void SetPageType(BTreePageType page_type);
     BTreePageType GetPageType() const;
 
+    // Leaf pages can be written COMPRESSED, all other pages use PAX.
+    void SetPageFormat(BTreePageFormat format);
+    BTreePageFormat GetPageFormat() const;
+
     void SetSize(int size);
     int GetSize() const;
 
@@ -39,6 +54,8 @@ class BTreePage
     int GetMaxKey() const;
     int GetMinKey() const;
     void WriteToDisk(const std::string& filename) const;
+    // Write the page in the current on-disk format to a PAGE_SIZE buffer.
+    void SerializeToBuffer(std::byte* buffer) const;
 
     std::vector<std::pair<int, int>> GetKeyValues() const;
 
@@ -46,6 +63,7 @@ class BTreePage
 
    private:
     BTreePageType page_type_;
+    BTreePageFormat format_;
     int size_;
     int page_id_;
     std::vector<int> keys_;
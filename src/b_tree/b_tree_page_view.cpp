@@ -0,0 +1,255 @@
+#include "b_tree_page_view.h"
+
+#include <cstdlib>  // For posix_memalign
+#include <cstring>  // For memcpy, memset
+#include <stdexcept>
+
+#include "../config.h"
+#include "key_search.h"
+#include "leaf_compression.h"
+
+namespace
+{
+// The page starts with the page type and format, and the number of keys.
+// PAX pages then store all keys followed by all values; interleaved pages
+// store (key, value) pairs. Internal pages have one extra child id at the end.
+// Compressed leaves are laid out as described in leaf_compression.h.
+constexpr size_t kHeaderSize = sizeof(uint32_t) + sizeof(int);
+
+int
+ReadInt(const std::byte *ptr)
+{
+    int value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+}  // namespace
+
+PageFrame
+AllocatePageFrame()
+{
+    void *aligned_buffer;
+    if (posix_memalign(&aligned_buffer, PAGE_SIZE, PAGE_SIZE) != 0)
+    {
+        throw std::runtime_error("Failed to allocate aligned memory");
+    }
+    std::memset(aligned_buffer, 0, PAGE_SIZE);
+
+    return PageFrame(static_cast<std::byte *>(aligned_buffer),
+                     [](std::byte *ptr) { free(ptr); });
+}
+
+BTreePageView::BTreePageView()
+    : page_type_(BTreePageType::INVALID_PAGE),
+      format_(BTreePageFormat::INTERLEAVED),
+      size_(0),
+      page_id_(-1),
+      keys_(nullptr),
+      values_(nullptr),
+      stride_(1)
+{
+}
+
+BTreePageView::BTreePageView(PageFrame frame, int page_id)
+    : frame_(std::move(frame)),
+      page_type_(BTreePageType::INVALID_PAGE),
+      format_(BTreePageFormat::INTERLEAVED),
+      size_(0),
+      page_id_(page_id),
+      keys_(nullptr),
+      values_(nullptr),
+      stride_(1)
+{
+    if (!frame_)
+    {
+        return;
+    }
+
+    uint32_t type_and_format;
+    std::memcpy(&type_and_format, frame_.get(), sizeof(type_and_format));
+    page_type_ = static_cast<BTreePageType>(type_and_format & 0xffff);
+    format_ = static_cast<BTreePageFormat>(type_and_format >> 16);
+    size_ = ReadInt(frame_.get() + sizeof(uint32_t));
+
+    // An empty or corrupted page is treated as invalid
+    int max_size = format_ == BTreePageFormat::COMPRESSED
+                       ? MAX_COMPRESSED_LEAF_KV_PAIRS
+                       : MAX_PAGE_KV_PAIRS;
+    bool valid_type = page_type_ == BTreePageType::LEAF_PAGE ||
+                      page_type_ == BTreePageType::INTERNAL_PAGE;
+    bool valid_format =
+        format_ == BTreePageFormat::INTERLEAVED ||
+        format_ == BTreePageFormat::PAX ||
+        (format_ == BTreePageFormat::COMPRESSED &&
+         page_type_ == BTreePageType::LEAF_PAGE);
+    if (!valid_type || !valid_format || size_ <= 0 || size_ > max_size)
+    {
+        page_type_ = BTreePageType::INVALID_PAGE;
+        size_ = 0;
+        return;
+    }
+
+    const int *data =
+        reinterpret_cast<const int *>(frame_.get() + kHeaderSize);
+    switch (format_)
+    {
+        case BTreePageFormat::INTERLEAVED:
+            keys_ = data;
+            values_ = data + 1;
+            stride_ = 2;
+            break;
+        case BTreePageFormat::PAX:
+            keys_ = data;
+            values_ = data + size_;
+            break;
+        case BTreePageFormat::COMPRESSED:
+        {
+            // Decode into one array of keys followed by one of values, each
+            // rounded up to whole groups of 8 for the vectorized decoder
+            int padded_size = (size_ + 7) / 8 * 8;
+            decoded_ = std::make_shared<std::vector<int>>(2 * padded_size);
+            DecodeCompressedLeaf(frame_.get(), size_, decoded_->data(),
+                                 decoded_->data() + padded_size);
+            keys_ = decoded_->data();
+            values_ = decoded_->data() + padded_size;
+            break;
+        }
+    }
+}
+
+bool
+BTreePageView::IsLeafPage() const
+{
+    return page_type_ == BTreePageType::LEAF_PAGE;
+}
+
+bool
+BTreePageView::IsInternalPage() const
+{
+    return page_type_ == BTreePageType::INTERNAL_PAGE;
+}
+
+BTreePageType
+BTreePageView::GetPageType() const
+{
+    return page_type_;
+}
+
+int
+BTreePageView::GetSize() const
+{
+    return size_;
+}
+
+int
+BTreePageView::GetPageId() const
+{
+    return page_id_;
+}
+
+int
+BTreePageView::KeyAt(int idx) const
+{
+    return keys_[idx * stride_];
+}
+
+int
+BTreePageView::ValueAt(int idx) const
+{
+    return values_[idx * stride_];
+}
+
+int
+BTreePageView::LowerBound(int key) const
+{
+    // Contiguous keys can be searched with vector compares
+    if (stride_ == 1)
+    {
+        return LowerBoundKeys(keys_, size_, key);
+    }
+
+    // Binary search over the interleaved pairs in the frame
+    int left = 0;
+    int right = size_;
+    while (left < right)
+    {
+        int mid = left + (right - left) / 2;
+        if (KeyAt(mid) < key)
+        {
+            left = mid + 1;
+        }
+        else
+        {
+            right = mid;
+        }
+    }
+    return left;
+}
+
+int
+BTreePageView::Get(int key) const
+{
+    int idx = LowerBound(key);
+    if (idx < size_ && KeyAt(idx) == key)
+    {
+        return ValueAt(idx);
+    }
+
+    return -1;
+}
+
+int
+BTreePageView::FindChildPage(int key) const
+{
+    // take the child of the first key that is equal to or greater than the
+    // given
+    int idx = LowerBound(key);
+    if (idx < size_)
+    {
+        return ValueAt(idx);
+    }
+
+    return -1;
+}
+
+std::vector<std::pair<int, int>>
+BTreePageView::Scan(int key1, int key2) const
+{
+    std::vector<std::pair<int, int>> result;
+    for (int i = LowerBound(key1); i < size_; i++)
+    {
+        int key = KeyAt(i);
+        if (key > key2)
+        {
+            break;
+        }
+        result.push_back({key, ValueAt(i)});
+    }
+
+    return result;
+}
+
+int
+BTreePageView::GetMaxKey() const
+{
+    return KeyAt(size_ - 1);
+}
+
+int
+BTreePageView::GetMinKey() const
+{
+    return KeyAt(0);
+}
+
+std::vector<std::pair<int, int>>
+BTreePageView::GetKeyValues() const
+{
+    std::vector<std::pair<int, int>> result;
+    result.reserve(size_);
+    for (int i = 0; i < size_; i++)
+    {
+        result.push_back({KeyAt(i), ValueAt(i)});
+    }
+
+    return result;
+}
@@ -0,0 +1,69 @@
+#ifndef B_TREE_PAGE_VIEW_H
+#define B_TREE_PAGE_VIEW_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "b_tree_page.h"
+
+// A PAGE_SIZE buffer holding one page exactly as it is stored on disk.
+using PageFrame = std::shared_ptr<std::byte>;
+
+// Allocate a zeroed, PAGE_SIZE aligned frame that frees itself once the last
+// view of it is gone.
+PageFrame AllocatePageFrame();
+
+/** Read-only view of a B-tree page in its on-disk frame.
+ *
+ *  The header and key/value arrays are read in place, so creating or copying
+ *  a view never decodes the page or allocates. This is what the buffer pool
+ *  caches and what lookups search. BTreePage is still used to build pages.
+ *  Both the PAX and the older interleaved page formats can be viewed.
+ *  Compressed leaves are the exception: they are decoded once when the view
+ *  is created, and copies of the view share the decoded arrays.
+ */
+class BTreePageView
+{
+   public:
+    // An invalid page, returned when a page cannot be read.
+    BTreePageView();
+    BTreePageView(PageFrame frame, int page_id);
+
+    bool IsLeafPage() const;
+    bool IsInternalPage() const;
+    BTreePageType GetPageType() const;
+    int GetSize() const;
+    int GetPageId() const;
+
+    // Used for the Leaf Pages
+    int Get(int key) const;
+    std::vector<std::pair<int, int>> Scan(int key1, int key2) const;
+    // Used for the Internal Pages
+    int FindChildPage(int key) const;
+
+    int GetMaxKey() const;
+    int GetMinKey() const;
+
+    std::vector<std::pair<int, int>> GetKeyValues() const;
+
+   private:
+    int KeyAt(int idx) const;
+    int ValueAt(int idx) const;
+    // Index of the first key that is >= key, or GetSize() if there is none.
+    int LowerBound(int key) const;
+
+    PageFrame frame_;
+    std::shared_ptr<std::vector<int>> decoded_;  // compressed leaves only
+    BTreePageType page_type_;
+    BTreePageFormat format_;
+    int size_;
+    int page_id_;
+    // Key i is at keys_[i * stride_], and its value at values_[i * stride_].
+    const int* keys_;
+    const int* values_;
+    int stride_;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "key_search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEY_SEARCH_X86 1
+#endif
+
+namespace
+{
+// Narrow the range with a binary search until this many keys are left, then
+// count the keys smaller than the search key with vector compares.
+constexpr int kLinearSearchWidth = 32;
+
+int
+CountLessThanScalar(const int* keys, int n, int key)
+{
+    int count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        count += keys[i] < key;
+    }
+    return count;
+}
+
+#ifdef KEY_SEARCH_X86
+int
+CountLessThanSse2(const int* keys, int n, int key)
+{
+    const __m128i needle = _mm_set1_epi32(key);
+    int count = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i block =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        // Lanes where key > keys[i] are all ones
+        __m128i less = _mm_cmpgt_epi32(needle, block);
+        count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+    }
+    return count + CountLessThanScalar(keys + i, n - i, key);
+}
+
+__attribute__((target("avx2"))) int
+CountLessThanAvx2(const int* keys, int n, int key)
+{
+    const __m256i needle = _mm256_set1_epi32(key);
+    int count = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i block =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        __m256i less = _mm256_cmpgt_epi32(needle, block);
+        count +=
+            __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+    }
+    return count + CountLessThanScalar(keys + i, n - i, key);
+}
+#endif
+
+using CountLessThanFn = int (*)(const int*, int, int);
+
+// Pick the widest implementation the CPU supports once, at startup
+CountLessThanFn
+SelectCountLessThan()
+{
+#ifdef KEY_SEARCH_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return CountLessThanAvx2;
+    }
+    return CountLessThanSse2;
+#else
+    return CountLessThanScalar;
+#endif
+}
+}  // namespace
+
+int
+LowerBoundKeys(const int* keys, int n, int key)
+{
+    int left = 0;
+    int right = n;
+    while (right - left > kLinearSearchWidth)
+    {
+        int mid = left + (right - left) / 2;
+        if (keys[mid] < key)
+        {
+            left = mid + 1;
+        }
+        else
+        {
+            right = mid;
+        }
+    }
+
+    // The keys are sorted, so the number of keys below the search key in the
+    // remaining window is the offset of the lower bound
+    static const CountLessThanFn count_less_than = SelectCountLessThan();
+    return left + count_less_than(keys + left, right - left, key);
+}
@@ -0,0 +1,9 @@
+#ifndef KEY_SEARCH_H
+#define KEY_SEARCH_H
+
+// Return the index of the first key that is >= key in a sorted, contiguous
+// array of n keys, or n if there is none. Uses AVX2 or SSE2 compares when
+// the CPU supports them and a scalar loop otherwise.
+int LowerBoundKeys(const int* keys, int n, int key);
+
+#endif
@@ -0,0 +1,276 @@
+#include "leaf_compression.h"
+
+#include <algorithm>
+#include <cstring>  // For memcpy, memset
+#include <vector>
+
+#include "../config.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEAF_COMPRESSION_X86 1
+#endif
+
+namespace
+{
+constexpr int kLanes = 8;
+constexpr size_t kLaneGroupBytes = kLanes * sizeof(uint32_t);
+
+// Offsets within the page, after the type/format and size fields
+constexpr size_t kKeyBaseOffset = 8;
+constexpr size_t kValueBaseOffset = 12;
+constexpr size_t kKeyBitsOffset = 16;
+constexpr size_t kValueBitsOffset = 17;
+constexpr size_t kDataOffset = 32;
+
+int
+BitWidth(uint32_t x)
+{
+    return x == 0 ? 0 : 32 - __builtin_clz(x);
+}
+
+uint32_t
+LowMask(int bits)
+{
+    return bits == 32 ? 0xffffffffu : (1u << bits) - 1;
+}
+
+// Bytes used by n packed values of the given width. One extra group of lane
+// words is kept as slack so that decoding can always load the next word.
+size_t
+PackedBytes(int n, int bits)
+{
+    if (bits == 0)
+    {
+        return 0;
+    }
+    size_t groups = (n + kLanes - 1) / kLanes;
+    size_t words_per_lane = (groups * bits + 31) / 32;
+    return (words_per_lane + 1) * kLaneGroupBytes;
+}
+
+void
+Pack(const uint32_t *input, int n, int bits, std::byte *out)
+{
+    if (bits == 0)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> words(PackedBytes(n, bits) / sizeof(uint32_t), 0);
+    for (int i = 0; i < n; i++)
+    {
+        size_t lane = i % kLanes;
+        size_t bit = static_cast<size_t>(i / kLanes) * bits;
+        size_t word = bit / 32;
+        size_t shift = bit % 32;
+        uint64_t x = static_cast<uint64_t>(input[i]) << shift;
+        words[word * kLanes + lane] |= static_cast<uint32_t>(x);
+        words[(word + 1) * kLanes + lane] |= static_cast<uint32_t>(x >> 32);
+    }
+    std::memcpy(out, words.data(), words.size() * sizeof(uint32_t));
+}
+
+void
+UnpackScalar(const std::byte *in, int groups, int bits, uint32_t *out)
+{
+    const uint32_t mask = LowMask(bits);
+    for (int g = 0; g < groups; g++)
+    {
+        size_t bit = static_cast<size_t>(g) * bits;
+        const std::byte *lo = in + (bit / 32) * kLaneGroupBytes;
+        const std::byte *hi = lo + kLaneGroupBytes;
+        for (int lane = 0; lane < kLanes; lane++)
+        {
+            uint32_t lo_word, hi_word;
+            std::memcpy(&lo_word, lo + lane * sizeof(uint32_t), 4);
+            std::memcpy(&hi_word, hi + lane * sizeof(uint32_t), 4);
+            uint64_t x = lo_word | (static_cast<uint64_t>(hi_word) << 32);
+            x >>= bit % 32;
+            out[g * kLanes + lane] = static_cast<uint32_t>(x) & mask;
+        }
+    }
+}
+
+#ifdef LEAF_COMPRESSION_X86
+__attribute__((target("avx2"))) void
+UnpackAvx2(const std::byte *in, int groups, int bits, uint32_t *out)
+{
+    const __m256i mask = _mm256_set1_epi32(LowMask(bits));
+    for (int g = 0; g < groups; g++)
+    {
+        size_t bit = static_cast<size_t>(g) * bits;
+        const std::byte *lo = in + (bit / 32) * kLaneGroupBytes;
+        __m256i lo_words =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lo));
+        __m256i hi_words = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(lo + kLaneGroupBytes));
+        // Shifting a lane by 32 gives zero, which is what the high word
+        // should contribute when the value starts at bit 0
+        __m128i shift = _mm_cvtsi32_si128(bit % 32);
+        __m128i shift_back = _mm_cvtsi32_si128(32 - bit % 32);
+        __m256i x = _mm256_or_si256(_mm256_srl_epi32(lo_words, shift),
+                                    _mm256_sll_epi32(hi_words, shift_back));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + g * kLanes),
+                            _mm256_and_si256(x, mask));
+    }
+}
+#endif
+
+void
+Unpack(const std::byte *in, int n, int bits, uint32_t *out)
+{
+    int groups = (n + kLanes - 1) / kLanes;
+    if (bits == 0)
+    {
+        std::memset(out, 0, groups * kLaneGroupBytes);
+        return;
+    }
+
+#ifdef LEAF_COMPRESSION_X86
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    if (has_avx2)
+    {
+        UnpackAvx2(in, groups, bits, out);
+        return;
+    }
+#endif
+    UnpackScalar(in, groups, bits, out);
+}
+}  // namespace
+
+size_t
+CompressedLeafBytes(int n, int key_bits, int value_bits)
+{
+    return kDataOffset + PackedBytes(n, key_bits) + PackedBytes(n, value_bits);
+}
+
+void
+EncodeCompressedLeaf(const int *keys, const int *values, int n,
+                     std::byte *page)
+{
+    // Keys become deltas from the previous key, values become offsets from
+    // the smallest value
+    std::vector<uint32_t> key_deltas(n, 0);
+    std::vector<uint32_t> value_offsets(n, 0);
+    int value_base = values[0];
+    for (int i = 0; i < n; i++)
+    {
+        value_base = std::min(value_base, values[i]);
+    }
+
+    uint32_t max_delta = 0;
+    uint32_t max_offset = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (i > 0)
+        {
+            key_deltas[i] = static_cast<uint32_t>(keys[i]) -
+                            static_cast<uint32_t>(keys[i - 1]);
+        }
+        value_offsets[i] = static_cast<uint32_t>(values[i]) -
+                           static_cast<uint32_t>(value_base);
+        max_delta = std::max(max_delta, key_deltas[i]);
+        max_offset = std::max(max_offset, value_offsets[i]);
+    }
+
+    uint8_t key_bits = BitWidth(max_delta);
+    uint8_t value_bits = BitWidth(max_offset);
+    std::memcpy(page + kKeyBaseOffset, &keys[0], sizeof(int));
+    std::memcpy(page + kValueBaseOffset, &value_base, sizeof(int));
+    std::memcpy(page + kKeyBitsOffset, &key_bits, sizeof(key_bits));
+    std::memcpy(page + kValueBitsOffset, &value_bits, sizeof(value_bits));
+
+    std::byte *data = page + kDataOffset;
+    Pack(key_deltas.data(), n, key_bits, data);
+    Pack(value_offsets.data(), n, value_bits, data + PackedBytes(n, key_bits));
+}
+
+void
+DecodeCompressedLeaf(const std::byte *page, int n, int *keys, int *values)
+{
+    int key_base, value_base;
+    uint8_t key_bits, value_bits;
+    std::memcpy(&key_base, page + kKeyBaseOffset, sizeof(int));
+    std::memcpy(&value_base, page + kValueBaseOffset, sizeof(int));
+    std::memcpy(&key_bits, page + kKeyBitsOffset, sizeof(key_bits));
+    std::memcpy(&value_bits, page + kValueBitsOffset, sizeof(value_bits));
+
+    const std::byte *data = page + kDataOffset;
+    uint32_t *key_words = reinterpret_cast<uint32_t *>(keys);
+    uint32_t *value_words = reinterpret_cast<uint32_t *>(values);
+    Unpack(data, n, key_bits, key_words);
+    Unpack(data + PackedBytes(n, key_bits), n, value_bits, value_words);
+
+    // Prefix sum of the deltas gives back the keys
+    uint32_t key = static_cast<uint32_t>(key_base);
+    for (int i = 0; i < n; i++)
+    {
+        key += key_words[i];
+        key_words[i] = key;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        value_words[i] += static_cast<uint32_t>(value_base);
+    }
+}
+
+CompressedLeafSizer::CompressedLeafSizer()
+{
+    Reset();
+}
+
+bool
+CompressedLeafSizer::TryAdd(int key, int value)
+{
+    if (size_ == 0)
+    {
+        size_ = 1;
+        last_key_ = key;
+        min_value_ = value;
+        max_value_ = value;
+        return true;
+    }
+
+    if (size_ + 1 > MAX_COMPRESSED_LEAF_KV_PAIRS)
+    {
+        return false;
+    }
+
+    uint32_t max_delta = std::max(
+        max_delta_,
+        static_cast<uint32_t>(key) - static_cast<uint32_t>(last_key_));
+    int min_value = std::min(min_value_, value);
+    int max_value = std::max(max_value_, value);
+    uint32_t max_offset = static_cast<uint32_t>(max_value) -
+                          static_cast<uint32_t>(min_value);
+    if (CompressedLeafBytes(size_ + 1, BitWidth(max_delta),
+                            BitWidth(max_offset)) > PAGE_SIZE)
+    {
+        return false;
+    }
+
+    size_++;
+    last_key_ = key;
+    max_delta_ = max_delta;
+    min_value_ = min_value;
+    max_value_ = max_value;
+    return true;
+}
+
+void
+CompressedLeafSizer::Reset()
+{
+    size_ = 0;
+    last_key_ = 0;
+    max_delta_ = 0;
+    min_value_ = 0;
+    max_value_ = 0;
+}
+
+int
+CompressedLeafSizer::GetSize() const
+{
+    return size_;
+}
@@ -0,0 +1,55 @@
+#ifndef LEAF_COMPRESSION_H
+#define LEAF_COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+
+/** Encoding of compressed leaf pages.
+ *
+ *  Keys are stored as deltas from the previous key and values as offsets
+ *  from the smallest value (frame of reference). Both are bit-packed with
+ *  the smallest width that fits, in 8 interleaved 32-bit lanes: entry i goes
+ *  to lane i % 8. Every group of 8 entries then sits at the same bit offset
+ *  in all lanes, so it can be unpacked with a single 256-bit shift and mask.
+ *
+ *  Compressed page layout (after the common type/format and size fields):
+ *      key_base | value_base | key_bits | value_bits | padding to 32 bytes
+ *      packed key deltas | packed value offsets
+ */
+
+// Number of bytes used on disk by a compressed leaf with n entries.
+size_t CompressedLeafBytes(int n, int key_bits, int value_bits);
+
+// Encode n sorted keys and their values into a PAGE_SIZE page buffer. The
+// page type/format and size fields must be written by the caller.
+void EncodeCompressedLeaf(const int* keys, const int* values, int n,
+                          std::byte* page);
+
+// Decode a compressed leaf page. keys and values must have room for n
+// entries rounded up to a multiple of 8.
+void DecodeCompressedLeaf(const std::byte* page, int n, int* keys,
+                          int* values);
+
+/** Tracks the encoded size of a compressed leaf while it is being filled, so
+ *  builders can pack as many entries as fit in a page.
+ */
+class CompressedLeafSizer
+{
+   public:
+    CompressedLeafSizer();
+
+    // Add the next (key, value) pair if the page still has room for it.
+    // Returns false and leaves the sizer unchanged if it does not.
+    bool TryAdd(int key, int value);
+    void Reset();
+    int GetSize() const;
+
+   private:
+    int size_;
+    int last_key_;
+    uint32_t max_delta_;
+    int min_value_;
+    int max_value_;
+};
+
+#endif
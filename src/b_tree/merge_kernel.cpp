@@ -0,0 +1,177 @@
+#include "merge_kernel.h"
+
+#include <climits>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MERGE_KERNEL_X86 1
+#endif
+
+namespace
+{
+size_t
+DedupeMergedRunScalar(const int* keys, const int* values, size_t size,
+                      bool drop_tombstones, int* out_keys, int* out_values)
+{
+    // Always write the pair, and only move past it if it is kept, so the
+    // loop has no data-dependent branch
+    size_t num_kept = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        bool is_first = i == 0 || keys[i] != keys[i - 1];
+        bool is_dropped = drop_tombstones && values[i] == INT_MAX;
+        out_keys[num_kept] = keys[i];
+        out_values[num_kept] = values[i];
+        num_kept += is_first && !is_dropped;
+    }
+    return num_kept;
+}
+
+#ifdef MERGE_KERNEL_X86
+// For every 8-bit mask of kept lanes, the indexes of the kept lanes moved
+// to the front
+struct CompressTable
+{
+    alignas(32) int32_t lanes[256][8];
+
+    CompressTable() : lanes()
+    {
+        for (int mask = 0; mask < 256; mask++)
+        {
+            int num_kept = 0;
+            for (int lane = 0; lane < 8; lane++)
+            {
+                if (mask & (1 << lane))
+                {
+                    lanes[mask][num_kept++] = lane;
+                }
+            }
+        }
+    }
+};
+
+const CompressTable kCompressTable;
+
+// Lanes [0, n) are all ones, for storing the first n lanes of a vector
+alignas(32) const int32_t kPrefixMasks[16] = {-1, -1, -1, -1, -1, -1, -1, -1,
+                                              0,  0,  0,  0,  0,  0,  0,  0};
+
+__attribute__((target("avx2"))) size_t
+DedupeMergedRunAvx2(const int* keys, const int* values, size_t size,
+                    bool drop_tombstones, int* out_keys, int* out_values)
+{
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    // The first pair has no previous key to compare with
+    out_keys[0] = keys[0];
+    out_values[0] = values[0];
+    size_t num_kept = !(drop_tombstones && values[0] == INT_MAX);
+
+    const __m256i tombstone = _mm256_set1_epi32(INT_MAX);
+    const __m256i drop_mask = _mm256_set1_epi32(drop_tombstones ? -1 : 0);
+    size_t i = 1;
+    for (; i + 8 <= size; i += 8)
+    {
+        __m256i key_block =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+        __m256i previous_keys =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i - 1));
+        __m256i value_block =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+
+        // A lane is removed if it repeats the previous key or holds a
+        // tombstone that is dropped
+        __m256i removed = _mm256_or_si256(
+            _mm256_cmpeq_epi32(key_block, previous_keys),
+            _mm256_and_si256(_mm256_cmpeq_epi32(value_block, tombstone),
+                             drop_mask));
+        int kept_mask =
+            ~_mm256_movemask_ps(_mm256_castsi256_ps(removed)) & 0xff;
+
+        // Move the kept lanes to the front and store only those
+        __m256i lanes = _mm256_load_si256(
+            reinterpret_cast<const __m256i*>(kCompressTable.lanes[kept_mask]));
+        int num_lanes = __builtin_popcount(kept_mask);
+        __m256i store_mask = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(kPrefixMasks + 8 - num_lanes));
+        _mm256_maskstore_epi32(out_keys + num_kept, store_mask,
+                               _mm256_permutevar8x32_epi32(key_block, lanes));
+        _mm256_maskstore_epi32(out_values + num_kept, store_mask,
+                               _mm256_permutevar8x32_epi32(value_block, lanes));
+        num_kept += num_lanes;
+    }
+
+    // The tail still compares with the last pair of the vector loop
+    for (; i < size; i++)
+    {
+        bool is_first = keys[i] != keys[i - 1];
+        bool is_dropped = drop_tombstones && values[i] == INT_MAX;
+        out_keys[num_kept] = keys[i];
+        out_values[num_kept] = values[i];
+        num_kept += is_first && !is_dropped;
+    }
+    return num_kept;
+}
+#endif
+
+using DedupeMergedRunFn = size_t (*)(const int*, const int*, size_t, bool,
+                                     int*, int*);
+
+// Pick the widest implementation the CPU supports once, at startup
+DedupeMergedRunFn
+SelectDedupeMergedRun()
+{
+#ifdef MERGE_KERNEL_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return DedupeMergedRunAvx2;
+    }
+#endif
+    return DedupeMergedRunScalar;
+}
+}  // namespace
+
+size_t
+MergeSortedRuns(const int* a_keys, const int* a_values, size_t a_size,
+                const int* b_keys, const int* b_values, size_t b_size,
+                int* out_keys, int* out_values)
+{
+    // Pick the next pair with a select instead of a branch, since which run
+    // wins is unpredictable
+    size_t i = 0;
+    size_t j = 0;
+    size_t k = 0;
+    while (i < a_size && j < b_size)
+    {
+        bool take_a = a_keys[i] <= b_keys[j];
+        out_keys[k] = take_a ? a_keys[i] : b_keys[j];
+        out_values[k] = take_a ? a_values[i] : b_values[j];
+        i += take_a;
+        j += !take_a;
+        k++;
+    }
+    for (; i < a_size; i++, k++)
+    {
+        out_keys[k] = a_keys[i];
+        out_values[k] = a_values[i];
+    }
+    for (; j < b_size; j++, k++)
+    {
+        out_keys[k] = b_keys[j];
+        out_values[k] = b_values[j];
+    }
+    return k;
+}
+
+size_t
+DedupeMergedRun(const int* keys, const int* values, size_t size,
+                bool drop_tombstones, int* out_keys, int* out_values)
+{
+    static const DedupeMergedRunFn dedupe_merged_run = SelectDedupeMergedRun();
+    return dedupe_merged_run(keys, values, size, drop_tombstones, out_keys,
+                             out_values);
+}
@@ -0,0 +1,22 @@
+#ifndef MERGE_KERNEL_H
+#define MERGE_KERNEL_H
+
+#include <cstddef>
+
+// Merge two sorted runs of keys and their values into out_keys and
+// out_values, which must have room for a_size + b_size pairs. Equal keys are
+// all kept, with the pair of run a first. Returns the number of pairs
+// written.
+size_t MergeSortedRuns(const int* a_keys, const int* a_values, size_t a_size,
+                       const int* b_keys, const int* b_values, size_t b_size,
+                       int* out_keys, int* out_values);
+
+// Copy a merged run to out_keys and out_values, keeping only the first pair
+// of every group of equal keys, and dropping the pairs whose value is a
+// tombstone if drop_tombstones is set. The output must not overlap the
+// input. Uses AVX2 masks when the CPU supports them and a scalar loop
+// otherwise. Returns the number of pairs written.
+size_t DedupeMergedRun(const int* keys, const int* values, size_t size,
+                       bool drop_tombstones, int* out_keys, int* out_values);
+
+#endif
@@ -0,0 +1,184 @@
+#include "sequential_page_reader.h"
+
+#include <sys/stat.h>  // For fstat
+
+#include <algorithm>
+#include <cstdlib>  // For posix_memalign
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+std::shared_ptr<std::byte>
+AllocateChunkBuffer(int num_pages)
+{
+    void *aligned_buffer;
+    if (posix_memalign(&aligned_buffer, PAGE_SIZE,
+                       static_cast<size_t>(num_pages) * PAGE_SIZE) != 0)
+    {
+        throw std::runtime_error("Failed to allocate aligned memory");
+    }
+    return std::shared_ptr<std::byte>(static_cast<std::byte *>(aligned_buffer),
+                                      [](std::byte *ptr) { free(ptr); });
+}
+}  // namespace
+
+SequentialPageReader::SequentialPageReader(std::shared_ptr<IoFile> file,
+                                           int first_page_id, int end_page_id,
+                                           RateLimiter *rate_limiter,
+                                           int buffer_pages)
+    : file_(std::move(file)),
+      end_page_id_(end_page_id),
+      next_page_id_(first_page_id),
+      rate_limiter_(rate_limiter),
+      buffer_pages_(buffer_pages),
+      active_chunk_(0)
+{
+    if (end_page_id_ < 0)
+    {
+        struct stat file_stat;
+        if (fstat(file_->GetFd(), &file_stat) != 0)
+        {
+            throw std::runtime_error("Failed to stat B-tree file: " +
+                                     file_->GetFilename());
+        }
+        end_page_id_ = file_stat.st_size / PAGE_SIZE;
+    }
+
+    // Read the first chunk and the one after it right away
+    StartRead(chunks_[0], first_page_id);
+    StartRead(chunks_[1], first_page_id + chunks_[0].num_pages);
+}
+
+SequentialPageReader::SequentialPageReader(const std::string &filename,
+                                           int first_page_id, int end_page_id,
+                                           RateLimiter *rate_limiter,
+                                           int buffer_pages)
+    : SequentialPageReader(IoEngine::Default().OpenFile(filename),
+                           first_page_id, end_page_id, rate_limiter,
+                           buffer_pages)
+{
+}
+
+SequentialPageReader::~SequentialPageReader()
+{
+    // The reads in flight still use the buffers
+    for (Chunk &chunk : chunks_)
+    {
+        if (chunk.pending.valid())
+        {
+            chunk.pending.wait();
+        }
+    }
+}
+
+BTreePageView
+SequentialPageReader::NextPage()
+{
+    Chunk *chunk = &chunks_[active_chunk_];
+    WaitForRead(*chunk);
+    if (next_page_id_ >= chunk->first_page_id + chunk->num_pages)
+    {
+        // Move on to the chunk that was read ahead, and read ahead into the
+        // one that is used up
+        active_chunk_ = 1 - active_chunk_;
+        chunk = &chunks_[active_chunk_];
+        WaitForRead(*chunk);
+        StartRead(chunks_[1 - active_chunk_],
+                  chunk->first_page_id + chunk->num_pages);
+    }
+
+    if (next_page_id_ >= end_page_id_ ||
+        next_page_id_ >= chunk->first_page_id + chunk->num_pages)
+    {
+        return BTreePageView();
+    }
+
+    // The view shares ownership of the whole buffer
+    size_t offset =
+        static_cast<size_t>(next_page_id_ - chunk->first_page_id) * PAGE_SIZE;
+    PageFrame frame(chunk->buffer, chunk->buffer.get() + offset);
+    return BTreePageView(std::move(frame), next_page_id_++);
+}
+
+void
+SequentialPageReader::StartRead(Chunk &chunk, int first_page_id)
+{
+    chunk.first_page_id = first_page_id;
+    chunk.num_pages =
+        std::max(0, std::min(buffer_pages_, end_page_id_ - first_page_id));
+    if (chunk.num_pages == 0)
+    {
+        return;
+    }
+
+    if (!chunk.buffer || chunk.buffer.use_count() > 1)
+    {
+        chunk.buffer = AllocateChunkBuffer(buffer_pages_);
+    }
+
+    // Split the chunk into page runs that the engine can read in parallel
+    std::vector<IoRequest> requests;
+    for (int page = 0; page < chunk.num_pages; page += IO_BATCH_PAGES)
+    {
+        int num_pages = std::min(IO_BATCH_PAGES, chunk.num_pages - page);
+        requests.push_back(
+            {file_.get(),
+             chunk.buffer.get() + static_cast<size_t>(page) * PAGE_SIZE,
+             static_cast<size_t>(num_pages) * PAGE_SIZE,
+             static_cast<off_t>(first_page_id + page) * PAGE_SIZE});
+    }
+    size_t num_bytes = static_cast<size_t>(chunk.num_pages) * PAGE_SIZE;
+    chunk.pending = std::async(
+        std::launch::async,
+        [this, requests = std::move(requests), num_bytes]() mutable -> ssize_t
+        {
+            if (rate_limiter_ != nullptr)
+            {
+                rate_limiter_->Request(num_bytes);
+            }
+
+            file_->GetEngine().Read(requests);
+
+            // The chunk holds the pages up to the first short read
+            ssize_t total = 0;
+            for (const IoRequest &request : requests)
+            {
+                if (request.result < 0)
+                {
+                    return -1;
+                }
+                total += request.result;
+                if (static_cast<size_t>(request.result) < request.size)
+                {
+                    break;
+                }
+            }
+            return total;
+        });
+}
+
+void
+SequentialPageReader::WaitForRead(Chunk &chunk)
+{
+    if (!chunk.pending.valid())
+    {
+        return;
+    }
+
+    ssize_t bytes_read = chunk.pending.get();
+    if (bytes_read < 0)
+    {
+        throw std::runtime_error("Failed to read pages from disk: " +
+                                 file_->GetFilename());
+    }
+
+    // The file ended early
+    int num_pages = bytes_read / PAGE_SIZE;
+    if (num_pages < chunk.num_pages)
+    {
+        chunk.num_pages = num_pages;
+        end_page_id_ = chunk.first_page_id + num_pages;
+    }
+}
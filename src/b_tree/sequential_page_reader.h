@@ -0,0 +1,68 @@
+#ifndef SEQUENTIAL_PAGE_READER_H
+#define SEQUENTIAL_PAGE_READER_H
+
+#include <sys/types.h>
+
+#include <future>
+#include <memory>
+#include <string>
+
+#include "../compaction/rate_limiter.h"
+#include "../config.h"
+#include "../io/io_engine.h"
+#include "b_tree_page_view.h"
+
+/** Reads a range of pages of a file front to back in large chunks.
+ *
+ *  Two aligned buffers of buffer_pages pages are used in turn. While the
+ *  caller walks the pages of one, the next chunk is read into the other on a
+ *  background thread, so the disk stays busy while the caller works. Pages
+ *  are handed out as views into the buffers without copying. A buffer that
+ *  still has a view in use is not overwritten; a new one is allocated for
+ *  the next chunk instead. A chunk is read as a batch of IO_BATCH_PAGES page
+ *  reads through the engine of the file, which may keep them all in flight
+ *  at once.
+ */
+class SequentialPageReader
+{
+   public:
+    // Read the pages in [first_page_id, end_page_id), or up to the end of
+    // the file if end_page_id is negative. If rate_limiter is given, every
+    // chunk waits for its bytes.
+    SequentialPageReader(std::shared_ptr<IoFile> file, int first_page_id,
+                         int end_page_id, RateLimiter* rate_limiter = nullptr,
+                         int buffer_pages = COMPACTION_READAHEAD_PAGES);
+    // Open the file with the default pread engine
+    SequentialPageReader(const std::string& filename, int first_page_id,
+                         int end_page_id, RateLimiter* rate_limiter = nullptr,
+                         int buffer_pages = COMPACTION_READAHEAD_PAGES);
+    ~SequentialPageReader();
+
+    SequentialPageReader(const SequentialPageReader&) = delete;
+    SequentialPageReader& operator=(const SequentialPageReader&) = delete;
+
+    // The next page of the range, or an invalid page past its end.
+    BTreePageView NextPage();
+
+   private:
+    struct Chunk
+    {
+        std::shared_ptr<std::byte> buffer;
+        int first_page_id = 0;
+        int num_pages = 0;
+        std::future<ssize_t> pending;  // valid while the read is in flight
+    };
+
+    void StartRead(Chunk& chunk, int first_page_id);
+    void WaitForRead(Chunk& chunk);
+
+    std::shared_ptr<IoFile> file_;
+    int end_page_id_;
+    int next_page_id_;
+    RateLimiter* rate_limiter_;
+    int buffer_pages_;
+    Chunk chunks_[2];
+    int active_chunk_;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#include "sst_footer.h"
+
+#include <fcntl.h>     // For open
+#include <sys/stat.h>  // For fstat
+#include <unistd.h>    // For close, pread
+
+#include <cstring>  // For memcpy, memset
+
+#include "../config.h"
+
+namespace
+{
+// The low 16 bits are neither a leaf nor an internal page type, so the footer
+// can never be mistaken for a B-tree page.
+constexpr uint64_t kSstFooterMagic = 0x535354464f4f5452ULL;
+constexpr uint32_t kSstFooterVersion = 2;  // 2 added max_sequence
+
+template <typename T>
+void
+WriteField(std::byte*& ptr, const T& value)
+{
+    std::memcpy(ptr, &value, sizeof(value));
+    ptr += sizeof(value);
+}
+
+template <typename T>
+void
+ReadField(const std::byte*& ptr, T& value)
+{
+    std::memcpy(&value, ptr, sizeof(value));
+    ptr += sizeof(value);
+}
+}  // namespace
+
+bool
+SstFooter::MayContainRange(int key1, int key2) const
+{
+    // Files without a footer do not record their key range
+    if (num_leaf_pages < 0)
+    {
+        return true;
+    }
+    return num_entries > 0 && min_key <= key2 && max_key >= key1;
+}
+
+void
+SstFooter::SerializeToBuffer(std::byte* buffer) const
+{
+    std::memset(buffer, 0, PAGE_SIZE);
+    std::byte* ptr = buffer;
+    WriteField(ptr, kSstFooterMagic);
+    WriteField(ptr, kSstFooterVersion);
+    WriteField(ptr, root_page_id);
+    WriteField(ptr, first_leaf_page_id);
+    WriteField(ptr, num_leaf_pages);
+    WriteField(ptr, num_internal_pages);
+    WriteField(ptr, min_key);
+    WriteField(ptr, max_key);
+    WriteField(ptr, num_entries);
+    WriteField(ptr, filter_block_offset);
+    WriteField(ptr, filter_block_size);
+    WriteField(ptr, max_sequence);
+}
+
+bool
+SstFooter::ReadFromFile(const std::string& filename)
+{
+    *this = SstFooter();
+    root_page_id = 0;
+    first_leaf_page_id = -1;
+    num_leaf_pages = -1;
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat file_stat;
+    std::byte buffer[PAGE_SIZE];
+    bool has_page = fstat(fd, &file_stat) == 0 &&
+                    file_stat.st_size >= PAGE_SIZE &&
+                    pread(fd, buffer, PAGE_SIZE,
+                          file_stat.st_size - PAGE_SIZE) == PAGE_SIZE;
+    close(fd);
+    if (!has_page)
+    {
+        return false;
+    }
+
+    const std::byte* ptr = buffer;
+    uint64_t magic;
+    uint32_t version;
+    ReadField(ptr, magic);
+    ReadField(ptr, version);
+    if (magic != kSstFooterMagic || version < 1 || version > kSstFooterVersion)
+    {
+        return false;
+    }
+
+    ReadField(ptr, root_page_id);
+    ReadField(ptr, first_leaf_page_id);
+    ReadField(ptr, num_leaf_pages);
+    ReadField(ptr, num_internal_pages);
+    ReadField(ptr, min_key);
+    ReadField(ptr, max_key);
+    ReadField(ptr, num_entries);
+    ReadField(ptr, filter_block_offset);
+    ReadField(ptr, filter_block_size);
+    if (version >= 2)
+    {
+        ReadField(ptr, max_sequence);
+    }
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef SST_FOOTER_H
+#define SST_FOOTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/** Fixed-size footer in the last page of an SST file.
+ *
+ *  The leaves come first, then the internal nodes with the root last, then
+ *  the optional leaf filter block (fence pointers and per-leaf filters), and
+ *  finally this page. Files written before the footer existed have the root
+ *  at page 0 and no footer.
+ */
+struct SstFooter
+{
+    int root_page_id = -1;  // -1 for an empty tree
+    int first_leaf_page_id = 0;
+    int num_leaf_pages = 0;
+    int num_internal_pages = 0;
+    uint64_t num_entries = 0;
+    int min_key = 0;
+    int max_key = 0;
+    // Byte range of the serialized LeafFilterBlock, size 0 if there is none
+    uint64_t filter_block_offset = 0;
+    uint64_t filter_block_size = 0;
+    // Largest sequence number of the entries, 0 for files written before
+    // sequence numbers existed
+    uint64_t max_sequence = 0;
+
+    // Returns false only if the file is known to hold no key in
+    // [key1, key2].
+    bool MayContainRange(int key1, int key2) const;
+
+    // Write the footer to a PAGE_SIZE buffer.
+    void SerializeToBuffer(std::byte* buffer) const;
+
+    // Read the footer from the last page of the file. Returns false if the
+    // file has no footer, in which case the root is set to page 0 and the
+    // leaf range to -1 (unknown).
+    bool ReadFromFile(const std::string& filename);
+};
+
+#endif
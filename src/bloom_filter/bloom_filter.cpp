@@ -7,7 +7,7 @@
 
 // Constructor: Initializes the Bloom filter with a given number of bits
 BloomFilter::BloomFilter(size_t num_bits)
-    : bit_array_(num_bits, false), num_bits_(num_bits)
+    : bit_array_((num_bits + 63) / 64, 0), num_bits_(num_bits)
 {
     // optimal hash functions is k = (m/n) * ln(2), where m is the
     // number of bits and n is the number of keys.
@@ -27,7 +27,7 @@ BloomFilter::Insert(int key)
     for (size_t i = 0; i < num_hashes_; ++i)
     {
         size_t hash = Hash(key, i) % num_bits_;
-        bit_array_[hash] = true;
+        SetBit(hash);
     }
 }
 
@@ -39,11 +39,33 @@ BloomFilter::MayContain(int key) const
     for (size_t i = 0; i < num_hashes_; ++i)
     {
         size_t hash = Hash(key, i) % num_bits_;
-        if (!bit_array_[hash]) return false;
+        if (!TestBit(hash)) return false;
     }
     return true;
 }
 
+void
+BloomFilter::Prefetch(int key) const
+{
+    for (size_t i = 0; i < num_hashes_; ++i)
+    {
+        size_t hash = Hash(key, i) % num_bits_;
+        __builtin_prefetch(&bit_array_[hash / 64]);
+    }
+}
+
+bool
+BloomFilter::TestBit(size_t bit) const
+{
+    return (bit_array_[bit / 64] >> (bit % 64)) & 1;
+}
+
+void
+BloomFilter::SetBit(size_t bit)
+{
+    bit_array_[bit / 64] |= 1ULL << (bit % 64);
+}
+
 // Hash function: Computes a hash value for the given key and seed.
 size_t
 BloomFilter::Hash(int key, int seed) const
@@ -64,12 +86,9 @@ BloomFilter::SerializeToDisk(const std::string &filename) const
     size_t num_bytes = (num_bits_ + 7) / 8;  // Round up to the nearest byte
     std::vector<uint8_t> byte_array(num_bytes, 0);
 
-    for (size_t i = 0; i < num_bits_; ++i)
+    for (size_t i = 0; i < num_bytes; ++i)
     {
-        if (bit_array_[i])
-        {
-            byte_array[i / 8] |= (1 << (i % 8));
-        }
+        byte_array[i] = (bit_array_[i / 8] >> (8 * (i % 8))) & 0xff;
     }
 
     out_file.write(reinterpret_cast<const char *>(byte_array.data()),
@@ -93,10 +112,11 @@ BloomFilter::DeserializeFromDisk(const std::string &filename)
     std::vector<uint8_t> byte_array(num_bytes, 0);
     in_file.read(reinterpret_cast<char *>(byte_array.data()), num_bytes);
 
-    bit_array_.resize(num_bits_);
-    for (size_t i = 0; i < num_bits_; ++i)
+    bit_array_.assign((num_bits_ + 63) / 64, 0);
+    for (size_t i = 0; i < num_bytes; ++i)
     {
-        bit_array_[i] = (byte_array[i / 8] & (1 << (i % 8))) != 0;
+        bit_array_[i / 8] |= static_cast<uint64_t>(byte_array[i])
+                             << (8 * (i % 8));
     }
 
     in_file.close();
@@ -112,8 +132,8 @@ BloomFilter::Union(const BloomFilter &other)
             "functions");
     }
 
-    for (size_t i = 0; i < num_bits_; ++i)
+    for (size_t i = 0; i < bit_array_.size(); ++i)
     {
-        bit_array_[i] = bit_array_[i] || other.bit_array_[i];
+        bit_array_[i] |= other.bit_array_[i];
     }
 }
\ No newline at end of file
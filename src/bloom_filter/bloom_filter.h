@@ -1,6 +1,7 @@
 #pragma once  // ensure the header file is included only once during
               // compilation.
 #include <cmath>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -11,13 +12,19 @@ class BloomFilter
     explicit BloomFilter(const std::string &filename);
     void Insert(int key);
     bool MayContain(int key) const;
+    // Hint the CPU to load the bits of a key that is about to be probed.
+    void Prefetch(int key) const;
     void SerializeToDisk(const std::string &filename) const;
     void DeserializeFromDisk(const std::string &filename);
     void Union(const BloomFilter &other);
 
    private:
     size_t Hash(int key, int seed) const;
-    std::vector<bool> bit_array_;
+    bool TestBit(size_t bit) const;
+    void SetBit(size_t bit);
+    // Bit i is stored in word i / 64, so the words can be prefetched and
+    // are laid out like the serialized byte array on little-endian hosts.
+    std::vector<uint64_t> bit_array_;
     size_t num_hashes_;
     size_t num_bits_;
 };
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "leaf_filter_block.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "../config.h"
+
+namespace
+{
+// optimal hash functions is k = (m/n) * ln(2), where m/n is the number of
+// bits per key.
+const size_t kNumLeafHashes = std::max<size_t>(
+    1, static_cast<size_t>(
+           std::round(LEAF_BLOOM_FILTER_BITS_PER_KEY * std::log(2))));
+
+// Mix the key so that consecutive keys land on unrelated bits. The two halves
+// of the result drive double hashing: probe i checks h1 + i * h2.
+uint64_t
+MixKey(int key)
+{
+    uint64_t x = static_cast<uint32_t>(key);
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+}  // namespace
+
+LeafFilterBlock::LeafFilterBlock(int first_leaf_page_id)
+    : first_leaf_page_id_(first_leaf_page_id), filter_offsets_{0}
+{
+}
+
+LeafFilterBlock::LeafFilterBlock(const std::string &filename)
+    : first_leaf_page_id_(0), filter_offsets_{0}
+{
+    DeserializeFromDisk(filename);
+}
+
+void
+LeafFilterBlock::AddLeaf(
+    const std::vector<std::pair<int, int>> &key_value_pairs)
+{
+    if (key_value_pairs.empty())
+    {
+        return;
+    }
+
+    // Round every filter up to whole words so that a filter never shares a
+    // word with its neighbour.
+    uint32_t num_bits =
+        key_value_pairs.size() * LEAF_BLOOM_FILTER_BITS_PER_KEY;
+    num_bits = (num_bits + 63) / 64 * 64;
+    uint32_t start = filter_offsets_.back();
+    bits_.resize((start + num_bits) / 64, 0);
+
+    for (const auto &pair : key_value_pairs)
+    {
+        uint64_t hash = MixKey(pair.first);
+        uint32_t h1 = static_cast<uint32_t>(hash);
+        uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+        for (size_t i = 0; i < kNumLeafHashes; i++)
+        {
+            uint32_t bit = start + (h1 + i * h2) % num_bits;
+            bits_[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+
+    fence_keys_.push_back(key_value_pairs.back().first);
+    filter_offsets_.push_back(start + num_bits);
+}
+
+void
+LeafFilterBlock::SetFirstLeafPageId(int page_id)
+{
+    first_leaf_page_id_ = page_id;
+}
+
+int
+LeafFilterBlock::FindLeafPage(int key) const
+{
+    // The first leaf whose max key is >= key is the only one that can hold it
+    auto it = std::lower_bound(fence_keys_.begin(), fence_keys_.end(), key);
+    if (it == fence_keys_.end())
+    {
+        return INVALID_PAGE_ID;
+    }
+
+    size_t leaf = it - fence_keys_.begin();
+    if (!LeafMayContain(leaf, key))
+    {
+        return INVALID_PAGE_ID;
+    }
+
+    return first_leaf_page_id_ + static_cast<int>(leaf);
+}
+
+int
+LeafFilterBlock::GetNumLeaves() const
+{
+    return fence_keys_.size();
+}
+
+bool
+LeafFilterBlock::LeafMayContain(size_t leaf, int key) const
+{
+    uint32_t start = filter_offsets_[leaf];
+    uint32_t num_bits = filter_offsets_[leaf + 1] - start;
+
+    uint64_t hash = MixKey(key);
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    for (size_t i = 0; i < kNumLeafHashes; i++)
+    {
+        uint32_t bit = start + (h1 + i * h2) % num_bits;
+        if ((bits_[bit / 64] & (1ULL << (bit % 64))) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+LeafFilterBlock::SerializeToDisk(const std::string &filename) const
+{
+    std::ofstream out_file(filename, std::ios::binary);
+    if (!out_file.is_open())
+    {
+        throw std::runtime_error("Failed to create leaf filter file: " +
+                                 filename);
+    }
+
+    std::vector<char> buffer;
+    SerializeToBuffer(buffer);
+    out_file.write(buffer.data(), buffer.size());
+    out_file.close();
+}
+
+void
+LeafFilterBlock::DeserializeFromDisk(const std::string &filename)
+{
+    std::ifstream in_file(filename, std::ios::binary);
+    if (!in_file.is_open())
+    {
+        // no leaf filter file found
+        return;
+    }
+
+    std::vector<char> buffer((std::istreambuf_iterator<char>(in_file)),
+                             std::istreambuf_iterator<char>());
+    in_file.close();
+    DeserializeFromBuffer(buffer.data(), buffer.size());
+}
+
+void
+LeafFilterBlock::SerializeToBuffer(std::vector<char> &buffer) const
+{
+    uint32_t num_leaves = fence_keys_.size();
+    uint64_t num_words = bits_.size();
+
+    auto append = [&buffer](const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    };
+    append(&first_leaf_page_id_, sizeof(first_leaf_page_id_));
+    append(&num_leaves, sizeof(num_leaves));
+    append(&num_words, sizeof(num_words));
+    append(fence_keys_.data(), num_leaves * sizeof(int));
+    append(filter_offsets_.data(), (num_leaves + 1) * sizeof(uint32_t));
+    append(bits_.data(), num_words * sizeof(uint64_t));
+}
+
+void
+LeafFilterBlock::DeserializeFromBuffer(const char *data, size_t size)
+{
+    const char *end = data + size;
+    auto read = [&data, end](void *out, size_t out_size)
+    {
+        if (static_cast<size_t>(end - data) < out_size)
+        {
+            throw std::runtime_error("Truncated leaf filter block");
+        }
+        std::memcpy(out, data, out_size);
+        data += out_size;
+    };
+
+    uint32_t num_leaves = 0;
+    uint64_t num_words = 0;
+    read(&first_leaf_page_id_, sizeof(first_leaf_page_id_));
+    read(&num_leaves, sizeof(num_leaves));
+    read(&num_words, sizeof(num_words));
+
+    fence_keys_.resize(num_leaves);
+    filter_offsets_.resize(num_leaves + 1);
+    bits_.resize(num_words);
+    read(fence_keys_.data(), num_leaves * sizeof(int));
+    read(filter_offsets_.data(), (num_leaves + 1) * sizeof(uint32_t));
+    read(bits_.data(), num_words * sizeof(uint64_t));
+}
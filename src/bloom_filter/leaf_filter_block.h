@@ -0,0 +1,49 @@
+#ifndef LEAF_FILTER_BLOCK_H
+#define LEAF_FILTER_BLOCK_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** Partitioned Bloom filter for a single SST file.
+ *
+ *  Holds the fence pointers (max key of every leaf page) together with one
+ *  small Bloom filter per leaf. A lookup finds the only leaf that can hold the
+ *  key and probes that leaf's filter, so a negative lookup needs no I/O and a
+ *  positive one needs a single leaf read.
+ */
+class LeafFilterBlock
+{
+   public:
+    explicit LeafFilterBlock(int first_leaf_page_id = 0);
+    explicit LeafFilterBlock(const std::string &filename);
+
+    // Append the next leaf page (in key order) to the block.
+    void AddLeaf(const std::vector<std::pair<int, int>> &key_value_pairs);
+
+    // Leaves are stored consecutively, so only the first id is needed.
+    void SetFirstLeafPageId(int page_id);
+
+    // Return the page id of the leaf that may contain the key, or
+    // INVALID_PAGE_ID if no leaf can contain it.
+    int FindLeafPage(int key) const;
+
+    int GetNumLeaves() const;
+
+    void SerializeToDisk(const std::string &filename) const;
+    void DeserializeFromDisk(const std::string &filename);
+    // The same format in memory, used to embed the block in an SST file.
+    void SerializeToBuffer(std::vector<char> &buffer) const;
+    void DeserializeFromBuffer(const char *data, size_t size);
+
+   private:
+    bool LeafMayContain(size_t leaf, int key) const;
+
+    int first_leaf_page_id_;
+    std::vector<int> fence_keys_;           // max key of every leaf page
+    std::vector<uint32_t> filter_offsets_;  // first bit of each leaf filter
+    std::vector<uint64_t> bits_;            // all leaf filters, back to back
+};
+
+#endif
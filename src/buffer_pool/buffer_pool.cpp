@@ -2,70 +2,133 @@
 
 #include "buffer_pool.h"
 
+#include <algorithm>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <string>
 #include <vector>
 
-BufferPool::BufferPool(size_t max_number_of_pages)
-    : max_number_of_pages_(max_number_of_pages)
+#include "../config.h"
+
+BufferPool::BufferPool(size_t max_number_of_pages, Statistics *statistics)
+    : num_shards_(std::max<size_t>(
+          1, std::min<size_t>(BUFFER_POOL_SHARDS, max_number_of_pages))),
+      shards_(new Shard[num_shards_]),
+      statistics_(statistics)
 {
+    // Split the pages evenly, giving the remainder to the first shards
+    for (size_t i = 0; i < num_shards_; i++)
+    {
+        shards_[i].max_number_of_pages =
+            max_number_of_pages / num_shards_ +
+            (i < max_number_of_pages % num_shards_ ? 1 : 0);
+    }
 }
 
 void
 BufferPool::EvictAllPages()
 {
-    lru_list_.clear();
-    page_table_.clear();
+    for (size_t i = 0; i < num_shards_; i++)
+    {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        shards_[i].lru_list.clear();
+        shards_[i].page_table.clear();
+    }
 }
 
-BTreePage
+BTreePageView
 BufferPool::GetPageFromId(
     const std::string &filename, int page_id,
-    const std::function<BTreePage(int, const std::string &)> &loadPageFromDisk)
+    const std::function<BTreePageView(int, const std::string &)>
+        &loadPageFromDisk)
+{
+    BTreePageView page;
+    if (TryGetPage(filename, page_id, &page))
+    {
+        return page;
+    }
+
+    // If the page is not in the buffer pool, load it from disk without
+    // blocking the other threads of this shard
+    page = loadPageFromDisk(page_id, filename);
+    AddPage(filename, page_id, page);
+    return page;
+}
+
+bool
+BufferPool::TryGetPage(const std::string &filename, int page_id,
+                       BTreePageView *page)
 {
     std::string key = filename + std::to_string(page_id);
-    auto it = page_table_.find(key);
+    Shard &shard = GetShard(key);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.page_table.find(key);
+
+        // If the page is in the buffer pool, move it to the front of the LRU
+        // list
+        if (it != shard.page_table.end())
+        {
+            if (statistics_ != nullptr)
+            {
+                statistics_->Record(Ticker::BUFFER_POOL_HITS);
+            }
+            shard.lru_list.splice(shard.lru_list.begin(), shard.lru_list,
+                                  it->second);
+            *page = it->second->second;
+            return true;
+        }
+    }
 
-    // If the page is in the buffer pool, move it to the front of the LRU list
-    if (it != page_table_.end())
+    if (statistics_ != nullptr)
     {
-        auto page = it->second->second;
-        lru_list_.erase(it->second);
-        lru_list_.push_front({key, page});
-        page_table_[key] = lru_list_.begin();
-        return page;
+        statistics_->Record(Ticker::BUFFER_POOL_MISSES);
     }
+    return false;
+}
 
-    // If the page is not in the buffer pool, load it from disk
-    BTreePage page = loadPageFromDisk(page_id, filename);
+void
+BufferPool::AddPage(const std::string &filename, int page_id,
+                    const BTreePageView &page, bool low_priority)
+{
+    std::string key = filename + std::to_string(page_id);
+    Shard &shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.page_table.count(key) > 0)
+    {
+        // Another thread loaded the page in the meantime
+        return;
+    }
 
-    // If the buffer pool is full, evict the least recently used page
-    if (lru_list_.size() == max_number_of_pages_)
+    // If the shard is full, evict the least recently used page
+    if (shard.lru_list.size() >= shard.max_number_of_pages)
     {
-        EvictPage();
+        EvictPage(shard);
     }
 
     // Add the new page to the buffer pool
-    AddPageToPool(filename, page_id, page);
-
-    return page;
+    if (low_priority)
+    {
+        shard.lru_list.push_back({key, page});
+        shard.page_table[key] = std::prev(shard.lru_list.end());
+        return;
+    }
+    shard.lru_list.push_front({key, page});
+    shard.page_table[key] = shard.lru_list.begin();
 }
 
-void
-BufferPool::EvictPage()
+BufferPool::Shard &
+BufferPool::GetShard(const std::string &key)
 {
-    auto last = lru_list_.end();
-    --last;
-    page_table_.erase(last->first);
-    lru_list_.pop_back();
+    return shards_[std::hash<std::string>()(key) % num_shards_];
 }
 
 void
-BufferPool::AddPageToPool(const std::string &filename, int page_id,
-                          const BTreePage &page)
+BufferPool::EvictPage(Shard &shard)
 {
-    std::string key = filename + std::to_string(page_id);
-    lru_list_.push_front({key, page});
-    page_table_[key] = lru_list_.begin();
-}
\ No newline at end of file
+    auto last = shard.lru_list.end();
+    --last;
+    shard.page_table.erase(last->first);
+    shard.lru_list.pop_back();
+}
@@ -3,39 +3,74 @@
 
 #include <functional>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
 
-#include "../b_tree/b_tree_page.h"
+#include "../b_tree/b_tree_page_view.h"
+#include "../statistics/statistics.h"
 
+/** LRU cache of B-tree pages, safe to use from several threads.
+ *
+ *  The pages are spread over up to BUFFER_POOL_SHARDS shards by a hash of
+ *  their filename and id. Each shard has its own lock and LRU list, so
+ *  threads reading different pages rarely wait for each other.
+ */
 class BufferPool
 {
    public:
-    explicit BufferPool(size_t max_number_of_pages);
+    // If statistics is given, hits and misses are counted in it.
+    explicit BufferPool(size_t max_number_of_pages,
+                        Statistics *statistics = nullptr);
     void EvictAllPages();
 
-    // dependency inject the function to load a page from disk
-    BTreePage GetPageFromId(
+    // dependency inject the function to load a page from disk. The page is
+    // loaded without holding a lock, so two threads missing on the same page
+    // may both read it.
+    BTreePageView GetPageFromId(
         const std::string &filename, int page_id,
-        const std::function<BTreePage(int, const std::string &)>
+        const std::function<BTreePageView(int, const std::string &)>
             &loadPageFromDisk);
 
+    // Look up a page without loading it. On a hit the page is copied to
+    // *page and made the most recently used. Counts a hit or a miss.
+    bool TryGetPage(const std::string &filename, int page_id,
+                    BTreePageView *page);
+    // Add a page that the caller loaded after a miss, unless another thread
+    // added it first. A low priority page, such as one read ahead by a
+    // scan, is added as the least recently used, so it is the first to be
+    // evicted unless it is hit before.
+    void AddPage(const std::string &filename, int page_id,
+                 const BTreePageView &page, bool low_priority = false);
+
    private:
-    size_t max_number_of_pages_;
-
-    // The LRU list is a list of pairs of the filename+id and the BTreePage
-    std::list<std::pair<std::string, BTreePage>> lru_list_;
-
-    // The page_table_ is a map of the filename+id to an iterator in the LRU
-    // list. This allows us to quickly find the location of a page in the LRU
-    // list.
-    std::unordered_map<std::string,
-                       std::list<std::pair<std::string, BTreePage>>::iterator>
-        page_table_;
-    void EvictPage();
-    void AddPageToPool(const std::string &filename, int page_id,
-                       const BTreePage &page);
+    struct Shard
+    {
+        std::mutex mutex;
+        size_t max_number_of_pages = 0;
+
+        // The LRU list is a list of pairs of the filename+id and a view of
+        // the page frame. Handing out a page only copies the view, not the
+        // frame.
+        std::list<std::pair<std::string, BTreePageView>> lru_list;
+
+        // The page_table is a map of the filename+id to an iterator in the
+        // LRU list. This allows us to quickly find the location of a page in
+        // the LRU list.
+        std::unordered_map<
+            std::string,
+            std::list<std::pair<std::string, BTreePageView>>::iterator>
+            page_table;
+    };
+
+    size_t num_shards_;
+    std::unique_ptr<Shard[]> shards_;
+    Statistics *statistics_;
+
+    Shard &GetShard(const std::string &key);
+    static void EvictPage(Shard &shard);
 };
 
 #endif
\ No newline at end of file
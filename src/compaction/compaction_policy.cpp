@@ -0,0 +1,286 @@
+#include "compaction_policy.h"
+
+#include <algorithm>
+#include <climits>
+#include <set>
+#include <stdexcept>
+
+CompactionPolicy::CompactionPolicy(int size_ratio, uint64_t memtable_entries)
+    : size_ratio_(size_ratio), memtable_entries_(memtable_entries)
+{
+    if (size_ratio_ < 2)
+    {
+        throw std::runtime_error("Compaction size ratio must be at least 2");
+    }
+}
+
+std::unique_ptr<CompactionPolicy>
+CompactionPolicy::Create(CompactionStyle style, int size_ratio,
+                         uint64_t memtable_entries)
+{
+    switch (style)
+    {
+        case CompactionStyle::LEVELING:
+            return std::make_unique<LevelingPolicy>(size_ratio,
+                                                    memtable_entries);
+        case CompactionStyle::TIERING:
+            return std::make_unique<TieringPolicy>(size_ratio,
+                                                   memtable_entries);
+        case CompactionStyle::LAZY_LEVELING:
+            return std::make_unique<LazyLevelingPolicy>(size_ratio,
+                                                        memtable_entries);
+    }
+    throw std::runtime_error("Unknown compaction style");
+}
+
+bool
+CompactionPolicy::PickCompaction(const std::vector<SstFileInfo>& files,
+                                 CompactionTask& task) const
+{
+    std::vector<CompactionTask> tasks = PickCompactions(files);
+    if (tasks.empty())
+    {
+        return false;
+    }
+    task = tasks.front();
+    return true;
+}
+
+CompactionPolicy::LevelRuns
+CompactionPolicy::GroupByLevel(const std::vector<SstFileInfo>& files)
+{
+    LevelRuns runs;
+    for (auto it = files.rbegin(); it != files.rend(); ++it)
+    {
+        if (static_cast<size_t>(it->level) >= runs.size())
+        {
+            runs.resize(it->level + 1);
+        }
+        runs[it->level].push_back(&*it);
+    }
+    return runs;
+}
+
+size_t
+CompactionPolicy::CountRuns(const LevelRuns& runs, int level)
+{
+    if (static_cast<size_t>(level) >= runs.size())
+    {
+        return 0;
+    }
+
+    // The files of a run are next to each other
+    size_t num_runs = 0;
+    const std::string* run_id = nullptr;
+    for (const SstFileInfo* file : runs[level])
+    {
+        if (run_id == nullptr || file->run_id != *run_id)
+        {
+            num_runs++;
+            run_id = &file->run_id;
+        }
+    }
+    return num_runs;
+}
+
+void
+CompactionPolicy::AddLevel(const LevelRuns& runs, int level,
+                           CompactionTask& task)
+{
+    if (static_cast<size_t>(level) < runs.size())
+    {
+        for (const SstFileInfo* file : runs[level])
+        {
+            task.inputs.push_back(file->filename);
+            task.num_input_entries += file->num_entries;
+        }
+    }
+}
+
+void
+CompactionPolicy::AddOverlapping(const LevelRuns& runs, int level,
+                                 int min_key, int max_key,
+                                 CompactionTask& task)
+{
+    if (static_cast<size_t>(level) < runs.size())
+    {
+        for (const SstFileInfo* file : runs[level])
+        {
+            if (file->min_key <= max_key && file->max_key >= min_key)
+            {
+                task.inputs.push_back(file->filename);
+                task.num_input_entries += file->num_entries;
+            }
+        }
+    }
+}
+
+void
+CompactionPolicy::SetDropTombstones(const std::vector<SstFileInfo>& files,
+                                    CompactionTask& task)
+{
+    std::set<std::string> inputs(task.inputs.begin(), task.inputs.end());
+    int min_key = INT_MAX;
+    int max_key = INT_MIN;
+    for (const SstFileInfo& file : files)
+    {
+        if (inputs.count(file.filename) > 0)
+        {
+            min_key = std::min(min_key, file.min_key);
+            max_key = std::max(max_key, file.max_key);
+        }
+    }
+
+    // Files on the output level and below hold older data. If none of them
+    // is left out of the merge in the key range of the inputs, no older
+    // value is left for a tombstone to hide.
+    task.drop_tombstones = true;
+    for (const SstFileInfo& file : files)
+    {
+        if (file.level >= task.output_level &&
+            inputs.count(file.filename) == 0 && file.min_key <= max_key &&
+            file.max_key >= min_key)
+        {
+            task.drop_tombstones = false;
+        }
+    }
+}
+
+void
+CompactionPolicy::SortByScore(std::vector<CompactionTask>& tasks)
+{
+    // Ties keep the order of the levels, from the top down
+    std::stable_sort(tasks.begin(), tasks.end(),
+                     [](const CompactionTask& a, const CompactionTask& b)
+                     { return a.score > b.score; });
+}
+
+uint64_t
+CompactionPolicy::RunCapacity(int level) const
+{
+    uint64_t capacity = memtable_entries_;
+    for (int i = 0; i < level; i++)
+    {
+        capacity *= size_ratio_;
+    }
+    return capacity;
+}
+
+std::vector<CompactionTask>
+LevelingPolicy::PickCompactions(const std::vector<SstFileInfo>& files) const
+{
+    std::vector<CompactionTask> tasks;
+    LevelRuns runs = GroupByLevel(files);
+    if (runs.empty())
+    {
+        return tasks;
+    }
+
+    // The flushed files on level 0 overlap each other, so they are merged
+    // together as soon as there are two
+    size_t num_level_0_runs = CountRuns(runs, 0);
+    if (num_level_0_runs >= 2)
+    {
+        CompactionTask task;
+        AddLevel(runs, 0, task);
+        int min_key = INT_MAX;
+        int max_key = INT_MIN;
+        for (const SstFileInfo* file : runs[0])
+        {
+            min_key = std::min(min_key, file->min_key);
+            max_key = std::max(max_key, file->max_key);
+        }
+        AddOverlapping(runs, 1, min_key, max_key, task);
+        task.output_level = 1;
+        task.score = num_level_0_runs / 2.0;
+        SetDropTombstones(files, task);
+        tasks.push_back(task);
+    }
+
+    for (size_t level = 1; level < runs.size(); level++)
+    {
+        uint64_t num_entries = 0;
+        for (const SstFileInfo* file : runs[level])
+        {
+            num_entries += file->num_entries;
+        }
+        if (runs[level].empty() || num_entries <= RunCapacity(level))
+        {
+            continue;
+        }
+
+        // Push the oldest file down, merging it only with the files it
+        // overlaps
+        const SstFileInfo* file = runs[level].back();
+        CompactionTask task;
+        task.inputs.push_back(file->filename);
+        task.num_input_entries = file->num_entries;
+        AddOverlapping(runs, level + 1, file->min_key, file->max_key, task);
+        task.output_level = level + 1;
+        task.trivial_move = task.inputs.size() == 1;
+        task.score = static_cast<double>(num_entries) / RunCapacity(level);
+        SetDropTombstones(files, task);
+        tasks.push_back(task);
+    }
+    SortByScore(tasks);
+    return tasks;
+}
+
+std::vector<CompactionTask>
+TieringPolicy::PickCompactions(const std::vector<SstFileInfo>& files) const
+{
+    std::vector<CompactionTask> tasks;
+    LevelRuns runs = GroupByLevel(files);
+    for (size_t level = 0; level < runs.size(); level++)
+    {
+        size_t num_runs = CountRuns(runs, level);
+        if (num_runs < static_cast<size_t>(size_ratio_))
+        {
+            continue;
+        }
+
+        // If the new run fills the next level as well, merge that level in
+        // the same pass instead of rewriting the run again right away
+        CompactionTask task;
+        int output_level = level + 1;
+        AddLevel(runs, level, task);
+        while (CountRuns(runs, output_level) + 1 >=
+               static_cast<size_t>(size_ratio_))
+        {
+            AddLevel(runs, output_level, task);
+            output_level++;
+        }
+        task.output_level = output_level;
+        task.score = static_cast<double>(num_runs) / size_ratio_;
+        SetDropTombstones(files, task);
+        tasks.push_back(task);
+    }
+    SortByScore(tasks);
+    return tasks;
+}
+
+std::vector<CompactionTask>
+LazyLevelingPolicy::PickCompactions(const std::vector<SstFileInfo>& files) const
+{
+    std::vector<CompactionTask> tasks = TieringPolicy::PickCompactions(files);
+
+    // A merge that lands on the last level is merged into its run. The last
+    // level grows until it holds a whole level's worth of runs.
+    LevelRuns runs = GroupByLevel(files);
+    int last_level = runs.size() - 1;
+    for (CompactionTask& task : tasks)
+    {
+        if (task.output_level != last_level)
+        {
+            continue;
+        }
+
+        AddLevel(runs, last_level, task);
+        if (task.num_input_entries > RunCapacity(last_level + 1))
+        {
+            task.output_level = last_level + 1;
+        }
+        SetDropTombstones(files, task);
+    }
+    return tasks;
+}
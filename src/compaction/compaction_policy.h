@@ -0,0 +1,128 @@
+#ifndef COMPACTION_POLICY_H
+#define COMPACTION_POLICY_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// How SST files are merged as they accumulate on each level.
+enum class CompactionStyle
+{
+    LEVELING,       // one run of disjoint files per level
+    TIERING,        // up to size_ratio runs per level before they are merged
+    LAZY_LEVELING,  // tiering, except for a single run on the last level
+};
+
+struct SstFileInfo
+{
+    std::string filename;
+    int level;
+    uint64_t num_entries;
+    // Files written by the same merge form one run and share the run id.
+    std::string run_id;
+    int min_key;
+    int max_key;
+};
+
+// A merge of one or more SST files into new files on output_level.
+struct CompactionTask
+{
+    std::vector<std::string> inputs;  // newest first
+    int output_level = 0;
+    uint64_t num_input_entries = 0;
+    // True if no older file that may hold the same keys is left outside the
+    // inputs, so deleted keys do not have to be remembered anymore.
+    bool drop_tombstones = false;
+    // The single input overlaps nothing on the output level, so it is moved
+    // there without being rewritten.
+    bool trivial_move = false;
+    // How far past its limit the level that triggered the merge is. Merges
+    // with higher scores run first.
+    double score = 0;
+};
+
+/** Decides which SST files to merge next.
+ *
+ *  The files are ordered from oldest to newest, which is from the highest
+ *  level to level 0, and by age within a level. Level i runs are expected to
+ *  hold about memtable_entries * size_ratio^i entries. A run can be split
+ *  into several files with disjoint key ranges.
+ */
+class CompactionPolicy
+{
+   public:
+    CompactionPolicy(int size_ratio, uint64_t memtable_entries);
+    virtual ~CompactionPolicy() = default;
+
+    static std::unique_ptr<CompactionPolicy> Create(CompactionStyle style,
+                                                    int size_ratio,
+                                                    uint64_t memtable_entries);
+
+    // Returns every merge that is due, highest score first. Merges of
+    // different levels are independent of each other.
+    virtual std::vector<CompactionTask> PickCompactions(
+        const std::vector<SstFileInfo>& files) const = 0;
+
+    // Pick the merge with the highest score. Returns false if no files need
+    // to be merged.
+    bool PickCompaction(const std::vector<SstFileInfo>& files,
+                        CompactionTask& task) const;
+
+   protected:
+    // The files on each level, newest first.
+    using LevelRuns = std::vector<std::vector<const SstFileInfo*>>;
+    static LevelRuns GroupByLevel(const std::vector<SstFileInfo>& files);
+
+    static size_t CountRuns(const LevelRuns& runs, int level);
+
+    // Add all files of a level to the task.
+    static void AddLevel(const LevelRuns& runs, int level,
+                         CompactionTask& task);
+    // Add the files of a level that overlap [min_key, max_key].
+    static void AddOverlapping(const LevelRuns& runs, int level, int min_key,
+                               int max_key, CompactionTask& task);
+    static void SetDropTombstones(const std::vector<SstFileInfo>& files,
+                                  CompactionTask& task);
+    static void SortByScore(std::vector<CompactionTask>& tasks);
+
+    // Expected number of entries in a level i run
+    uint64_t RunCapacity(int level) const;
+
+    int size_ratio_;
+    uint64_t memtable_entries_;
+};
+
+// Merges the files flushed to level 0 as soon as there are two, together
+// with the level 1 files they overlap. A deeper level that grows past its
+// capacity pushes its oldest file down into the files it overlaps on the next
+// level, or just moves it there if it overlaps none.
+class LevelingPolicy : public CompactionPolicy
+{
+   public:
+    using CompactionPolicy::CompactionPolicy;
+    std::vector<CompactionTask> PickCompactions(
+        const std::vector<SstFileInfo>& files) const override;
+};
+
+// Merges the size_ratio runs of a level into one run on the next level. If
+// that fills the next level too, its runs join the same merge.
+class TieringPolicy : public CompactionPolicy
+{
+   public:
+    using CompactionPolicy::CompactionPolicy;
+    std::vector<CompactionTask> PickCompactions(
+        const std::vector<SstFileInfo>& files) const override;
+};
+
+// Tiering on all levels but the last, which holds a single run that every
+// merge reaching it is merged into.
+class LazyLevelingPolicy : public TieringPolicy
+{
+   public:
+    using TieringPolicy::TieringPolicy;
+    std::vector<CompactionTask> PickCompactions(
+        const std::vector<SstFileInfo>& files) const override;
+};
+
+#endif
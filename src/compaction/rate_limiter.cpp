@@ -0,0 +1,52 @@
+#include "rate_limiter.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+RateLimiter::RateLimiter(uint64_t bytes_per_second)
+    : bytes_per_second_(bytes_per_second),
+      available_bytes_(static_cast<double>(bytes_per_second)),
+      last_refill_(Clock::now())
+{
+    if (bytes_per_second_ == 0)
+    {
+        throw std::runtime_error("Rate limit must be greater than 0");
+    }
+}
+
+void
+RateLimiter::Request(uint64_t bytes)
+{
+    std::chrono::duration<double> wait(0);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        // Refill the bucket for the time since the last request
+        Clock::time_point now = Clock::now();
+        std::chrono::duration<double> elapsed = now - last_refill_;
+        last_refill_ = now;
+        available_bytes_ =
+            std::min(available_bytes_ + elapsed.count() * bytes_per_second_,
+                     static_cast<double>(bytes_per_second_));
+
+        available_bytes_ -= bytes;
+        if (available_bytes_ < 0)
+        {
+            wait = std::chrono::duration<double>(-available_bytes_ /
+                                                 bytes_per_second_);
+        }
+    }
+
+    // Sleep without the lock so other threads can take their share
+    if (wait.count() > 0)
+    {
+        std::this_thread::sleep_for(wait);
+    }
+}
+
+uint64_t
+RateLimiter::GetBytesPerSecond() const
+{
+    return bytes_per_second_;
+}
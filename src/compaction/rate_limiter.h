@@ -0,0 +1,34 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/** Token bucket that limits the bytes per second of background I/O.
+ *
+ *  The bucket refills at bytes_per_second and holds at most one second of
+ *  tokens. A request takes its tokens even if the bucket runs short, and the
+ *  caller then sleeps until the debt is paid back, so large requests are not
+ *  starved by small ones. Safe to share between threads.
+ */
+class RateLimiter
+{
+   public:
+    explicit RateLimiter(uint64_t bytes_per_second);
+
+    // Block until the given number of bytes may be read or written.
+    void Request(uint64_t bytes);
+
+    uint64_t GetBytesPerSecond() const;
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t bytes_per_second_;
+    std::mutex mutex_;
+    double available_bytes_;
+    Clock::time_point last_refill_;
+};
+
+#endif
@@ -1,3 +1,6 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
 #include <climits>  // INT_MAX
 #include <cstdint>
 
@@ -8,10 +11,23 @@ static constexpr int BUFFER_POOL_SIZE = 128;  // size of buffer pool
 static constexpr int PAGE_SIZE = 4096;        // size of data page in byte
 static constexpr int BUCKET_SIZE = 50;        // size of extendible hash bucket6
 static constexpr int MAX_PAGE_KV_PAIRS = (PAGE_SIZE - 16) / 8;
+static constexpr int MAX_COMPRESSED_LEAF_KV_PAIRS = 4 * MAX_PAGE_KV_PAIRS;
 static constexpr int MEMTABLE_SIZE = 1024 * 1024;  // 1MB memtable size
 static constexpr int MAX_KEYS_IN_MEMTABLE = MEMTABLE_SIZE / 8;
 static constexpr int BLOOM_FILTER_BITS = MAX_KEYS_IN_MEMTABLE * 8;
+static constexpr int LEAF_BLOOM_FILTER_BITS_PER_KEY = 10;  // per-leaf filters
+static constexpr int SST_WRITE_BUFFER_PAGES = 64;  // pages per SST write
+static constexpr int MIN_SUBCOMPACTION_LEAF_PAGES = 64;  // per merge thread
+static constexpr int COMPACTION_READAHEAD_PAGES = 512;  // 2MB per read
 static constexpr int MAX_BUFFER_POOL_SIZE =
     10 * 1024 * 1024 / PAGE_SIZE;  // 10MB buffer pool size
+static constexpr int BUFFER_POOL_SHARDS = 16;  // independently locked LRUs
+static constexpr int MAX_REGISTERED_FILES = 1024;  // io_uring fixed files
+static constexpr int IO_BATCH_PAGES = 64;  // pages per read in a batch
+static constexpr int SCAN_READAHEAD_TRIGGER_LEAVES = 4;  // before readahead
+static constexpr int SCAN_READAHEAD_MIN_PAGES = 16;  // first readahead, 64KB
+static constexpr int SCAN_READAHEAD_MAX_PAGES = 256;  // doubles up to 1MB
 
 constexpr page_id_t INVALID_PAGE_ID = static_cast<page_id_t>(-1);
+
+#endif
@@ -1,29 +1,125 @@
 #include "database.h"
 
-#include <fcntl.h>   // for open
-#include <unistd.h>  // for pread
-
 #include <algorithm>
 #include <chrono>  // for using timestamps
 #include <climits>
 #include <filesystem>  // for using filesystem to check if directory exists
+#include <iomanip>     // for zero-padding level numbers
 #include <fstream>     // for reading and writing files
 #include <set>         // for using set to track found keys
 #include <sstream>     // for using stringstream to create filenames
 
-#include "b_tree/b_tree.h"
+#include "b_tree/b_tree_builder.h"
 #include "b_tree/b_tree_manager.h"
+#include "b_tree/merge_kernel.h"
 #include "bloom_filter/bloom_filter.h"
 #include "config.h"
 
+namespace
+{
+// The part of the filename shared by all files written by one merge: the
+// timestamp, without the partition index
+std::string
+GetSstRunId(const std::string& filename)
+{
+    size_t start = filename.find("sst_") + 9;
+    return filename.substr(start, filename.find_first_of("_.", start) - start);
+}
+
+// Merge runs of pairs sorted by key, given from the newest to the oldest,
+// keeping the newest pair of every key
+std::vector<std::pair<int, int>>
+MergeNewestFirst(const std::vector<std::vector<std::pair<int, int>>>& runs)
+{
+    std::vector<int> keys;
+    std::vector<int> values;
+    for (const auto& run : runs)
+    {
+        std::vector<int> run_keys;
+        std::vector<int> run_values;
+        for (const auto& pair : run)
+        {
+            run_keys.push_back(pair.first);
+            run_values.push_back(pair.second);
+        }
+
+        // The merge keeps the pair of the newer run first among equal keys,
+        // and the dedupe keeps only that one
+        std::vector<int> merged_keys(keys.size() + run.size());
+        std::vector<int> merged_values(merged_keys.size());
+        size_t num_merged = MergeSortedRuns(
+            keys.data(), values.data(), keys.size(), run_keys.data(),
+            run_values.data(), run_keys.size(), merged_keys.data(),
+            merged_values.data());
+        keys.resize(num_merged);
+        values.resize(num_merged);
+        size_t num_kept =
+            DedupeMergedRun(merged_keys.data(), merged_values.data(),
+                            num_merged, false, keys.data(), values.data());
+        keys.resize(num_kept);
+        values.resize(num_kept);
+    }
+
+    std::vector<std::pair<int, int>> pairs;
+    pairs.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        pairs.emplace_back(keys[i], values[i]);
+    }
+    return pairs;
+}
+}  // namespace
+
+uint64_t
+Snapshot::GetSequence() const
+{
+    return sequence_;
+}
+
 Database::Database(const std::string& name, size_t memtableSize,
                    bool use_binary_search)
+    : Database(name, DatabaseOptions{memtableSize, use_binary_search})
+{
+}
+
+Database::Database(const std::string& name, const DatabaseOptions& options)
+    : Database(name, options, nullptr)
+{
+}
+
+Database::Database(const std::string& name, const DatabaseOptions& options,
+                   std::shared_ptr<BufferPool> buffer_pool)
     : db_name_(name),
-      memtable_(memtableSize),
-      use_binary_search_(use_binary_search),
+      options_(options),
+      scheduler_(options.scheduler != nullptr ? *options.scheduler
+                                              : TaskScheduler::Default()),
       is_open_(false),
-      buffer_pool_(MAX_BUFFER_POOL_SIZE)
+      buffer_pool_(buffer_pool ? std::move(buffer_pool)
+                               : std::make_shared<BufferPool>(
+                                     MAX_BUFFER_POOL_SIZE, &statistics_)),
+      compaction_policy_(CompactionPolicy::Create(options.compaction_style,
+                                                  options.size_ratio,
+                                                  options.memtable_size / 8)),
+      io_engine_(
+          IoEngine::Create(options.io_engine, options.io_queue_depth,
+                           options.use_direct_io)),
+      memtable_(std::make_shared<Memtable>(options.memtable_size)),
+      current_(std::make_shared<Version>()),
+      last_sequence_(0),
+      background_compactions_(false),
+      flush_running_(false),
+      running_compactions_(0),
+      compaction_pending_(false),
+      stop_compactions_(true),
+      running_read_tasks_(0),
+      stop_reads_(true)
 {
+    if (options.compaction_bytes_per_second > 0)
+    {
+        rate_limiter_ =
+            std::make_unique<RateLimiter>(options.compaction_bytes_per_second);
+    }
+
     // Ensure the database name doesn't end with a slash
     if (db_name_.back() == '/')
     {
@@ -34,6 +130,7 @@ Database::Database(const std::string& name, size_t memtableSize,
 void
 Database::Open()
 {
+    std::vector<std::shared_ptr<SstFile>> files;
     if (!std::filesystem::exists(db_name_))
     {
         std::filesystem::create_directory(db_name_);
@@ -45,36 +142,53 @@ Database::Open()
             // Only include `.sst` files in the list
             if (entry.path().extension() == ".sst")
             {
-                sst_files_.push_back(entry.path().string());
+                files.push_back(LoadSstFile(entry.path().string()));
             }
+        }
+    }
 
-            // Load the Bloom filters for each SST file
-            if (entry.path().extension() == ".filter")
-            {
-                BloomFilter bloom_filter(entry.path().string());
-                // remove the .filter extension and add to the map
-                std::string sst_file = entry.path().string();
-                sst_file = sst_file.substr(0, sst_file.size() - 7);
-                bloom_filters_.insert({sst_file, bloom_filter});
-            }
+    // The first version holds every file, from the oldest to the newest.
+    // New writes continue after the newest sequence number on disk.
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        current_ = std::make_shared<Version>()->Apply({}, files);
+        for (const auto& file : files)
+        {
+            last_sequence_ =
+                std::max(last_sequence_, file->footer.max_sequence);
         }
     }
-    // Sort descending order to maintain LSM levels
-    std::sort(sst_files_.begin(), sst_files_.end(),
-              std::greater<std::string>());
     is_open_ = true;
+    StartCompactions();
+    StartReads();
 }
 
 void
 Database::Close()
 {
-    if (memtable_.GetSize() > 0)
+    // Serve the reads that are still queued before the files change
+    StopReads();
     {
-        StoreMemtable();
+        std::lock_guard<std::mutex> write_lock(write_mutex_);
+        if (memtable_->GetSize() > 0)
+        {
+            StoreMemtable();
+        }
     }
+
+    // Leave the files in their final shape for the next Open
+    WaitForCompactions();
+    StopCompactions();
     is_open_ = false;
 }
 
+Database::~Database()
+{
+    // A running flush or compaction finishes, but no new one is started
+    StopReads();
+    StopCompactions();
+}
+
 void
 Database::Put(int key, int value)
 {
@@ -83,8 +197,17 @@ Database::Put(int key, int value)
         return;
     }
 
-    memtable_.Put(key, value);
-    if (memtable_.IsFull())
+    statistics_.Record(Ticker::USER_BYTES_WRITTEN, 2 * sizeof(int));
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    bool is_full;
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        uint64_t snapshot_sequence =
+            snapshots_.empty() ? 0 : *snapshots_.rbegin();
+        memtable_->Put(key, value, ++last_sequence_, snapshot_sequence);
+        is_full = memtable_->IsFull();
+    }
+    if (is_full)
     {
         StoreMemtable();
     }
@@ -98,7 +221,11 @@ Database::Delete(int key)
         return;
     }
 
-    memtable_.Delete(key);
+    statistics_.Record(Ticker::USER_BYTES_WRITTEN, 2 * sizeof(int));
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    std::unique_lock<std::shared_mutex> lock(state_mutex_);
+    uint64_t snapshot_sequence = snapshots_.empty() ? 0 : *snapshots_.rbegin();
+    memtable_->Delete(key, ++last_sequence_, snapshot_sequence);
 }
 
 int
@@ -108,9 +235,28 @@ Database::Get(int key)
     {
         return -1;
     }
+    return Get(key, GetReadState());
+}
+
+int
+Database::Get(int key, const Snapshot& snapshot)
+{
+    if (!is_open_)
+    {
+        return -1;
+    }
+    statistics_.Record(Ticker::GETS);
 
-    // Check memtable first
-    auto result = memtable_.Get(key);
+    // Check memtable first. The memtable may still take writes.
+    int result;
+    {
+        std::shared_lock<std::shared_mutex> lock(state_mutex_);
+        result = snapshot.memtable_->Get(key, snapshot.sequence_);
+    }
+    if (result == -1 && snapshot.immutable_memtable_)
+    {
+        result = snapshot.immutable_memtable_->Get(key, snapshot.sequence_);
+    }
     if (result == INT_MAX)
     {
         return -1;
@@ -121,20 +267,43 @@ Database::Get(int key)
     }
 
     // Loop through SST files in reverse order
-    for (auto it = sst_files_.rbegin(); it != sst_files_.rend(); ++it)
+    const std::shared_ptr<const Version>& version = snapshot.version_;
+    const auto& files = version->GetFiles();
+    for (auto it = files.rbegin(); it != files.rend(); ++it)
     {
-        // Load the Bloom filter for the current SST file
-        auto bloom_filter = bloom_filters_.find(*it)->second;
+        const SstFile& file = **it;
+
+        // The files of a partitioned level cover disjoint key ranges
+        if (!file.footer.MayContainRange(key, key))
+        {
+            continue;
+        }
 
         // Check Bloom filter
-        if (!bloom_filter.MayContain(key))
+        if (!file.bloom_filter.MayContain(key))
         {
+            statistics_.Record(Ticker::BLOOM_FILTER_NEGATIVES);
             continue;
         }
 
         // Search the SST file using the BTreeManager
-        BTreeManager btm(*it, GetLargestLSMLevel(), buffer_pool_);
-        if (use_binary_search_)
+        BTreeManager btm(file.filename, version->GetLargestLevel(),
+                         *buffer_pool_, file.footer, file.io_file,
+                         file.mapped_file);
+        if (file.has_leaf_filters)
+        {
+            // The fence pointers lead straight to the only candidate leaf,
+            // and its filter tells us whether reading it is worthwhile
+            int leaf_page_id = file.leaf_filter_block.FindLeafPage(key);
+            if (leaf_page_id == INVALID_PAGE_ID)
+            {
+                statistics_.Record(Ticker::LEAF_FILTER_NEGATIVES);
+                statistics_.Record(Ticker::BLOOM_FILTER_FALSE_POSITIVES);
+                continue;
+            }
+            result = btm.GetFromLeafPage(leaf_page_id, key);
+        }
+        else if (options_.use_binary_search)
         {
             result = btm.BinarySearchGet(key);
         }
@@ -142,6 +311,9 @@ Database::Get(int key)
         {
             result = btm.Get(key);
         }
+        statistics_.Record(Ticker::GET_PAGES_READ, btm.GetPagesRead());
+        statistics_.Record(result == -1 ? Ticker::BLOOM_FILTER_FALSE_POSITIVES
+                                        : Ticker::BLOOM_FILTER_TRUE_POSITIVES);
 
         if (result == INT_MAX)
         {
@@ -156,21 +328,191 @@ Database::Get(int key)
     return -1;
 }
 
+std::vector<int>
+Database::MultiGet(const std::vector<int>& keys)
+{
+    if (!is_open_)
+    {
+        return std::vector<int>(keys.size(), -1);
+    }
+    return MultiGet(keys, GetReadState());
+}
+
+std::vector<int>
+Database::MultiGet(const std::vector<int>& keys, const Snapshot& snapshot)
+{
+    std::vector<int> values(keys.size(), -1);
+    if (!is_open_)
+    {
+        return values;
+    }
+    statistics_.Record(Ticker::MULTIGET_KEYS, keys.size());
+
+    // Sort and dedupe the keys so that each SST is searched in key order
+    std::vector<int> sorted_keys(keys);
+    std::sort(sorted_keys.begin(), sorted_keys.end());
+    sorted_keys.erase(std::unique(sorted_keys.begin(), sorted_keys.end()),
+                      sorted_keys.end());
+    std::vector<int> sorted_values(sorted_keys.size(), -1);
+
+    // Check memtable first. Keep the indexes of the unresolved keys.
+    std::vector<int> results(sorted_keys.size());
+    {
+        std::shared_lock<std::shared_mutex> lock(state_mutex_);
+        for (size_t i = 0; i < sorted_keys.size(); i++)
+        {
+            results[i] =
+                snapshot.memtable_->Get(sorted_keys[i], snapshot.sequence_);
+        }
+    }
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < sorted_keys.size(); i++)
+    {
+        int result = results[i];
+        if (result == -1 && snapshot.immutable_memtable_)
+        {
+            result = snapshot.immutable_memtable_->Get(sorted_keys[i],
+                                                       snapshot.sequence_);
+        }
+        if (result == -1)
+        {
+            pending.push_back(i);
+        }
+        else if (result != INT_MAX)
+        {
+            sorted_values[i] = result;
+        }
+    }
+
+    // Loop through SST files in reverse order until every key is resolved
+    const std::shared_ptr<const Version>& version = snapshot.version_;
+    const auto& files = version->GetFiles();
+    for (auto it = files.rbegin(); it != files.rend(); ++it)
+    {
+        if (pending.empty())
+        {
+            break;
+        }
+
+        // Probe the Bloom filter for the whole batch, prefetching the bits of
+        // the keys a few iterations ahead to hide the cache misses
+        const SstFile& file = **it;
+        const BloomFilter& bloom_filter = file.bloom_filter;
+        const SstFooter& footer = file.footer;
+        const size_t prefetch_distance = 8;
+        std::vector<size_t> candidates;
+        std::vector<int> candidate_keys;
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            if (i + prefetch_distance < pending.size())
+            {
+                bloom_filter.Prefetch(
+                    sorted_keys[pending[i + prefetch_distance]]);
+            }
+
+            int key = sorted_keys[pending[i]];
+            if (!footer.MayContainRange(key, key))
+            {
+                continue;
+            }
+            if (!bloom_filter.MayContain(key))
+            {
+                statistics_.Record(Ticker::BLOOM_FILTER_NEGATIVES);
+                continue;
+            }
+            candidates.push_back(pending[i]);
+            candidate_keys.push_back(key);
+        }
+
+        if (candidates.empty())
+        {
+            continue;
+        }
+
+        // Search the SST file for all candidates at once
+        BTreeManager btm(file.filename, version->GetLargestLevel(),
+                         *buffer_pool_, footer, file.io_file,
+                         file.mapped_file);
+        std::vector<int> results;
+        if (file.has_leaf_filters)
+        {
+            results = btm.MultiGet(candidate_keys, &file.leaf_filter_block);
+        }
+        else if (options_.use_binary_search)
+        {
+            for (int key : candidate_keys)
+            {
+                results.push_back(btm.BinarySearchGet(key));
+            }
+        }
+        else
+        {
+            results = btm.MultiGet(candidate_keys);
+        }
+
+        statistics_.Record(Ticker::MULTIGET_PAGES_READ, btm.GetPagesRead());
+
+        // Stop tracking the keys that were found or deleted in this SST
+        std::vector<bool> resolved(sorted_keys.size(), false);
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            if (results[i] == -1)
+            {
+                statistics_.Record(Ticker::BLOOM_FILTER_FALSE_POSITIVES);
+                continue;
+            }
+            statistics_.Record(Ticker::BLOOM_FILTER_TRUE_POSITIVES);
+            resolved[candidates[i]] = true;
+            if (results[i] != INT_MAX)
+            {
+                sorted_values[candidates[i]] = results[i];
+            }
+        }
+
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                     [&resolved](size_t i)
+                                     { return resolved[i]; }),
+                      pending.end());
+    }
+
+    // Map the results back to the order of the request
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        auto it =
+            std::lower_bound(sorted_keys.begin(), sorted_keys.end(), keys[i]);
+        values[i] = sorted_values[it - sorted_keys.begin()];
+    }
+
+    return values;
+}
+
 std::vector<std::pair<int, int>>
 Database::Scan(int key1, int key2)
+{
+    if (!is_open_)
+    {
+        return {};
+    }
+    return Scan(key1, key2, GetReadState());
+}
+
+std::vector<std::pair<int, int>>
+Database::Scan(int key1, int key2, const Snapshot& snapshot)
 {
     if (!is_open_)
     {
         return {};
     }
 
+    statistics_.Record(Ticker::SCANS);
     std::vector<std::pair<int, int>> results;
     int range = key2 - key1;
 
     // Scan memory table first
-    auto memtable_results = memtable_.Scan(key1, key2);
-    results.insert(results.end(), memtable_results.begin(),
-                   memtable_results.end());
+    {
+        std::shared_lock<std::shared_mutex> lock(state_mutex_);
+        results = snapshot.memtable_->Scan(key1, key2, snapshot.sequence_);
+    }
 
     // Use set to track found keys
     std::set<int> result_keys;
@@ -179,18 +521,54 @@ Database::Scan(int key1, int key2)
         result_keys.insert(r.first);
     }
 
+    // Then the memtable that is being flushed
+    if (snapshot.immutable_memtable_)
+    {
+        for (const auto& r : snapshot.immutable_memtable_->Scan(
+                 key1, key2, snapshot.sequence_))
+        {
+            if (result_keys.insert(r.first).second)
+            {
+                results.push_back(r);
+            }
+        }
+    }
+
     // Return if we have all possible keys
     if (result_keys.size() > static_cast<size_t>(range))
     {
+        std::sort(results.begin(), results.end());
         return results;
     }
 
-    // Go through SST files in reverse order
-    for (auto it = sst_files_.rbegin(); it != sst_files_.rend(); ++it)
+    // Large scans read the levels at the same time
+    const std::shared_ptr<const Version>& version = snapshot.version_;
+    if (options_.parallel_scan_min_keys > 0 &&
+        static_cast<int64_t>(key2) - key1 + 1 >=
+            options_.parallel_scan_min_keys)
+    {
+        return ScanLevelsInParallel(key1, key2, version, std::move(results));
+    }
+
+    // Go through SST files in reverse order, until every key of the range
+    // is found
+    const auto& files = version->GetFiles();
+    for (auto it = files.rbegin();
+         it != files.rend() && result_keys.size() <= static_cast<size_t>(range);
+         ++it)
     {
+        const SstFile& file = **it;
+        if (!file.footer.MayContainRange(key1, key2))
+        {
+            continue;
+        }
+
         // Scan the SST file using the BTreeManager
-        BTreeManager btm(*it, GetLargestLSMLevel(), buffer_pool_);
+        BTreeManager btm(file.filename, version->GetLargestLevel(),
+                         *buffer_pool_, file.footer, file.io_file,
+                         file.mapped_file);
         auto sst_results = btm.Scan(key1, key2);
+        statistics_.Record(Ticker::SCAN_PAGES_READ, btm.GetPagesRead());
 
         for (const auto& r : sst_results)
         {
@@ -200,51 +578,289 @@ Database::Scan(int key1, int key2)
                 result_keys.insert(r.first);
                 if (result_keys.size() > static_cast<size_t>(range))
                 {
-                    return results;
+                    break;
                 }
             }
         }
     }
 
+    // Every key appears once, so this orders the pairs by key, the same as
+    // the parallel scan
+    std::sort(results.begin(), results.end());
     return results;
 }
 
+std::future<int>
+Database::GetAsync(int key)
+{
+    std::promise<int> promise;
+    std::future<int> future = promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(read_mutex_);
+        if (!stop_reads_ && options_.async_read_threads > 0)
+        {
+            queued_gets_.push_back({key, std::move(promise)});
+            ScheduleReads();
+            return future;
+        }
+    }
+
+    // No task serves reads, so read now
+    std::vector<AsyncGet> gets;
+    gets.push_back({key, std::move(promise)});
+    ServeGets(gets);
+    return future;
+}
+
+std::future<std::vector<std::pair<int, int>>>
+Database::ScanAsync(int key1, int key2)
+{
+    std::promise<std::vector<std::pair<int, int>>> promise;
+    std::future<std::vector<std::pair<int, int>>> future =
+        promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(read_mutex_);
+        if (!stop_reads_ && options_.async_read_threads > 0)
+        {
+            queued_scans_.push_back({key1, key2, std::move(promise)});
+            ScheduleReads();
+            return future;
+        }
+    }
+
+    AsyncScan scan{key1, key2, std::move(promise)};
+    ServeScan(scan);
+    return future;
+}
+
+/* Start one task per level that holds files overlapping the range, then
+   merge the sorted results of the levels, newest first. The files of a
+   level are consecutive in the version, since higher levels are older. */
+std::vector<std::pair<int, int>>
+Database::ScanLevelsInParallel(int key1, int key2,
+                               const std::shared_ptr<const Version>& version,
+                               std::vector<std::pair<int, int>> pairs)
+{
+    std::vector<std::vector<std::shared_ptr<SstFile>>> levels;
+    const auto& files = version->GetFiles();
+    for (auto it = files.rbegin(); it != files.rend(); ++it)
+    {
+        if (!(*it)->footer.MayContainRange(key1, key2))
+        {
+            continue;
+        }
+        if (levels.empty() || levels.back().back()->level != (*it)->level)
+        {
+            levels.emplace_back();
+        }
+        levels.back().push_back(*it);
+    }
+
+    TaskGroup level_tasks(scheduler_, TaskPriority::READ);
+    std::vector<std::future<std::vector<std::pair<int, int>>>> level_scans;
+    for (const auto& level_files : levels)
+    {
+        level_scans.push_back(level_tasks.Async(
+            [this, key1, key2, &version, &level_files]()
+            { return ScanLevel(key1, key2, *version, level_files); }));
+    }
+    // Every task uses the levels, so wait for all before any error is thrown
+    level_tasks.Wait();
+
+    // The memtable pairs are the newest, then the levels from the top
+    std::vector<std::vector<std::pair<int, int>>> runs;
+    std::sort(pairs.begin(), pairs.end());
+    runs.push_back(std::move(pairs));
+    for (auto& level_scan : level_scans)
+    {
+        runs.push_back(level_scan.get());
+    }
+    return MergeNewestFirst(runs);
+}
+
+std::vector<std::pair<int, int>>
+Database::ScanLevel(int key1, int key2, const Version& version,
+                    const std::vector<std::shared_ptr<SstFile>>& files)
+{
+    std::vector<std::vector<std::pair<int, int>>> runs;
+    for (const auto& file : files)
+    {
+        BTreeManager btm(file->filename, version.GetLargestLevel(),
+                         *buffer_pool_, file->footer, file->io_file,
+                         file->mapped_file);
+        runs.push_back(btm.Scan(key1, key2));
+        statistics_.Record(Ticker::SCAN_PAGES_READ, btm.GetPagesRead());
+    }
+
+    // A tiered level may hold the same key in several files
+    if (runs.size() == 1)
+    {
+        return std::move(runs.front());
+    }
+    return MergeNewestFirst(runs);
+}
+
+/* Write the memtable to a new level 0 SST file. Must be called with
+   write_mutex_ held. Reads keep searching the memtable until the file is
+   installed, and writes go to a new memtable. With background compactions
+   the file is written by a scheduler task, after the previous flush is done.
+ */
 void
 Database::StoreMemtable()
 {
-    // Generate a unique filename for the SST file
-    std::string filename = GenerateFileName();
+    StallWrites();
 
-    // Get all kv pairs from the memtable in sorted order
-    auto result = memtable_.Scan(INT_MIN, INT_MAX);
+    bool background;
+    {
+        std::unique_lock<std::mutex> lock(compaction_mutex_);
+        compaction_cv_.wait(lock, [this] { return !flush_running_; });
+        background = background_compactions_;
 
-    // Create a BloomFilter and populate it with keys from the memtable. 8
-    // bits
-    // per entry
-    BloomFilter bloom_filter(BLOOM_FILTER_BITS);
+        // A failed background flush leaves its memtable in place, so that it
+        // is not lost
+        if (compaction_error_)
+        {
+            std::shared_lock<std::shared_mutex> state_lock(state_mutex_);
+            if (immutable_memtable_)
+            {
+                std::rethrow_exception(compaction_error_);
+            }
+        }
+    }
 
-    for (const auto& pair : result)
+    std::shared_ptr<const Memtable> memtable;
     {
-        bloom_filter.Insert(pair.first);
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        memtable = memtable_;
+        immutable_memtable_ = memtable;
+        memtable_ = std::make_shared<Memtable>(options_.memtable_size);
     }
 
+    // Generate a unique filename for the SST file
+    std::string filename = GenerateFileName();
+    if (background)
+    {
+        {
+            std::lock_guard<std::mutex> lock(compaction_mutex_);
+            flush_running_ = true;
+        }
+        scheduler_.Submit(TaskPriority::FLUSH,
+                          [this, memtable, filename]()
+                          { RunBackgroundFlush(memtable, filename); });
+        return;
+    }
+
+    // Compact before the write returns
+    FlushMemtable(memtable, filename);
+    Compact();
+}
+
+void
+Database::FlushMemtable(const std::shared_ptr<const Memtable>& memtable,
+                        const std::string& filename)
+{
+    // Create a BloomFilter and populate it with keys from the memtable, in
+    // a task of its own while this thread writes the B-tree pages. 8 bits
+    // per entry. The group waits for the task, which uses the memtable,
+    // before this function returns or throws.
+    TaskGroup filter_tasks(scheduler_, TaskPriority::FLUSH);
+    std::future<BloomFilter> bloom_filter_task = filter_tasks.Async(
+        [&memtable]()
+        {
+            BloomFilter bloom_filter(BLOOM_FILTER_BITS);
+            memtable->ForEach([&](int key, int) { bloom_filter.Insert(key); });
+            return bloom_filter;
+        });
+    LeafFilterBlock leaf_filter_block;
+
+    // Stream the memtable in sorted order straight into the B-tree pages
+    // instead of copying it into a vector first
+    BTreeBuilder builder(
+        filename, options_.compress_leaf_pages,
+        options_.use_leaf_filters ? &leaf_filter_block : nullptr, nullptr,
+        options_.use_direct_io);
+    memtable->ForEach([&](int key, int value) { builder.Add(key, value); });
+    builder.SetMaxSequence(memtable->GetMaxSequence());
+    builder.Finish();
+    filter_tasks.Wait();
+    BloomFilter bloom_filter = bloom_filter_task.get();
+
     // Serialize the BloomFilter to disk alongside the SST file
     bloom_filter.SerializeToDisk(filename + ".filter");
 
-    // add the bloom filter to the map
-    bloom_filters_.insert({filename, bloom_filter});
-    // Use BTree to store the data
-    BTree btree(result);
-    btree.SaveBTreeToDisk(filename);
+    // The leaf filter block is stored in the SST file itself
+    auto file =
+        std::make_shared<SstFile>(filename, builder.GetFooter(), bloom_filter);
+    file->has_leaf_filters = options_.use_leaf_filters;
+    file->leaf_filter_block = leaf_filter_block;
+    OpenForReads(*file);
 
-    // Add the SST file to the list of SST files
-    sst_files_.push_back(filename);
+    // The new file replaces the memtable in one step
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        current_ = current_->Apply({}, {file});
+        immutable_memtable_.reset();
+    }
+    statistics_.Record(Ticker::FLUSHES);
+    statistics_.RecordLevel(LevelTicker::BYTES_WRITTEN, 0,
+                            std::filesystem::file_size(filename));
+}
 
-    // Clear the memtable
-    memtable_.Clear();
+/* Flush a memtable as a scheduler task, then let the compactions know that
+   there may be work. */
+void
+Database::RunBackgroundFlush(std::shared_ptr<const Memtable> memtable,
+                             const std::string& filename)
+{
+    std::exception_ptr error;
+    try
+    {
+        FlushMemtable(memtable, filename);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
 
-    // Compact if necessary
-    Compact();
+    std::lock_guard<std::mutex> lock(compaction_mutex_);
+    flush_running_ = false;
+    if (error && !compaction_error_)
+    {
+        compaction_error_ = error;
+    }
+    compaction_pending_ = true;
+    ScheduleCompactions();
+    compaction_cv_.notify_all();
+}
+
+/* Wait while level 0 is full, so that flushes do not outrun the background
+   compactions. Stops waiting once no compaction is running or due, which
+   also covers policies that let level 0 grow past the limit. */
+void
+Database::StallWrites()
+{
+    std::unique_lock<std::mutex> lock(compaction_mutex_);
+    if (!background_compactions_)
+    {
+        return;
+    }
+    compaction_cv_.wait(
+        lock,
+        [this]
+        {
+            if (compaction_error_ ||
+                (running_compactions_ == 0 && !compaction_pending_))
+            {
+                return true;
+            }
+            std::shared_ptr<const Version> version = GetCurrentVersion();
+            const auto& files = version->GetFiles();
+            int num_level_0_files =
+                std::count_if(files.begin(), files.end(),
+                              [](const std::shared_ptr<SstFile>& file)
+                              { return file->level == 0; });
+            return num_level_0_files < options_.level0_stall_files;
+        });
 }
 
 /* A helper function for StoreMemtable. Generate a unique filename for each
@@ -265,80 +881,619 @@ Database::GenerateFileName()
     return filename.str();
 }
 
+std::shared_ptr<const Version>
+Database::GetCurrentVersion()
+{
+    std::shared_lock<std::shared_mutex> lock(state_mutex_);
+    return current_;
+}
+
+Snapshot
+Database::GetReadState()
+{
+    Snapshot state;
+    std::shared_lock<std::shared_mutex> lock(state_mutex_);
+    state.memtable_ = memtable_;
+    state.immutable_memtable_ = immutable_memtable_;
+    state.version_ = current_;
+    return state;
+}
+
+/* Register a snapshot at the last sequence number, so that writes keep the
+   memtable values it can see. Dropping the snapshot unregisters it. */
+std::shared_ptr<const Snapshot>
+Database::GetSnapshot()
+{
+    auto snapshot = std::make_unique<Snapshot>();
+    {
+        std::unique_lock<std::shared_mutex> lock(state_mutex_);
+        snapshot->sequence_ = last_sequence_;
+        snapshot->memtable_ = memtable_;
+        snapshot->immutable_memtable_ = immutable_memtable_;
+        snapshot->version_ = current_;
+        snapshots_.insert(last_sequence_);
+    }
+
+    return std::shared_ptr<const Snapshot>(
+        snapshot.release(),
+        [this](const Snapshot* released)
+        {
+            {
+                std::unique_lock<std::shared_mutex> lock(state_mutex_);
+                snapshots_.erase(snapshots_.find(released->sequence_));
+            }
+            delete released;
+        });
+}
+
+/* Replace the current version with one that has the given files removed and
+   added. The removed files are deleted once no read uses them anymore. */
+void
+Database::InstallVersion(const std::vector<std::string>& removed,
+                         const std::vector<std::shared_ptr<SstFile>>& added)
+{
+    std::unique_lock<std::shared_mutex> lock(state_mutex_);
+    current_ = current_->Apply(removed, added);
+}
+
+/* Describe the SST files for the compaction policy, from the oldest to the
+   newest. */
+std::vector<SstFileInfo>
+Database::GetSstFileInfos(const Version& version)
+{
+    std::vector<SstFileInfo> files;
+    for (const auto& file : version.GetFiles())
+    {
+        const SstFooter& footer = file->footer;
+        uint64_t num_entries = footer.num_entries;
+        if (footer.num_leaf_pages < 0)
+        {
+            // Older files do not record their size, estimate it
+            num_entries = std::filesystem::file_size(file->filename) /
+                          PAGE_SIZE * MAX_PAGE_KV_PAIRS;
+        }
+        // Without a footer the key range is unknown
+        bool has_range = footer.num_leaf_pages >= 0;
+        files.push_back({file->filename, file->level, num_entries,
+                         GetSstRunId(file->filename),
+                         has_range ? footer.min_key : INT_MIN,
+                         has_range ? footer.max_key : INT_MAX});
+    }
+    return files;
+}
+
 void
 Database::Compact()
 {
-    // To compact, we will look at the most recent 2 SST files. If they have
-    // the same level, we will use BTreeManager to merge them into a new SST.
-    // If this new SST shares a level with the next most recent SST, we will
-    // merge them as well. We will continue this process until we reach an SST
-    // with a different level.
+    // Let the compaction policy pick merges until every level is within its
+    // limits
+    CompactionTask task;
+    while (compaction_policy_->PickCompaction(
+        GetSstFileInfos(*GetCurrentVersion()), task))
+    {
+        RunCompaction(task);
+    }
+}
+
+/* Merge the input files of a compaction in one pass and replace them with
+   the merged files. Only installing the new version blocks reads. */
+void
+Database::RunCompaction(const CompactionTask& task)
+{
+    // The inputs stay in this version until this compaction removes them,
+    // since no other compaction uses their levels
+    std::shared_ptr<const Version> version = GetCurrentVersion();
+    std::shared_ptr<SstFile> newest = version->FindFile(task.inputs.front());
 
-    // sst_files_ are sorted by timestamp, so the most recent SST is at the end.
-    if (sst_files_.size() < 2)
+    if (task.trivial_move)
     {
+        InstallVersion({newest->filename},
+                       {MoveSstFile(*newest, task.output_level)});
+        statistics_.Record(Ticker::TRIVIAL_MOVES);
         return;
     }
+    auto start_time = std::chrono::steady_clock::now();
 
-    std::string filename1 = sst_files_[sst_files_.size() - 1];
-    std::string filename2 = sst_files_[sst_files_.size() - 2];
+    std::vector<std::string> older_files(task.inputs.begin() + 1,
+                                         task.inputs.end());
 
-    // check if they each have the same level. if not, return an error
-    // search for "sst_" and get the next 4 characters. The filename includes
-    // the path
-    std::string level1 = filename1.substr(filename1.find("sst_") + 4, 4);
-    std::string level2 = filename2.substr(filename2.find("sst_") + 4, 4);
-    if (level1 != level2)
+    MergeOptions merge_options;
+    merge_options.build_leaf_filters = options_.use_leaf_filters;
+    merge_options.compress_leaf_pages = options_.compress_leaf_pages;
+    merge_options.max_file_entries = options_.sst_partition_entries;
+    merge_options.max_subcompactions = options_.max_subcompactions;
+    merge_options.rate_limiter = rate_limiter_.get();
+    merge_options.direct_io = options_.use_direct_io;
+    merge_options.output_dir = db_name_;
+    merge_options.scheduler = &scheduler_;
+    for (const auto& filename : task.inputs)
+    {
+        merge_options.max_sequence =
+            std::max(merge_options.max_sequence,
+                     version->FindFile(filename)->footer.max_sequence);
+    }
+    BTreeManager btm(newest->filename, version->GetLargestLevel(),
+                     *buffer_pool_, newest->footer, newest->io_file);
+    std::vector<MergeOutput> outputs = btm.MergeMany(
+        older_files, task.output_level, task.drop_tombstones, merge_options);
+    for (const auto& filename : task.inputs)
+    {
+        statistics_.RecordLevel(LevelTicker::BYTES_READ,
+                                GetSstLevel(filename),
+                                std::filesystem::file_size(filename));
+    }
+
+    // A merge whose pairs were all dropped tombstones writes a file with no
+    // entries. Its footer key range would wrongly overlap key 0.
+    std::vector<MergeOutput> nonempty_outputs;
+    for (auto& output : outputs)
+    {
+        SstFooter footer;
+        footer.ReadFromFile(output.filename);
+        if (footer.num_entries == 0)
+        {
+            std::filesystem::remove(output.filename);
+            continue;
+        }
+        nonempty_outputs.push_back(std::move(output));
+    }
+    outputs.swap(nonempty_outputs);
+
+    // The merge wrote the outputs into the database directory. Serialize the
+    // Bloom filters built during the merge next to them.
+    std::vector<std::shared_ptr<SstFile>> output_files;
+    for (const auto& output : outputs)
+    {
+        const std::string& out_path = output.filename;
+        SstFooter footer;
+        footer.ReadFromFile(out_path);
+        output.bloom_filter.SerializeToDisk(out_path + ".filter");
+        auto file = std::make_shared<SstFile>(out_path, footer,
+                                              output.bloom_filter);
+        file->has_leaf_filters = options_.use_leaf_filters;
+        file->leaf_filter_block = output.leaf_filter_block;
+        OpenForReads(*file);
+        output_files.push_back(file);
+        statistics_.RecordLevel(LevelTicker::BYTES_WRITTEN, task.output_level,
+                                std::filesystem::file_size(out_path));
+    }
+
+    // The merged files are deleted once the reads that use them finish
+    InstallVersion(task.inputs, output_files);
+
+    statistics_.Record(Ticker::COMPACTIONS);
+    statistics_.RecordCompactionMicros(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_time)
+            .count());
+}
+
+/* Move an SST file to another level without rewriting it. The file and its
+   filters get a second name in the new level, and the old names are removed
+   once no read uses them anymore. */
+std::shared_ptr<SstFile>
+Database::MoveSstFile(const SstFile& file, int level)
+{
+    std::stringstream level_digits;
+    level_digits << std::setfill('0') << std::setw(4) << level;
+    std::string new_filename = file.filename;
+    new_filename.replace(new_filename.find("sst_") + 4, 4, level_digits.str());
+
+    std::filesystem::create_hard_link(file.filename, new_filename);
+    std::filesystem::create_hard_link(file.filename + ".filter",
+                                      new_filename + ".filter");
+    if (std::filesystem::exists(file.filename + ".leaf_filter"))
+    {
+        std::filesystem::create_hard_link(file.filename + ".leaf_filter",
+                                          new_filename + ".leaf_filter");
+    }
+
+    auto moved_file =
+        std::make_shared<SstFile>(new_filename, file.footer, file.bloom_filter);
+    moved_file->has_leaf_filters = file.has_leaf_filters;
+    moved_file->leaf_filter_block = file.leaf_filter_block;
+    // Both names are links to the same data, so the open file is shared
+    moved_file->io_file = file.io_file;
+    moved_file->mapped_file = file.mapped_file;
+    return moved_file;
+}
+
+/* Open an SST file for the reads of this database, and map it if reads go
+   through memory mappings. */
+void
+Database::OpenForReads(SstFile& file)
+{
+    file.io_file = io_engine_->OpenFile(file.filename, true);
+    if (options_.use_mmap_reads)
+    {
+        file.mapped_file = MappedFile::Open(file.filename);
+    }
+}
+
+/* Load an SST file with its footer, its Bloom filter and, if this database
+   uses per-leaf filters, the leaf filter block. */
+std::shared_ptr<SstFile>
+Database::LoadSstFile(const std::string& filename)
+{
+    SstFooter footer;
+    footer.ReadFromFile(filename);
+    auto file = std::make_shared<SstFile>(filename, footer,
+                                          BloomFilter(filename + ".filter"));
+    OpenForReads(*file);
+    if (!options_.use_leaf_filters)
+    {
+        return file;
+    }
+
+    // Files written before the footer existed keep their leaf filters in a
+    // separate file
+    if (std::filesystem::exists(filename + ".leaf_filter"))
+    {
+        file->has_leaf_filters = true;
+        file->leaf_filter_block = LeafFilterBlock(filename + ".leaf_filter");
+        return file;
+    }
+    if (footer.filter_block_size == 0)
+    {
+        return file;
+    }
+
+    std::vector<char> buffer(footer.filter_block_size);
+    ssize_t bytes_read = file->io_file->Read(buffer.data(), buffer.size(),
+                                             footer.filter_block_offset);
+    if (bytes_read != static_cast<ssize_t>(buffer.size()))
+    {
+        throw std::runtime_error("Failed to read leaf filter block: " +
+                                 filename);
+    }
+
+    file->has_leaf_filters = true;
+    file->leaf_filter_block.DeserializeFromBuffer(buffer.data(),
+                                                  buffer.size());
+    return file;
+}
+
+void
+Database::StartCompactions()
+{
+    std::lock_guard<std::mutex> lock(compaction_mutex_);
+    stop_compactions_ = false;
+    compaction_error_ = nullptr;
+    background_compactions_ = options_.background_compaction_threads > 0;
+    // Files left from the last session may be due for a merge
+    compaction_pending_ = true;
+    ScheduleCompactions();
+}
+
+/* Let the running flush and compactions finish, and start no new ones. */
+void
+Database::StopCompactions()
+{
+    std::unique_lock<std::mutex> lock(compaction_mutex_);
+    stop_compactions_ = true;
+    compaction_cv_.wait(
+        lock, [this] { return running_compactions_ == 0 && !flush_running_; });
+    background_compactions_ = false;
+}
+
+void
+Database::WaitForCompactions()
+{
+    std::unique_lock<std::mutex> lock(compaction_mutex_);
+    compaction_cv_.wait(lock,
+                        [this]
+                        {
+                            return compaction_error_ ||
+                                   !background_compactions_ ||
+                                   (running_compactions_ == 0 &&
+                                    !compaction_pending_ && !flush_running_);
+                        });
+    if (compaction_error_)
+    {
+        std::rethrow_exception(compaction_error_);
+    }
+}
+
+/* Submit the due merges with the highest scores whose levels are not used by
+   a running merge, up to background_compaction_threads at a time. Must be
+   called with compaction_mutex_ held. */
+void
+Database::ScheduleCompactions()
+{
+    if (!background_compactions_ || stop_compactions_ || compaction_error_)
     {
         return;
     }
+    while (compaction_pending_ &&
+           running_compactions_ < options_.background_compaction_threads)
+    {
+        CompactionTask task;
+        std::set<int> levels;
+        if (!PickRunnableCompaction(task, levels))
+        {
+            // Nothing can run until a file is flushed or a merge finishes
+            compaction_pending_ = false;
+            compaction_cv_.notify_all();
+            return;
+        }
 
-    BTreeManager btm(filename1, GetLargestLSMLevel(), buffer_pool_);
-    std::string out_file = btm.Merge(filename2);
-    std::filesystem::rename(out_file, db_name_ + "/" + out_file);
+        busy_levels_.insert(levels.begin(), levels.end());
+        running_compactions_++;
+        scheduler_.Submit(TaskPriority::COMPACTION,
+                          [this, task, levels]()
+                          { RunBackgroundCompaction(task, levels); });
+    }
+}
 
-    // Load Bloom filters for both files
-    BloomFilter bloom_filter1(filename1 + ".filter");
-    BloomFilter bloom_filter2(filename2 + ".filter");
+/* Run one merge as a scheduler task, then release its levels and submit the
+   merges that became runnable. */
+void
+Database::RunBackgroundCompaction(const CompactionTask& task,
+                                  const std::set<int>& levels)
+{
+    std::exception_ptr error;
+    try
+    {
+        RunCompaction(task);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
 
-    // Create a new Bloom filter as the union of both
-    BloomFilter merged_filter(BLOOM_FILTER_BITS);
-    merged_filter.Union(bloom_filter1);
-    merged_filter.Union(bloom_filter2);
+    std::lock_guard<std::mutex> lock(compaction_mutex_);
+    for (int level : levels)
+    {
+        busy_levels_.erase(level);
+    }
+    running_compactions_--;
+    if (error && !compaction_error_)
+    {
+        compaction_error_ = error;
+    }
+    compaction_pending_ = true;
+    ScheduleCompactions();
+    compaction_cv_.notify_all();
+}
 
-    // Serialize the merged Bloom filter to disk
-    std::string out_filter = db_name_ + "/" + out_file + ".filter";
-    merged_filter.SerializeToDisk(out_filter);
+void
+Database::StartReads()
+{
+    std::lock_guard<std::mutex> lock(read_mutex_);
+    stop_reads_ = false;
+}
 
-    // remove the merged files
-    std::filesystem::remove(filename1);
-    std::filesystem::remove(filename1 + ".filter");
-    std::filesystem::remove(filename2);
-    std::filesystem::remove(filename2 + ".filter");
-    sst_files_.pop_back();
-    sst_files_.pop_back();
+/* Wait for the read tasks. They serve every queued read before they end, so
+   every future gets its result. */
+void
+Database::StopReads()
+{
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    stop_reads_ = true;
+    read_cv_.wait(lock, [this] { return running_read_tasks_ == 0; });
+}
 
-    // add the new merged file to the list of SST files
-    sst_files_.push_back(db_name_ + "/" + out_file);
+/* Submit a read task for newly queued reads, unless async_read_threads tasks
+   are serving the queue already. Must be called with read_mutex_ held. */
+void
+Database::ScheduleReads()
+{
+    if (running_read_tasks_ >= options_.async_read_threads)
+    {
+        return;
+    }
+    running_read_tasks_++;
+    scheduler_.Submit(TaskPriority::READ, [this]() { ServeQueuedReads(); });
+}
 
-    // add the new bloom filter to the map
-    bloom_filters_.insert({db_name_ + "/" + out_file, merged_filter});
-    bloom_filters_.erase(filename1 + ".filter");
-    bloom_filters_.erase(filename2 + ".filter");
+/* Serve queued reads until the queue is empty. The Gets that queued up while
+   the task was busy are served as one batch, so their page reads are shared
+   and submitted together. */
+void
+Database::ServeQueuedReads()
+{
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    while (true)
+    {
+        if (!queued_gets_.empty())
+        {
+            std::vector<AsyncGet> gets;
+            gets.swap(queued_gets_);
+            lock.unlock();
+            ServeGets(gets);
+            lock.lock();
+        }
+        else if (!queued_scans_.empty())
+        {
+            AsyncScan scan = std::move(queued_scans_.front());
+            queued_scans_.pop_front();
+            lock.unlock();
+            ServeScan(scan);
+            lock.lock();
+        }
+        else
+        {
+            running_read_tasks_--;
+            read_cv_.notify_all();
+            return;
+        }
+    }
+}
 
-    // recursively compact
-    Compact();
+void
+Database::ServeGets(std::vector<AsyncGet>& gets)
+{
+    try
+    {
+        if (gets.size() == 1)
+        {
+            gets[0].promise.set_value(Get(gets[0].key));
+            return;
+        }
+        std::vector<int> keys;
+        for (const AsyncGet& get : gets)
+        {
+            keys.push_back(get.key);
+        }
+        std::vector<int> values = MultiGet(keys);
+        for (size_t i = 0; i < gets.size(); i++)
+        {
+            gets[i].promise.set_value(values[i]);
+        }
+    }
+    catch (...)
+    {
+        for (AsyncGet& get : gets)
+        {
+            try
+            {
+                get.promise.set_exception(std::current_exception());
+            }
+            catch (const std::future_error&)
+            {
+                // This promise already has its value
+            }
+        }
+    }
 }
 
-int
-Database::GetLargestLSMLevel()
+void
+Database::ServeScan(AsyncScan& scan)
+{
+    try
+    {
+        scan.promise.set_value(Scan(scan.key1, scan.key2));
+    }
+    catch (...)
+    {
+        scan.promise.set_exception(std::current_exception());
+    }
+}
+
+/* Pick the due merge with the highest score that shares no level with a
+   running merge. Must be called with compaction_mutex_ held. */
+bool
+Database::PickRunnableCompaction(CompactionTask& task, std::set<int>& levels)
 {
-    if (sst_files_.empty())
+    for (const CompactionTask& candidate : compaction_policy_->PickCompactions(
+             GetSstFileInfos(*GetCurrentVersion())))
     {
-        return 0;
+        std::set<int> candidate_levels = {candidate.output_level};
+        for (const auto& filename : candidate.inputs)
+        {
+            candidate_levels.insert(GetSstLevel(filename));
+        }
+
+        bool conflicts = false;
+        for (int level : candidate_levels)
+        {
+            conflicts |= busy_levels_.count(level) > 0;
+        }
+        if (!conflicts)
+        {
+            task = candidate;
+            levels = candidate_levels;
+            return true;
+        }
     }
+    return false;
+}
+
+DatabaseStats
+Database::GetStats()
+{
+    DatabaseStats stats;
+    stats.user_bytes_written = statistics_.Get(Ticker::USER_BYTES_WRITTEN);
+    stats.gets = statistics_.Get(Ticker::GETS);
+    stats.get_pages_read = statistics_.Get(Ticker::GET_PAGES_READ);
+    stats.multiget_keys = statistics_.Get(Ticker::MULTIGET_KEYS);
+    stats.multiget_pages_read = statistics_.Get(Ticker::MULTIGET_PAGES_READ);
+    stats.scans = statistics_.Get(Ticker::SCANS);
+    stats.scan_pages_read = statistics_.Get(Ticker::SCAN_PAGES_READ);
+    stats.buffer_pool_hits = statistics_.Get(Ticker::BUFFER_POOL_HITS);
+    stats.buffer_pool_misses = statistics_.Get(Ticker::BUFFER_POOL_MISSES);
+    stats.bloom_filter_negatives =
+        statistics_.Get(Ticker::BLOOM_FILTER_NEGATIVES);
+    stats.bloom_filter_true_positives =
+        statistics_.Get(Ticker::BLOOM_FILTER_TRUE_POSITIVES);
+    stats.bloom_filter_false_positives =
+        statistics_.Get(Ticker::BLOOM_FILTER_FALSE_POSITIVES);
+    stats.leaf_filter_negatives = statistics_.Get(Ticker::LEAF_FILTER_NEGATIVES);
+    stats.flushes = statistics_.Get(Ticker::FLUSHES);
+    stats.compactions = statistics_.Get(Ticker::COMPACTIONS);
+    stats.trivial_moves = statistics_.Get(Ticker::TRIVIAL_MOVES);
+    stats.compaction_micros = statistics_.Get(Ticker::COMPACTION_MICROS);
+    stats.max_compaction_micros = statistics_.GetMaxCompactionMicros();
 
-    // search for "sst_" and get the next 4 characters
-    std::string level = sst_files_[0].substr(sst_files_[0].find("sst_") + 4, 4);
-    return std::stoi(level);
-}
\ No newline at end of file
+    // The current files of each level
+    std::shared_ptr<const Version> version = GetCurrentVersion();
+    for (const auto& file : version->GetFiles())
+    {
+        int level = std::min(file->level, MAX_STATS_LEVELS - 1);
+        if (static_cast<int>(stats.levels.size()) <= level)
+        {
+            stats.levels.resize(level + 1);
+        }
+        stats.levels[level].num_files++;
+        stats.levels[level].file_bytes +=
+            std::filesystem::file_size(file->filename);
+    }
+
+    for (int level = 0; level < MAX_STATS_LEVELS; level++)
+    {
+        uint64_t bytes_read =
+            statistics_.GetLevel(LevelTicker::BYTES_READ, level);
+        uint64_t bytes_written =
+            statistics_.GetLevel(LevelTicker::BYTES_WRITTEN, level);
+        if ((bytes_read > 0 || bytes_written > 0) &&
+            static_cast<int>(stats.levels.size()) <= level)
+        {
+            stats.levels.resize(level + 1);
+        }
+        if (level < static_cast<int>(stats.levels.size()))
+        {
+            stats.levels[level].bytes_read = bytes_read;
+            stats.levels[level].bytes_written = bytes_written;
+        }
+
+        stats.compaction_bytes_read += bytes_read;
+        if (level == 0)
+        {
+            stats.flush_bytes_written = bytes_written;
+        }
+        else
+        {
+            stats.compaction_bytes_written += bytes_written;
+        }
+    }
+    for (size_t level = 0; level < stats.levels.size(); level++)
+    {
+        stats.levels[level].level = level;
+    }
+
+    if (stats.user_bytes_written > 0)
+    {
+        stats.write_amplification =
+            static_cast<double>(stats.flush_bytes_written +
+                                stats.compaction_bytes_written) /
+            stats.user_bytes_written;
+    }
+    uint64_t num_lookups = stats.gets + stats.multiget_keys + stats.scans;
+    if (num_lookups > 0)
+    {
+        stats.read_amplification =
+            static_cast<double>(stats.get_pages_read +
+                                stats.multiget_pages_read +
+                                stats.scan_pages_read) /
+            num_lookups;
+    }
+    uint64_t num_positives =
+        stats.bloom_filter_true_positives + stats.bloom_filter_false_positives;
+    if (num_positives > 0)
+    {
+        stats.bloom_filter_false_positive_rate =
+            static_cast<double>(stats.bloom_filter_false_positives) /
+            num_positives;
+    }
+    return stats;
+}
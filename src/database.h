@@ -1,38 +1,211 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
 #include <string>
-#include <unordered_map>
 
+#include "b_tree/sst_footer.h"
 #include "bloom_filter/bloom_filter.h"
+#include "bloom_filter/leaf_filter_block.h"
+#include "compaction/compaction_policy.h"
+#include "compaction/rate_limiter.h"
 #include "buffer_pool/buffer_pool.h"
+#include "io/io_engine.h"
 #include "memtable.h"
+#include "options.h"
+#include "scheduler/task_scheduler.h"
 #include "sst.h"
+#include "statistics/statistics.h"
+#include "version/version.h"
 
+/** A consistent point-in-time view of a Database, taken by GetSnapshot.
+ *
+ *  Reads given a snapshot see every write made before it was taken and none
+ *  made after, even across flushes and compactions. The snapshot keeps the
+ *  memtables and SST files of that moment alive, so nothing it can read is
+ *  deleted until it is released by dropping the last pointer to it. It must
+ *  not outlive its Database.
+ */
+class Snapshot
+{
+   public:
+    // Sequence number of the last write the snapshot sees.
+    uint64_t GetSequence() const;
+
+   private:
+    friend class Database;
+
+    uint64_t sequence_ = UINT64_MAX;
+    std::shared_ptr<const Memtable> memtable_;
+    std::shared_ptr<const Memtable> immutable_memtable_;
+    std::shared_ptr<const Version> version_;
+};
+
+/** LSM-tree key-value store.
+ *
+ *  Safe to use from several threads. Puts, Deletes and flushes run one at a
+ *  time. A read holds state_mutex_ shared only while it searches the active
+ *  memtable and takes references to the memtable being flushed and to the
+ *  current version. It then searches those without any lock, so reads never
+ *  wait for a flush or compaction to write its files.
+ *
+ *  Every Put and Delete gets the next sequence number. Reads without a
+ *  snapshot see the newest data, and newer writes may appear while a Scan
+ *  runs. Reads given a Snapshot see a fixed point in time.
+ */
 class Database
 {
    private:
     std::string db_name_;
-    Memtable memtable_;
-    bool use_binary_search_;
+    DatabaseOptions options_;
+    // Runs the background flushes and compactions, the async reads and the
+    // parallel parts of scans and merges.
+    TaskScheduler& scheduler_;
     bool is_open_;
-    BufferPool buffer_pool_;
-    std::vector<std::string> sst_files_;
-    std::unordered_map<std::string, BloomFilter> bloom_filters_;
+    Statistics statistics_;
+    std::shared_ptr<BufferPool> buffer_pool_;
+    std::unique_ptr<CompactionPolicy> compaction_policy_;
+    std::unique_ptr<RateLimiter> rate_limiter_;
+    // Reads the SST files. Declared before the versions and memtables, so
+    // that the files they hold are closed before it is destroyed.
+    std::unique_ptr<IoEngine> io_engine_;
+
+    // Serializes Puts, Deletes and flushes.
+    std::mutex write_mutex_;
+
+    // Guards the three pointers below and the contents of the active
+    // memtable. It is never held while reading or writing files.
+    std::shared_mutex state_mutex_;
+    std::shared_ptr<Memtable> memtable_;
+    std::shared_ptr<const Memtable> immutable_memtable_;  // being flushed
+    std::shared_ptr<const Version> current_;
+    uint64_t last_sequence_;
+    std::multiset<uint64_t> snapshots_;  // sequence numbers of live snapshots
+
+    // Background flushes and compactions, run as scheduler tasks. One flush
+    // runs at a time. A compaction reserves every level it reads or writes,
+    // so compactions that run at the same time never share a level.
+    // compaction_mutex_ may be held while taking state_mutex_, but is never
+    // taken while holding it.
+    std::mutex compaction_mutex_;
+    std::condition_variable compaction_cv_;
+    bool background_compactions_;
+    bool flush_running_;
+    std::set<int> busy_levels_;
+    int running_compactions_;
+    bool compaction_pending_;  // files changed since the last pick
+    bool stop_compactions_;
+    std::exception_ptr compaction_error_;  // of a flush or compaction
+
+    // Asynchronous reads, queued until a read task takes them. A task takes
+    // every queued Get at once, or else the oldest Scan.
+    struct AsyncGet
+    {
+        int key;
+        std::promise<int> promise;
+    };
+    struct AsyncScan
+    {
+        int key1;
+        int key2;
+        std::promise<std::vector<std::pair<int, int>>> promise;
+    };
+    std::mutex read_mutex_;
+    std::condition_variable read_cv_;
+    int running_read_tasks_;
+    std::vector<AsyncGet> queued_gets_;
+    std::deque<AsyncScan> queued_scans_;
+    bool stop_reads_;
+
     void StoreMemtable();
+    // Write a memtable to a new level 0 SST file and install it.
+    void FlushMemtable(const std::shared_ptr<const Memtable>& memtable,
+                       const std::string& filename);
+    void RunBackgroundFlush(std::shared_ptr<const Memtable> memtable,
+                            const std::string& filename);
+    std::shared_ptr<SstFile> LoadSstFile(const std::string& filename);
+    void OpenForReads(SstFile& file);
     std::string GenerateFileName();
+    std::shared_ptr<const Version> GetCurrentVersion();
+    // The current state, without registering a snapshot. Reads with it see
+    // the newest data.
+    Snapshot GetReadState();
+    void InstallVersion(const std::vector<std::string>& removed,
+                        const std::vector<std::shared_ptr<SstFile>>& added);
+    std::vector<SstFileInfo> GetSstFileInfos(const Version& version);
     void Compact();
-    int GetLargestLSMLevel();
+    void RunCompaction(const CompactionTask& task);
+    std::shared_ptr<SstFile> MoveSstFile(const SstFile& file, int level);
+    void StartCompactions();
+    void StopCompactions();
+    void ScheduleCompactions();
+    void RunBackgroundCompaction(const CompactionTask& task,
+                                 const std::set<int>& levels);
+    bool PickRunnableCompaction(CompactionTask& task, std::set<int>& levels);
+    void StallWrites();
+    // Scan the SST files of a version with one task per level. pairs holds
+    // the memtable pairs of the range, which take precedence. Returns every
+    // key once, in key order.
+    std::vector<std::pair<int, int>> ScanLevelsInParallel(
+        int key1, int key2, const std::shared_ptr<const Version>& version,
+        std::vector<std::pair<int, int>> pairs);
+    // Scan files of one level, given from the newest to the oldest
+    std::vector<std::pair<int, int>> ScanLevel(
+        int key1, int key2, const Version& version,
+        const std::vector<std::shared_ptr<SstFile>>& files);
+    void StartReads();
+    void StopReads();
+    void ScheduleReads();
+    void ServeQueuedReads();
+    void ServeGets(std::vector<AsyncGet>& gets);
+    void ServeScan(AsyncScan& scan);
 
    public:
     Database(const std::string& name, size_t memtableSize,
              bool use_binary_search = false);
+    Database(const std::string& name, const DatabaseOptions& options);
+    // Cache pages in a buffer pool shared with other databases. Its hits and
+    // misses are not counted in the stats of this database.
+    Database(const std::string& name, const DatabaseOptions& options,
+             std::shared_ptr<BufferPool> buffer_pool);
+    ~Database();
     void Open();
     void Close();
     void Put(int key, int value);
     int Get(int key);
+    int Get(int key, const Snapshot& snapshot);
+    // Get a batch of keys. Returns the value of each key in the same order,
+    // or -1 for keys that are not found.
+    std::vector<int> MultiGet(const std::vector<int>& keys);
+    std::vector<int> MultiGet(const std::vector<int>& keys,
+                              const Snapshot& snapshot);
     void Delete(int key);
+    // The pairs of the keys in [key1, key2], each key once and in key order
     std::vector<std::pair<int, int>> Scan(int key1, int key2);
+    std::vector<std::pair<int, int>> Scan(int key1, int key2,
+                                          const Snapshot& snapshot);
+    // Queue a Get or Scan for the read tasks and return without waiting for
+    // it. The future gets the result, or the exception the read threw.
+    // Many Gets may be in flight at once; the ones a task picks up together
+    // share their page reads like a MultiGet.
+    std::future<int> GetAsync(int key);
+    std::future<std::vector<std::pair<int, int>>> ScanAsync(int key1,
+                                                            int key2);
+    // Take a snapshot of the current state. Writes do not wait for it.
+    std::shared_ptr<const Snapshot> GetSnapshot();
+    // Counters of the work done since the database was created.
+    DatabaseStats GetStats();
+    // Block until no flush or compaction is running or due. Rethrows the
+    // error of a failed background flush or compaction.
+    void WaitForCompactions();
 };
 
 #endif
@@ -0,0 +1,238 @@
+#include "io_engine.h"
+
+#include <fcntl.h>   // For open
+#include <unistd.h>  // For close, pread
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>  // For posix_memalign
+#include <cstring>  // For memcpy
+#include <stdexcept>
+
+#include "../config.h"
+
+#ifdef __linux__
+#include "io_uring_engine.h"
+#endif
+
+int
+OpenUncached(const std::string &filename, int flags, bool direct_io,
+             bool *is_direct)
+{
+    if (is_direct != nullptr)
+    {
+        *is_direct = false;
+    }
+#ifdef O_DIRECT
+    if (direct_io)
+    {
+        int fd = open(filename.c_str(), flags | O_DIRECT, 0666);
+        if (fd >= 0 || errno != EINVAL)
+        {
+            if (is_direct != nullptr)
+            {
+                *is_direct = fd >= 0;
+            }
+            return fd;
+        }
+        // The file system does not support O_DIRECT, as with tmpfs
+    }
+#endif
+
+    int fd = open(filename.c_str(), flags, 0666);
+    if (fd < 0)
+    {
+        return fd;
+    }
+    #ifdef __APPLE__
+        // macOS-specific code for disabling caching
+        fcntl(fd, F_NOCACHE, 1);
+    #elif defined(__linux__)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    #endif
+    return fd;
+}
+
+IoFile::IoFile(IoEngine &engine, const std::string &filename, int fd,
+               int fixed_index, bool direct)
+    : engine_(engine),
+      filename_(filename),
+      fd_(fd),
+      fixed_index_(fixed_index),
+      direct_(direct)
+{
+}
+
+IoFile::~IoFile()
+{
+    if (fixed_index_ >= 0)
+    {
+        engine_.UnregisterFile(fixed_index_);
+    }
+    close(fd_);
+}
+
+const std::string &
+IoFile::GetFilename() const
+{
+    return filename_;
+}
+
+int
+IoFile::GetFd() const
+{
+    return fd_;
+}
+
+int
+IoFile::GetFixedIndex() const
+{
+    return fixed_index_;
+}
+
+IoEngine &
+IoFile::GetEngine() const
+{
+    return engine_;
+}
+
+bool
+IoFile::IsDirect() const
+{
+    return direct_;
+}
+
+ssize_t
+IoFile::Read(void *buffer, size_t size, off_t offset) const
+{
+    bool aligned = reinterpret_cast<uintptr_t>(buffer) % PAGE_SIZE == 0 &&
+                   size % PAGE_SIZE == 0 && offset % PAGE_SIZE == 0;
+    if (!direct_ || aligned)
+    {
+        std::vector<IoRequest> requests = {{this, buffer, size, offset}};
+        engine_.Read(requests);
+        return requests[0].result;
+    }
+
+    // Read the whole pages around the range into an aligned buffer, and
+    // copy out the part that was asked for
+    off_t aligned_offset = offset / PAGE_SIZE * PAGE_SIZE;
+    size_t aligned_size = (static_cast<size_t>(offset - aligned_offset) +
+                           size + PAGE_SIZE - 1) /
+                          PAGE_SIZE * PAGE_SIZE;
+    void *aligned_buffer;
+    if (posix_memalign(&aligned_buffer, PAGE_SIZE, aligned_size) != 0)
+    {
+        return -1;
+    }
+    std::vector<IoRequest> requests = {
+        {this, aligned_buffer, aligned_size, aligned_offset}};
+    engine_.Read(requests);
+    ssize_t result = requests[0].result;
+    if (result >= 0)
+    {
+        size_t skipped = static_cast<size_t>(offset - aligned_offset);
+        result = std::min<ssize_t>(
+            size, std::max<ssize_t>(0, result - static_cast<ssize_t>(skipped)));
+        std::memcpy(buffer, static_cast<char *>(aligned_buffer) + skipped,
+                    result);
+    }
+    free(aligned_buffer);
+    return result;
+}
+
+std::unique_ptr<IoEngine>
+IoEngine::Create(IoEngineType type, int queue_depth, bool direct_io)
+{
+    std::unique_ptr<IoEngine> engine;
+#ifdef __linux__
+    if (type == IoEngineType::IO_URING && IoUringEngine::IsSupported())
+    {
+        engine = std::make_unique<IoUringEngine>(queue_depth);
+    }
+#endif
+    if (!engine)
+    {
+        engine = std::make_unique<PreadIoEngine>();
+    }
+    engine->direct_io_ = direct_io;
+    return engine;
+}
+
+IoEngine &
+IoEngine::Default()
+{
+    static PreadIoEngine engine;
+    return engine;
+}
+
+std::shared_ptr<IoFile>
+IoEngine::OpenFile(const std::string &filename, bool register_file)
+{
+    bool direct;
+    int fd = OpenUncached(filename, O_RDONLY, direct_io_, &direct);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open B-tree file: " + filename);
+    }
+
+    int fixed_index = register_file ? RegisterFile(fd) : -1;
+    return std::shared_ptr<IoFile>(
+        new IoFile(*this, filename, fd, fixed_index, direct));
+}
+
+bool
+IoEngine::UsesDirectIo() const
+{
+    return direct_io_;
+}
+
+int
+IoEngine::RegisterFile(int)
+{
+    return -1;
+}
+
+void
+IoEngine::UnregisterFile(int)
+{
+}
+
+void
+PreadIoEngine::Read(std::vector<IoRequest> &requests)
+{
+    for (IoRequest &request : requests)
+    {
+        // A large pread may return less than asked for
+        char *data = static_cast<char *>(request.buffer);
+        ssize_t total = 0;
+        while (static_cast<size_t>(total) < request.size)
+        {
+            ssize_t bytes_read = pread(request.file->GetFd(), data + total,
+                                       request.size - total,
+                                       request.offset + total);
+            if (bytes_read < 0 && errno == EINTR)
+            {
+                // Interrupted by a signal before reading anything
+                continue;
+            }
+            if (bytes_read <= 0)
+            {
+                if (bytes_read < 0)
+                {
+                    total = -1;
+                }
+                break;
+            }
+            total += bytes_read;
+        }
+        request.result = total;
+    }
+}
+
+IoEngineType
+PreadIoEngine::GetType() const
+{
+    return IoEngineType::PREAD;
+}
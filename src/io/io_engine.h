@@ -0,0 +1,130 @@
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// How SST pages are read from disk.
+enum class IoEngineType
+{
+    PREAD,     // one synchronous pread at a time
+    IO_URING,  // batches of reads in flight at once, Linux only
+};
+
+class IoEngine;
+
+// Open a file without letting the kernel cache its pages. With direct_io the
+// file is opened with O_DIRECT where the file system supports it, and then
+// every read and write must use PAGE_SIZE aligned buffers, offsets and
+// sizes. Otherwise, or where O_DIRECT is not supported, the kernel is asked
+// to drop the pages it caches. *is_direct tells which one happened. Returns
+// -1 like open if the file cannot be opened.
+int OpenUncached(const std::string& filename, int flags, bool direct_io,
+                 bool* is_direct = nullptr);
+
+/** A file opened for reading through an IoEngine.
+ *
+ *  The file stays open until the last pointer to it is dropped, so a reader
+ *  opens it once instead of around every read. Files opened with
+ *  register_file are also entered in the engine's registered file table,
+ *  which saves io_uring a file lookup per read. A file opened by an engine
+ *  that uses direct I/O bypasses the kernel page cache.
+ */
+class IoFile
+{
+   public:
+    ~IoFile();
+
+    IoFile(const IoFile&) = delete;
+    IoFile& operator=(const IoFile&) = delete;
+
+    const std::string& GetFilename() const;
+    int GetFd() const;
+    // Index in the registered file table, or -1 if the file is not in it.
+    int GetFixedIndex() const;
+    IoEngine& GetEngine() const;
+    // Whether the file was opened with O_DIRECT
+    bool IsDirect() const;
+
+    // Read up to size bytes at offset. Returns the number of bytes read,
+    // which is less than size only at the end of the file, or -1 on error.
+    // Unlike a batch, this read may be unaligned on a direct file.
+    ssize_t Read(void* buffer, size_t size, off_t offset) const;
+
+   private:
+    friend class IoEngine;
+    IoFile(IoEngine& engine, const std::string& filename, int fd,
+           int fixed_index, bool direct);
+
+    IoEngine& engine_;
+    std::string filename_;
+    int fd_;
+    int fixed_index_;
+    bool direct_;
+};
+
+// One read of a batch. result is set to the number of bytes read, which is
+// less than size only at the end of the file, or to -1 on error. On a direct
+// file, the buffer, size and offset must be PAGE_SIZE aligned.
+struct IoRequest
+{
+    const IoFile* file;
+    void* buffer;
+    size_t size;
+    off_t offset;
+    ssize_t result = 0;
+};
+
+/** Reads byte ranges of files, one at a time or many at once.
+ *
+ *  All engines are safe to use from several threads. Read blocks until
+ *  every request of the batch is complete; engines that can keep several
+ *  reads in flight do so up to their queue depth, so a batch of page reads
+ *  costs about one device round trip instead of one per page.
+ */
+class IoEngine
+{
+   public:
+    virtual ~IoEngine() = default;
+
+    // Create an engine of the given type. If the kernel does not support
+    // io_uring, a pread engine is returned instead. With direct_io, the
+    // files it opens bypass the kernel page cache where possible.
+    static std::unique_ptr<IoEngine> Create(IoEngineType type,
+                                            int queue_depth,
+                                            bool direct_io = false);
+    // A pread engine shared by code that is not given one.
+    static IoEngine& Default();
+
+    // Open a file for reading. Throws std::runtime_error if it cannot be
+    // opened.
+    std::shared_ptr<IoFile> OpenFile(const std::string& filename,
+                                     bool register_file = false);
+
+    virtual void Read(std::vector<IoRequest>& requests) = 0;
+    virtual IoEngineType GetType() const = 0;
+    bool UsesDirectIo() const;
+
+   protected:
+    bool direct_io_ = false;
+
+    friend class IoFile;
+    // Enter an open file in the registered file table. Returns its index,
+    // or -1 if the engine has no table or it is full.
+    virtual int RegisterFile(int fd);
+    virtual void UnregisterFile(int fixed_index);
+};
+
+/** Engine that reads each request with synchronous preads, in order. */
+class PreadIoEngine : public IoEngine
+{
+   public:
+    void Read(std::vector<IoRequest>& requests) override;
+    IoEngineType GetType() const override;
+};
+
+#endif
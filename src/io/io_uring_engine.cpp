@@ -0,0 +1,469 @@
+#ifdef __linux__
+
+#include "io_uring_engine.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>     // For mmap, munmap
+#include <sys/syscall.h>  // For the io_uring system call numbers
+#include <unistd.h>       // For close, syscall
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+
+#include "../config.h"
+
+namespace
+{
+
+int
+IoUringSetup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int
+IoUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete,
+             unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                    min_complete, flags, nullptr, 0));
+}
+
+int
+IoUringRegister(int ring_fd, unsigned opcode, const void *arg,
+                unsigned nr_args)
+{
+    return static_cast<int>(
+        syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+// The ring indices are shared with the kernel
+unsigned
+LoadAcquire(const unsigned *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void
+StoreRelease(unsigned *p, unsigned value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+}  // namespace
+
+// One io_uring instance and its mappings of the shared rings
+struct IoUringEngine::Ring
+{
+    int fd = -1;
+    void *sq_ptr = MAP_FAILED;
+    size_t sq_size = 0;
+    void *cq_ptr = MAP_FAILED;
+    size_t cq_size = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqes_size = 0;
+
+    unsigned *sq_tail = nullptr;
+    unsigned sq_mask = 0;
+    unsigned *sq_array = nullptr;
+    unsigned *cq_head = nullptr;
+    unsigned *cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    // The version of every slot of the registered file table as this ring
+    // last saw it. Empty if the kernel refused to register files, then plain
+    // fds are used.
+    std::vector<uint64_t> slot_versions;
+    uint64_t registered_files_version = 0;
+
+    explicit Ring(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd = IoUringSetup(entries, &params);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to set up io_uring: " +
+                                     std::string(std::strerror(errno)));
+        }
+
+        sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size =
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+        {
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        }
+        sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED)
+        {
+            Unmap();
+            throw std::runtime_error("Failed to map io_uring submissions");
+        }
+        if (!single_mmap)
+        {
+            cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED)
+            {
+                Unmap();
+                throw std::runtime_error(
+                    "Failed to map io_uring completions");
+            }
+        }
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(
+            mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED)
+        {
+            Unmap();
+            throw std::runtime_error("Failed to map io_uring entries");
+        }
+
+        char *sq = static_cast<char *>(sq_ptr);
+        char *cq = static_cast<char *>(single_mmap ? sq_ptr : cq_ptr);
+        sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        // Register an empty table, the slots are filled as files are opened
+        std::vector<int> files(MAX_REGISTERED_FILES, -1);
+        if (IoUringRegister(fd, IORING_REGISTER_FILES, files.data(),
+                            files.size()) == 0)
+        {
+            slot_versions.assign(files.size(), 0);
+        }
+    }
+
+    ~Ring() { Unmap(); }
+
+    void Unmap()
+    {
+        if (sqes != MAP_FAILED)
+        {
+            munmap(sqes, sqes_size);
+        }
+        if (cq_ptr != MAP_FAILED)
+        {
+            munmap(cq_ptr, cq_size);
+        }
+        if (sq_ptr != MAP_FAILED)
+        {
+            munmap(sq_ptr, sq_size);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    // Queue a read of what is left of a request
+    void PrepareRead(const IoRequest &request, size_t done, uint64_t tag)
+    {
+        // Only this thread moves the tail, the kernel moves the head
+        unsigned tail = *sq_tail;
+        unsigned index = tail & sq_mask;
+        io_uring_sqe *sqe = &sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        int fixed_index = request.file->GetFixedIndex();
+        if (fixed_index >= 0 && !slot_versions.empty())
+        {
+            sqe->fd = fixed_index;
+            sqe->flags = IOSQE_FIXED_FILE;
+        }
+        else
+        {
+            sqe->fd = request.file->GetFd();
+        }
+        sqe->addr = reinterpret_cast<uint64_t>(
+            static_cast<char *>(request.buffer) + done);
+        sqe->len = static_cast<uint32_t>(request.size - done);
+        sqe->off = static_cast<uint64_t>(request.offset + done);
+        sqe->user_data = tag;
+        sq_array[index] = index;
+        StoreRelease(sq_tail, tail + 1);
+    }
+
+    bool HasCompletions() const
+    {
+        return *cq_head != LoadAcquire(cq_tail);
+    }
+};
+
+IoUringEngine::IoUringEngine(int queue_depth)
+    : queue_depth_(static_cast<unsigned>(std::clamp(queue_depth, 1, 4096))),
+      registered_files_(MAX_REGISTERED_FILES, -1),
+      slot_versions_(MAX_REGISTERED_FILES, 0),
+      registered_files_version_(0)
+{
+    for (int slot = MAX_REGISTERED_FILES - 1; slot >= 0; slot--)
+    {
+        free_slots_.push_back(slot);
+    }
+    // Set up the first ring now so that a failure is reported here
+    idle_rings_.push_back(std::make_unique<Ring>(queue_depth_));
+}
+
+IoUringEngine::~IoUringEngine() = default;
+
+bool
+IoUringEngine::IsSupported()
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int fd = IoUringSetup(1, &params);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // IORING_OP_READ is missing from kernels before 5.6
+    const unsigned num_ops = IORING_OP_READ + 1;
+    std::vector<char> buffer(sizeof(io_uring_probe) +
+                             num_ops * sizeof(io_uring_probe_op));
+    io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+    bool supported =
+        IoUringRegister(fd, IORING_REGISTER_PROBE, probe, num_ops) == 0 &&
+        probe->last_op >= IORING_OP_READ &&
+        (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    close(fd);
+    return supported;
+}
+
+void
+IoUringEngine::Read(std::vector<IoRequest> &requests)
+{
+    if (requests.empty())
+    {
+        return;
+    }
+    std::unique_ptr<Ring> ring = AcquireRing();
+
+    std::vector<size_t> done(requests.size(), 0);
+    std::deque<size_t> resubmit;  // short or interrupted reads
+    size_t next = 0;
+    unsigned queued = 0;     // in the submission ring, not yet submitted
+    unsigned in_flight = 0;  // submitted, not yet completed
+
+    auto reap_completions = [&]()
+    {
+        unsigned head = *ring->cq_head;
+        unsigned tail = LoadAcquire(ring->cq_tail);
+        for (; head != tail; head++)
+        {
+            const io_uring_cqe &cqe = ring->cqes[head & ring->cq_mask];
+            size_t i = static_cast<size_t>(cqe.user_data);
+            int res = cqe.res;
+            in_flight--;
+            if (res == -EAGAIN || res == -EINTR)
+            {
+                resubmit.push_back(i);
+            }
+            else if (res < 0)
+            {
+                requests[i].result = -1;
+            }
+            else if (res == 0)
+            {
+                // End of the file
+                requests[i].result = static_cast<ssize_t>(done[i]);
+            }
+            else
+            {
+                done[i] += res;
+                if (done[i] < requests[i].size)
+                {
+                    resubmit.push_back(i);
+                }
+                else
+                {
+                    requests[i].result = static_cast<ssize_t>(done[i]);
+                }
+            }
+        }
+        StoreRelease(ring->cq_head, head);
+    };
+
+    while (next < requests.size() || !resubmit.empty() || queued > 0 ||
+           in_flight > 0)
+    {
+        // Fill the submission ring up to the queue depth
+        while (queued + in_flight < queue_depth_ &&
+               (!resubmit.empty() || next < requests.size()))
+        {
+            size_t i;
+            if (!resubmit.empty())
+            {
+                i = resubmit.front();
+                resubmit.pop_front();
+            }
+            else
+            {
+                i = next++;
+                if (requests[i].size == 0)
+                {
+                    requests[i].result = 0;
+                    continue;
+                }
+            }
+            ring->PrepareRead(requests[i], done[i], i);
+            queued++;
+        }
+
+        // Submit what is queued, and only wait in the kernel if no
+        // completion is ready to be reaped
+        bool wait = in_flight + queued > 0 && !ring->HasCompletions();
+        if (queued > 0 || wait)
+        {
+            int ret = IoUringEnter(ring->fd, queued, wait ? 1 : 0,
+                                   wait ? IORING_ENTER_GETEVENTS : 0);
+            if (ret < 0)
+            {
+                if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                {
+                    std::string error = std::strerror(errno);
+                    // The kernel may still write into the buffers of the
+                    // reads in flight, so wait for them before the caller
+                    // can free the buffers. Give up only if the ring cannot
+                    // even wait.
+                    while (in_flight > 0)
+                    {
+                        if (!ring->HasCompletions() &&
+                            IoUringEnter(ring->fd, 0, 1,
+                                         IORING_ENTER_GETEVENTS) < 0 &&
+                            errno != EINTR && errno != EAGAIN &&
+                            errno != EBUSY)
+                        {
+                            break;
+                        }
+                        reap_completions();
+                    }
+                    // The ring is left in an unknown state, drop it
+                    throw std::runtime_error("io_uring_enter failed: " +
+                                             error);
+                }
+                ret = 0;
+            }
+            queued -= ret;
+            in_flight += ret;
+        }
+
+        reap_completions();
+    }
+
+    ReleaseRing(std::move(ring));
+}
+
+IoEngineType
+IoUringEngine::GetType() const
+{
+    return IoEngineType::IO_URING;
+}
+
+int
+IoUringEngine::RegisterFile(int fd)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_slots_.empty())
+    {
+        return -1;
+    }
+    int slot = free_slots_.back();
+    free_slots_.pop_back();
+    registered_files_[slot] = fd;
+    slot_versions_[slot]++;
+    registered_files_version_++;
+    return slot;
+}
+
+void
+IoUringEngine::UnregisterFile(int fixed_index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    registered_files_[fixed_index] = -1;
+    slot_versions_[fixed_index]++;
+    free_slots_.push_back(fixed_index);
+    registered_files_version_++;
+
+    // A registered file stays open until every ring drops it, so update the
+    // idle rings now. Rings in use catch up when they are next taken.
+    for (std::unique_ptr<Ring> &ring : idle_rings_)
+    {
+        SyncRegisteredFiles(*ring);
+    }
+}
+
+std::unique_ptr<IoUringEngine::Ring>
+IoUringEngine::AcquireRing()
+{
+    std::unique_ptr<Ring> ring;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_rings_.empty())
+        {
+            ring = std::move(idle_rings_.back());
+            idle_rings_.pop_back();
+            SyncRegisteredFiles(*ring);
+            return ring;
+        }
+    }
+
+    // Every ring is in use by another thread, set up one more
+    ring = std::make_unique<Ring>(queue_depth_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    SyncRegisteredFiles(*ring);
+    return ring;
+}
+
+void
+IoUringEngine::ReleaseRing(std::unique_ptr<Ring> ring)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_rings_.push_back(std::move(ring));
+}
+
+void
+IoUringEngine::SyncRegisteredFiles(Ring &ring)
+{
+    if (ring.slot_versions.empty() ||
+        ring.registered_files_version == registered_files_version_)
+    {
+        return;
+    }
+    for (size_t slot = 0; slot < registered_files_.size(); slot++)
+    {
+        if (ring.slot_versions[slot] == slot_versions_[slot])
+        {
+            continue;
+        }
+        io_uring_files_update update;
+        std::memset(&update, 0, sizeof(update));
+        update.offset = static_cast<uint32_t>(slot);
+        update.fds = reinterpret_cast<uint64_t>(&registered_files_[slot]);
+        if (IoUringRegister(ring.fd, IORING_REGISTER_FILES_UPDATE, &update,
+                            1) != 1)
+        {
+            // Stop using the table on this ring rather than read the wrong
+            // file
+            IoUringRegister(ring.fd, IORING_UNREGISTER_FILES, nullptr, 0);
+            ring.slot_versions.clear();
+            return;
+        }
+        ring.slot_versions[slot] = slot_versions_[slot];
+    }
+    ring.registered_files_version = registered_files_version_;
+}
+
+#endif  // __linux__
@@ -0,0 +1,65 @@
+#ifndef IO_URING_ENGINE_H
+#define IO_URING_ENGINE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "io_engine.h"
+
+/** Engine that reads through io_uring.
+ *
+ *  A batch is submitted to a submission ring with a single system call and
+ *  up to queue_depth reads are kept in flight. Completions are reaped from
+ *  the completion ring in user space, and the engine only enters the kernel
+ *  to wait when none are ready. Short reads are resubmitted for the rest.
+ *
+ *  A ring must not be used by two threads at once, so the engine keeps a
+ *  pool of rings and each Read takes one for the length of the batch. Files
+ *  opened with register_file are entered in a table of MAX_REGISTERED_FILES
+ *  slots that is registered with every ring, so reads of them skip the
+ *  kernel's file lookup.
+ */
+class IoUringEngine : public IoEngine
+{
+   public:
+    // Throws std::runtime_error if the ring cannot be set up
+    explicit IoUringEngine(int queue_depth);
+    ~IoUringEngine() override;
+
+    // Whether the kernel can set up a ring and read through it
+    static bool IsSupported();
+
+    void Read(std::vector<IoRequest>& requests) override;
+    IoEngineType GetType() const override;
+
+   protected:
+    int RegisterFile(int fd) override;
+    void UnregisterFile(int fixed_index) override;
+
+   private:
+    struct Ring;
+
+    unsigned queue_depth_;
+
+    // Guards the idle rings and the registered file table
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Ring>> idle_rings_;
+    // The fd in every slot of the registered file table, -1 if free. Each
+    // change of a slot bumps its version and the table's, and rings catch up
+    // when they are taken. A slot is compared by version rather than by fd,
+    // since a closed fd number may be reused by the next file in the slot.
+    std::vector<int> registered_files_;
+    std::vector<uint64_t> slot_versions_;
+    std::vector<int> free_slots_;
+    uint64_t registered_files_version_;
+
+    std::unique_ptr<Ring> AcquireRing();
+    void ReleaseRing(std::unique_ptr<Ring> ring);
+    // Bring the files registered with a ring up to date with the table.
+    // Must hold mutex_.
+    void SyncRegisteredFiles(Ring& ring);
+};
+
+#endif
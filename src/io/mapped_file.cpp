@@ -0,0 +1,102 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>     // For open
+#include <sys/mman.h>  // For mmap, madvise, munmap
+#include <sys/stat.h>  // For fstat
+#include <unistd.h>    // For close
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "../config.h"
+
+MappedFile::MappedFile(const std::string &filename, std::byte *data,
+                       size_t size)
+    : filename_(filename), data_(data), size_(size)
+{
+}
+
+std::shared_ptr<MappedFile>
+MappedFile::Open(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open B-tree file: " + filename);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Failed to stat B-tree file: " + filename);
+    }
+
+    // An empty file cannot be mapped, and has no pages to read anyway
+    size_t size = file_stat.st_size;
+    std::byte *data = nullptr;
+    if (size > 0)
+    {
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to map B-tree file: " +
+                                     filename);
+        }
+        madvise(mapping, size, MADV_RANDOM);
+        data = static_cast<std::byte *>(mapping);
+    }
+    // The mapping keeps the file open
+    close(fd);
+    return std::shared_ptr<MappedFile>(new MappedFile(filename, data, size));
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != nullptr)
+    {
+        munmap(data_, size_);
+    }
+}
+
+const std::string &
+MappedFile::GetFilename() const
+{
+    return filename_;
+}
+
+size_t
+MappedFile::GetSize() const
+{
+    return size_;
+}
+
+int
+MappedFile::GetNumPages() const
+{
+    return static_cast<int>(size_ / PAGE_SIZE);
+}
+
+std::shared_ptr<std::byte>
+MappedFile::GetPage(int page_id)
+{
+    if (page_id < 0 || page_id >= GetNumPages())
+    {
+        return nullptr;
+    }
+    return std::shared_ptr<std::byte>(
+        shared_from_this(), data_ + static_cast<size_t>(page_id) * PAGE_SIZE);
+}
+
+void
+MappedFile::WillNeed(int first_page_id, int num_pages) const
+{
+    int end_page_id = std::min(first_page_id + num_pages, GetNumPages());
+    if (first_page_id < 0 || first_page_id >= end_page_id)
+    {
+        return;
+    }
+    madvise(data_ + static_cast<size_t>(first_page_id) * PAGE_SIZE,
+            static_cast<size_t>(end_page_id - first_page_id) * PAGE_SIZE,
+            MADV_WILLNEED);
+}
@@ -0,0 +1,45 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/** A whole SST file mapped read-only into memory.
+ *
+ *  Pages are read in place in the mapping, so a lookup that hits the kernel
+ *  page cache costs no system call and no copy. The mapping is advised for
+ *  random access, since lookups touch a few pages each, and scans ask for
+ *  the pages they are about to read with WillNeed. It stays valid until the
+ *  last pointer to it is dropped, even after the file is deleted.
+ */
+class MappedFile : public std::enable_shared_from_this<MappedFile>
+{
+   public:
+    // Map a file. Throws std::runtime_error if it cannot be opened or
+    // mapped.
+    static std::shared_ptr<MappedFile> Open(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::string& GetFilename() const;
+    size_t GetSize() const;
+    // Number of whole pages in the file
+    int GetNumPages() const;
+    // The start of a page in the mapping, sharing ownership of the mapping,
+    // or nullptr if the page is past the end of the file.
+    std::shared_ptr<std::byte> GetPage(int page_id);
+    // Ask the kernel to read pages that are about to be used.
+    void WillNeed(int first_page_id, int num_pages) const;
+
+   private:
+    MappedFile(const std::string& filename, std::byte* data, size_t size);
+
+    std::string filename_;
+    std::byte* data_;
+    size_t size_;
+};
+
+#endif
@@ -239,6 +239,92 @@ Part3Experiment()
         "\nPart 3 experiment complete. Results written to part3_results.csv\n");
 }
 
+void
+MmapExperiment()
+{
+    // Compare Gets through the buffer pool with Gets that read the pages in
+    // place in memory-mapped files, for data sizes that fit in memory. Both
+    // databases hold the same data, and the Gets are repeated so that the
+    // pages are cached by the buffer pool or the kernel.
+
+    std::filesystem::remove_all("buffer_pool_db");
+    std::filesystem::remove_all("mmap_db");
+    DatabaseOptions mmap_options;
+    mmap_options.use_mmap_reads = true;
+    Database buffer_pool_db("buffer_pool_db", DatabaseOptions());
+    Database mmap_db("mmap_db", mmap_options);
+    buffer_pool_db.Open();
+    mmap_db.Open();
+
+    std::vector<double> buffer_pool_throughputs;
+    std::vector<double> mmap_throughputs;
+    int current_data_mb = 0;
+    int total_size_mb = 256;
+    int num_gets = 100000;
+
+    printf("Beginning mmap experiment.\n");
+    for (int next_record_mb = 1; next_record_mb <= total_size_mb;
+         next_record_mb *= 2)
+    {
+        int num_pairs = (next_record_mb - current_data_mb) * 1000000 / 8;
+        for (int j = 0; j < num_pairs; j++)
+        {
+            int random_key = rand() % (next_record_mb * 1000000 / 8);
+            int random_value = rand();
+            buffer_pool_db.Put(random_key, random_value);
+            mmap_db.Put(random_key, random_value);
+        }
+        current_data_mb = next_record_mb;
+        buffer_pool_db.WaitForCompactions();
+        mmap_db.WaitForCompactions();
+
+        std::vector<int> keys;
+        for (int j = 0; j < num_gets; j++)
+        {
+            keys.push_back(rand() % (next_record_mb * 1000000 / 8));
+        }
+        std::chrono::duration<double> elapsed[2];
+        Database *databases[2] = {&buffer_pool_db, &mmap_db};
+        for (int i = 0; i < 2; i++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int key : keys)
+            {
+                databases[i]->Get(key);
+            }
+            elapsed[i] = std::chrono::high_resolution_clock::now() - start;
+        }
+
+        // ((8 bytes/pair * num_gets pairs) / 1MB) / time
+        double buffer_pool_throughput =
+            ((8.0 * num_gets) / 1000000) / elapsed[0].count();
+        double mmap_throughput =
+            ((8.0 * num_gets) / 1000000) / elapsed[1].count();
+        printf("\n%d MB. Buffer pool GET Throughput: %f MB/s", next_record_mb,
+               buffer_pool_throughput);
+        printf("\n%d MB. Mmap GET Throughput: %f MB/s", next_record_mb,
+               mmap_throughput);
+        buffer_pool_throughputs.push_back(buffer_pool_throughput);
+        mmap_throughputs.push_back(mmap_throughput);
+    }
+
+    std::ofstream file("mmap_results.csv");
+    file << "data_size_mb,buffer_pool_throughput,mmap_throughput\n";
+    for (size_t i = 0; i < buffer_pool_throughputs.size(); i++)
+    {
+        int size_mb = 1 << i;  // Powers of 2 (1MB, 2MB, 4MB, ...)
+        file << size_mb << "," << buffer_pool_throughputs[i] << ","
+             << mmap_throughputs[i] << "\n";
+    }
+
+    file.close();
+    buffer_pool_db.Close();
+    mmap_db.Close();
+
+    printf(
+        "\nMmap experiment complete. Results written to mmap_results.csv\n");
+}
+
 // Helper function to measure time for a task
 template <typename Func>
 void MeasureTime(const std::string &taskName, Func &&task) {
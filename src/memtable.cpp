@@ -1,54 +1,145 @@
 #include "memtable.h"
 
+#include <algorithm>
+
 #include "config.h"
 
 Memtable::Memtable(int memtable_size) : max_size_(memtable_size / 8) {}
 
 /* Insert a KV pair into the memtable. */
 void
-Memtable::Put(int key, int value)
+Memtable::Put(int key, int value, uint64_t sequence,
+              uint64_t snapshot_sequence)
 {
-    t.insert(key, value);
+    // Keep the replaced value if a snapshot can still see it
+    if (snapshot_sequence > 0)
+    {
+        uint64_t old_sequence;
+        int old_value = t.search(key, &old_sequence);
+        if (old_value != -1 && old_sequence <= snapshot_sequence)
+        {
+            history_[key].push_back({old_sequence, old_value});
+        }
+    }
+
+    t.insert(key, value, sequence);
+    max_sequence_ = std::max(max_sequence_, sequence);
 }
 
 /* Search for a value associated with the given key in the Memtable. */
 int
-Memtable::Get(int key)
+Memtable::Get(int key) const
 {
     return t.search(key);
 }
 
+/* Search for the value the key had after the write with the given sequence
+   number. */
+int
+Memtable::Get(int key, uint64_t sequence) const
+{
+    uint64_t entry_sequence;
+    int value = t.search(key, &entry_sequence);
+    if (value == -1 || entry_sequence <= sequence)
+    {
+        return value;
+    }
+    return GetOlderValue(key, sequence);
+}
+
+int
+Memtable::GetOlderValue(int key, uint64_t sequence) const
+{
+    auto versions = history_.find(key);
+    if (versions == history_.end())
+    {
+        return -1;
+    }
+    for (auto it = versions->second.rbegin(); it != versions->second.rend();
+         ++it)
+    {
+        if (it->first <= sequence)
+        {
+            return it->second;
+        }
+    }
+    return -1;
+}
+
 /* Delete a KV pair from the Memtable. */
 void
-Memtable::Delete(int key)
+Memtable::Delete(int key, uint64_t sequence, uint64_t snapshot_sequence)
 {
-    t.insert(key, INT_MAX);
+    Put(key, INT_MAX, sequence, snapshot_sequence);
 }
 
 /* Get the current number of Memtable entries. */
 int
-Memtable::GetSize()
+Memtable::GetSize() const
 {
     return t.GetSize();
 }
 
 /* Get the key-value pairs within the specified range. */
 std::vector<std::pair<int, int>>
-Memtable::Scan(int key1, int key2)
+Memtable::Scan(int key1, int key2) const
 {
     return t.scan(key1, key2);
 }
 
+/* Get the key-value pairs within the specified range as they were after the
+   write with the given sequence number. */
+std::vector<std::pair<int, int>>
+Memtable::Scan(int key1, int key2, uint64_t sequence) const
+{
+    std::vector<uint64_t> sequences;
+    std::vector<std::pair<int, int>> entries = t.scan(key1, key2, &sequences);
+    std::vector<std::pair<int, int>> result;
+    result.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (sequences[i] <= sequence)
+        {
+            result.push_back(entries[i]);
+            continue;
+        }
+
+        // Written after the snapshot, look for the value it replaced
+        int value = GetOlderValue(entries[i].first, sequence);
+        if (value != -1)
+        {
+            result.push_back({entries[i].first, value});
+        }
+    }
+    return result;
+}
+
+/* Visit every entry in ascending key order. */
+void
+Memtable::ForEach(const std::function<void(int, int)>& callback) const
+{
+    t.forEach(callback);
+}
+
 /* Check if the Memtable is full. */
 bool
-Memtable::IsFull()
+Memtable::IsFull() const
 {
     return t.GetSize() >= max_size_;
 }
 
+/* Get the largest sequence number of the entries. */
+uint64_t
+Memtable::GetMaxSequence() const
+{
+    return max_sequence_;
+}
+
 /* Clear the Memtable. */
 void
 Memtable::Clear()
 {
     t.clear();
+    history_.clear();
+    max_sequence_ = 0;
 }
@@ -1,30 +1,60 @@
 #ifndef MEMTABLE_H
 #define MEMTABLE_H
 
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "avl_tree.h"
 
+/** In-memory table of the newest writes.
+ *
+ *  Every entry carries the sequence number of the write that stored it.
+ *  When a write replaces a value that a snapshot can still read, the old
+ *  value is kept aside so that reads at the snapshot's sequence number find
+ *  it. Flushes only write the newest values.
+ */
 class Memtable
 {
    private:
     AVLTree t;
     // The maximum amount of key-value pairs that can be stored in the Memtable.
     int max_size_;
+    // Replaced values kept for snapshots, (sequence, value) oldest first
+    std::unordered_map<int, std::vector<std::pair<uint64_t, int>>> history_;
+    uint64_t max_sequence_ = 0;
+
+    // The newest replaced value written at or before sequence, or -1.
+    int GetOlderValue(int key, uint64_t sequence) const;
 
    public:
     Memtable();
     explicit Memtable(int memtable_size);
 
-    void Put(int key, int value);
-    int Get(int key);
-    std::vector<std::pair<int, int>> Scan(int key1, int key2);
+    // Store the value with the sequence number of its write. The value it
+    // replaces is kept if it is visible at snapshot_sequence, the sequence
+    // number of the newest live snapshot (0 if there is none).
+    void Put(int key, int value, uint64_t sequence = 0,
+             uint64_t snapshot_sequence = 0);
+    int Get(int key) const;
+    // The newest value written at or before sequence, or -1 if the memtable
+    // held no value for the key at that point.
+    int Get(int key, uint64_t sequence) const;
+    std::vector<std::pair<int, int>> Scan(int key1, int key2) const;
+    std::vector<std::pair<int, int>> Scan(int key1, int key2,
+                                          uint64_t sequence) const;
+    // Visit every entry in ascending key order.
+    void ForEach(const std::function<void(int, int)>& callback) const;
 
-    int GetSize();
-    bool IsFull();
+    int GetSize() const;
+    bool IsFull() const;
+    // The largest sequence number of the entries, 0 if there are none.
+    uint64_t GetMaxSequence() const;
     void Clear();
-    void Delete(int key);
+    void Delete(int key, uint64_t sequence = 0,
+                uint64_t snapshot_sequence = 0);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "compaction/compaction_policy.h"
+#include "config.h"
+#include "io/io_engine.h"
+#include "scheduler/task_scheduler.h"
+
+// Tunable settings for a Database instance. Defaults match the behaviour of
+// the original Database(name, memtable_size) constructor.
+struct DatabaseOptions
+{
+    size_t memtable_size = MEMTABLE_SIZE;
+
+    // Search SST files by binary searching the leaf pages instead of walking
+    // the internal nodes of the B-tree.
+    bool use_binary_search = false;
+
+    // Build a small Bloom filter for every leaf page of an SST, so a Get can
+    // skip the leaf read when the key cannot be in that page.
+    bool use_leaf_filters = false;
+
+    // Write leaf pages with bit-packed key deltas and values, so that as many
+    // pairs as fit are stored in each page.
+    bool compress_leaf_pages = false;
+
+    // How SST files are merged, and how much larger each level is than the
+    // one above it. Tiering with a ratio of 2 merges two files of the same
+    // level into the next one.
+    CompactionStyle compaction_style = CompactionStyle::TIERING;
+    int size_ratio = 2;
+
+    // Split the output of a compaction into SST files of at most this many
+    // entries, with disjoint key ranges. 0 writes one file per compaction.
+    uint64_t sst_partition_entries = 0;
+
+    // Split large compactions into up to this many key ranges that are
+    // merged in parallel.
+    int max_subcompactions = 1;
+
+    // Number of compactions that run in the background at the same time.
+    // Flushes then run in the background too. With 0, a flush writes its
+    // file and compacts before the write that triggered it returns, as the
+    // original constructor did.
+    int background_compaction_threads = 0;
+
+    // Limit the disk bandwidth of compactions to this many bytes per second
+    // read and written. 0 does not limit it.
+    uint64_t compaction_bytes_per_second = 0;
+
+    // Stall flushes while level 0 holds this many files and compactions are
+    // still catching up.
+    int level0_stall_files = 8;
+
+    // How pages of SST files are read. IO_URING keeps the reads of a
+    // MultiGet or compaction chunk in flight together, up to io_queue_depth
+    // at a time, and falls back to PREAD if the kernel does not support it.
+    IoEngineType io_engine = IoEngineType::PREAD;
+    int io_queue_depth = 32;
+
+    // Read and write SST pages with O_DIRECT, so that they are cached only
+    // in the buffer pool and not also in the kernel page cache. File systems
+    // without O_DIRECT support fall back to buffered I/O.
+    bool use_direct_io = false;
+
+    // Map every SST file into memory and search its pages in place instead
+    // of reading them into the buffer pool. Cheapest when the files fit in
+    // memory. Compactions still read their inputs with the I/O engine.
+    bool use_mmap_reads = false;
+
+    // Number of tasks that serve GetAsync and ScanAsync at the same time. The
+    // Gets that queue up while the tasks are busy are served together as one
+    // MultiGet. With 0, the async calls read before they return.
+    int async_read_threads = 1;
+
+    // Scan the SST levels in parallel, one task per level, when a Scan
+    // covers at least this many keys. The results of the levels are merged
+    // in key order, newest first. 0 scans the files one after another.
+    int parallel_scan_min_keys = 0;
+
+    // Runs the flushes, compactions and parallel reads. Databases that share
+    // a scheduler share its threads, and the limits above bound how many of
+    // them one database uses. nullptr uses TaskScheduler::Default().
+    TaskScheduler* scheduler = nullptr;
+};
+
+#endif
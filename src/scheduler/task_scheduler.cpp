@@ -0,0 +1,239 @@
+#include "task_scheduler.h"
+
+#include <algorithm>
+
+namespace
+{
+// The scheduler and index of the worker running on this thread
+thread_local const TaskScheduler* current_scheduler = nullptr;
+thread_local int current_worker = -1;
+}  // namespace
+
+TaskScheduler::TaskScheduler(int num_threads) : num_queued_(0), stop_(false)
+{
+    num_threads = std::max(1, num_threads);
+    for (int i = 0; i < num_threads; i++)
+    {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < num_threads; i++)
+    {
+        threads_.emplace_back(&TaskScheduler::WorkerLoop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+TaskScheduler&
+TaskScheduler::Default()
+{
+    static TaskScheduler scheduler(
+        std::max(2u, std::thread::hardware_concurrency()));
+    return scheduler;
+}
+
+void
+TaskScheduler::Submit(TaskPriority priority, std::function<void()> task)
+{
+    int p = static_cast<int>(priority);
+    if (IsWorkerThread())
+    {
+        Worker& worker = *workers_[current_worker];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks[p].push_back(std::move(task));
+        num_queued_++;
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shared_tasks_[p].push_back(std::move(task));
+        num_queued_++;
+    }
+
+    // Taking the lock orders the count before a sleeping worker checks it
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    cv_.notify_one();
+}
+
+int
+TaskScheduler::GetNumThreads() const
+{
+    return threads_.size();
+}
+
+bool
+TaskScheduler::IsWorkerThread() const
+{
+    return current_scheduler == this;
+}
+
+bool
+TaskScheduler::RunOneTask()
+{
+    std::function<void()> task;
+    if (!TakeTask(task))
+    {
+        return false;
+    }
+    task();
+    return true;
+}
+
+bool
+TaskScheduler::TakeTask(std::function<void()>& task)
+{
+    if (num_queued_ == 0)
+    {
+        return false;
+    }
+
+    int self = current_worker;
+    int num_workers = workers_.size();
+    for (int p = 0; p < kNumPriorities; p++)
+    {
+        // The newest task of this worker
+        if (self >= 0)
+        {
+            Worker& worker = *workers_[self];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.tasks[p].empty())
+            {
+                task = std::move(worker.tasks[p].back());
+                worker.tasks[p].pop_back();
+                num_queued_--;
+                return true;
+            }
+        }
+
+        // The oldest task submitted from outside the pool
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!shared_tasks_[p].empty())
+            {
+                task = std::move(shared_tasks_[p].front());
+                shared_tasks_[p].pop_front();
+                num_queued_--;
+                return true;
+            }
+        }
+
+        // The oldest task of another worker
+        for (int i = 1; i <= num_workers; i++)
+        {
+            int victim = (std::max(self, 0) + i) % num_workers;
+            if (victim == self)
+            {
+                continue;
+            }
+            Worker& worker = *workers_[victim];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (!worker.tasks[p].empty())
+            {
+                task = std::move(worker.tasks[p].front());
+                worker.tasks[p].pop_front();
+                num_queued_--;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void
+TaskScheduler::WorkerLoop(int index)
+{
+    current_scheduler = this;
+    current_worker = index;
+    while (true)
+    {
+        if (RunOneTask())
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || num_queued_ > 0; });
+        if (stop_ && num_queued_ == 0)
+        {
+            return;
+        }
+    }
+}
+
+TaskGroup::TaskGroup(TaskScheduler& scheduler, TaskPriority priority)
+    : scheduler_(scheduler), priority_(priority), num_unfinished_(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    Wait();
+}
+
+void
+TaskGroup::Submit(std::function<void()> function)
+{
+    auto task = std::make_shared<Task>();
+    task->function = std::move(function);
+    tasks_.push_back(task);
+    {
+        std::lock_guard<std::mutex> lock(scheduler_.mutex_);
+        num_unfinished_++;
+    }
+
+    // If the waiting thread claimed the task first, the worker only drops
+    // it. The group outlives every task that a worker runs.
+    scheduler_.Submit(priority_,
+                      [this, task]()
+                      {
+                          if (!task->claimed.exchange(true))
+                          {
+                              task->function();
+                              Finish();
+                          }
+                      });
+}
+
+void
+TaskGroup::Wait()
+{
+    // The newest tasks first, as workers steal the oldest
+    for (auto it = tasks_.rbegin(); it != tasks_.rend(); ++it)
+    {
+        Task& task = **it;
+        if (!task.claimed.exchange(true))
+        {
+            task.function();
+            Finish();
+        }
+    }
+    tasks_.clear();
+
+    std::unique_lock<std::mutex> lock(scheduler_.mutex_);
+    scheduler_.done_cv_.wait(lock, [this] { return num_unfinished_ == 0; });
+}
+
+void
+TaskGroup::Finish()
+{
+    // The waiter may destroy the group as soon as the count reaches zero
+    TaskScheduler& scheduler = scheduler_;
+    {
+        std::lock_guard<std::mutex> lock(scheduler.mutex_);
+        num_unfinished_--;
+    }
+    scheduler.done_cv_.notify_all();
+}
@@ -0,0 +1,140 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// What a task is for. A free worker always runs the most urgent task it can
+// find, so reads never queue behind flushes, nor flushes behind compactions.
+// Lower values are more urgent.
+enum class TaskPriority
+{
+    READ,        // foreground reads, such as parallel scans and async Gets
+    FLUSH,       // memtable flushes and their filter builds
+    COMPACTION,  // compactions and subcompactions
+};
+
+/** Work-stealing thread pool shared by the databases of a process.
+ *
+ *  Every worker has one deque per priority. A task submitted by a worker
+ *  goes to the back of that worker's deque and is taken from the back by
+ *  the same worker, which keeps related work on one core. Tasks submitted
+ *  from other threads go to a shared queue. A worker with nothing of its own
+ *  takes from the shared queue and then steals from the front of the other
+ *  workers' deques, always trying the higher priorities first.
+ *
+ *  A task that needs the results of subtasks submits them through a
+ *  TaskGroup and waits for the group.
+ */
+class TaskScheduler
+{
+   public:
+    explicit TaskScheduler(int num_threads);
+    // Runs the queued tasks before the workers stop.
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // The scheduler shared by every database that is not given one, with a
+    // worker per core.
+    static TaskScheduler& Default();
+
+    // The task must not throw.
+    void Submit(TaskPriority priority, std::function<void()> task);
+
+    int GetNumThreads() const;
+
+   private:
+    friend class TaskGroup;
+    static constexpr int kNumPriorities = 3;
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks[kNumPriorities];
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    // Guards the shared queues, stop_ and the counts of unfinished group
+    // tasks. cv_ wakes idle workers, done_cv_ wakes the waiting groups.
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable done_cv_;
+    std::deque<std::function<void()>> shared_tasks_[kNumPriorities];
+    std::atomic<int> num_queued_;
+    bool stop_;
+
+    bool IsWorkerThread() const;
+    // Run the most urgent task this thread can find. Returns false if there
+    // is none.
+    bool RunOneTask();
+    bool TakeTask(std::function<void()>& task);
+    void WorkerLoop(int index);
+};
+
+/** The subtasks of one job, such as the level scans of a Scan or the key
+ *  ranges of a merge, submitted with one priority.
+ *
+ *  Wait runs the subtasks that no worker has started yet on the waiting
+ *  thread, then sleeps until the others finish. It never runs the tasks of
+ *  other jobs, so a waiting compaction does not take on a compaction of
+ *  another database while it holds its own levels. Only the thread that
+ *  owns the group submits to it and waits for it.
+ */
+class TaskGroup
+{
+   public:
+    TaskGroup(TaskScheduler& scheduler, TaskPriority priority);
+    // Waits for the tasks, which may use the state of the caller.
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // The task must not throw.
+    void Submit(std::function<void()> task);
+
+    // Submit a task and return a future for its result or exception.
+    template <typename F>
+    std::future<std::invoke_result_t<F>> Async(F&& f)
+    {
+        using Result = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(
+            std::forward<F>(f));
+        std::future<Result> future = task->get_future();
+        Submit([task]() { (*task)(); });
+        return future;
+    }
+
+    // Block until every task submitted so far has finished.
+    void Wait();
+
+   private:
+    // Run by whichever of a worker and the waiting thread claims it first
+    struct Task
+    {
+        std::function<void()> function;
+        std::atomic<bool> claimed{false};
+    };
+
+    TaskScheduler& scheduler_;
+    TaskPriority priority_;
+    std::vector<std::shared_ptr<Task>> tasks_;
+    int num_unfinished_;  // guarded by the scheduler's mutex_
+
+    void Finish();
+};
+
+#endif
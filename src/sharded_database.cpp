@@ -0,0 +1,217 @@
+#include "sharded_database.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "config.h"
+
+namespace
+{
+// Mix the bits of a key, so that keys with a common stride still spread
+// over all the shards
+uint32_t
+HashKey(int key)
+{
+    uint32_t h = static_cast<uint32_t>(key);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+}  // namespace
+
+ShardedDatabase::ShardedDatabase(const std::string& name,
+                                 const ShardedDatabaseOptions& options)
+    : name_(name),
+      scheme_(options.scheme),
+      range_boundaries_(options.range_boundaries),
+      buffer_pool_(std::make_shared<BufferPool>(MAX_BUFFER_POOL_SIZE))
+{
+    if (options.num_shards < 1)
+    {
+        throw std::invalid_argument("A sharded database needs a shard");
+    }
+    if (name_.back() == '/')
+    {
+        name_.pop_back();
+    }
+
+    if (scheme_ == ShardingScheme::RANGE)
+    {
+        if (range_boundaries_.empty())
+        {
+            // Equal parts of the int range
+            int64_t range_size =
+                (static_cast<int64_t>(INT_MAX) - INT_MIN + 1) /
+                options.num_shards;
+            for (int i = 1; i < options.num_shards; i++)
+            {
+                range_boundaries_.push_back(
+                    static_cast<int>(INT_MIN + i * range_size));
+            }
+        }
+        if (static_cast<int>(range_boundaries_.size()) !=
+                options.num_shards - 1 ||
+            !std::is_sorted(range_boundaries_.begin(),
+                            range_boundaries_.end()))
+        {
+            throw std::invalid_argument(
+                "Range boundaries must be num_shards - 1 ascending keys");
+        }
+    }
+
+    for (int i = 0; i < options.num_shards; i++)
+    {
+        std::stringstream shard_name;
+        shard_name << name_ << "/shard_" << std::setfill('0') << std::setw(4)
+                   << i;
+        shards_.push_back(std::make_unique<Database>(
+            shard_name.str(), options.shard_options, buffer_pool_));
+    }
+}
+
+void
+ShardedDatabase::Open()
+{
+    if (!std::filesystem::exists(name_))
+    {
+        std::filesystem::create_directory(name_);
+    }
+    for (auto& shard : shards_)
+    {
+        shard->Open();
+    }
+}
+
+void
+ShardedDatabase::Close()
+{
+    for (auto& shard : shards_)
+    {
+        shard->Close();
+    }
+}
+
+void
+ShardedDatabase::Put(int key, int value)
+{
+    shards_[GetShardIndex(key)]->Put(key, value);
+}
+
+int
+ShardedDatabase::Get(int key)
+{
+    return shards_[GetShardIndex(key)]->Get(key);
+}
+
+std::vector<int>
+ShardedDatabase::MultiGet(const std::vector<int>& keys)
+{
+    // Split the keys by shard, remembering where each came from
+    std::vector<std::vector<int>> shard_keys(shards_.size());
+    std::vector<std::vector<size_t>> shard_positions(shards_.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        int shard = GetShardIndex(keys[i]);
+        shard_keys[shard].push_back(keys[i]);
+        shard_positions[shard].push_back(i);
+    }
+
+    std::vector<int> values(keys.size(), -1);
+    for (size_t shard = 0; shard < shards_.size(); shard++)
+    {
+        if (shard_keys[shard].empty())
+        {
+            continue;
+        }
+        std::vector<int> shard_values =
+            shards_[shard]->MultiGet(shard_keys[shard]);
+        for (size_t i = 0; i < shard_values.size(); i++)
+        {
+            values[shard_positions[shard][i]] = shard_values[i];
+        }
+    }
+    return values;
+}
+
+void
+ShardedDatabase::Delete(int key)
+{
+    shards_[GetShardIndex(key)]->Delete(key);
+}
+
+std::vector<std::pair<int, int>>
+ShardedDatabase::Scan(int key1, int key2)
+{
+    std::vector<std::pair<int, int>> results;
+    if (scheme_ == ShardingScheme::HASH)
+    {
+        // Every shard may hold keys of the range
+        for (auto& shard : shards_)
+        {
+            std::vector<std::pair<int, int>> shard_results =
+                shard->Scan(key1, key2);
+            results.insert(results.end(), shard_results.begin(),
+                           shard_results.end());
+        }
+        std::sort(results.begin(), results.end());
+        return results;
+    }
+
+    // The shards that overlap the range hold consecutive key ranges, so
+    // their sorted results follow each other
+    if (key1 > key2)
+    {
+        return results;
+    }
+    for (int shard = GetShardIndex(key1); shard <= GetShardIndex(key2);
+         shard++)
+    {
+        std::vector<std::pair<int, int>> shard_results =
+            shards_[shard]->Scan(key1, key2);
+        std::sort(shard_results.begin(), shard_results.end());
+        results.insert(results.end(), shard_results.begin(),
+                       shard_results.end());
+    }
+    return results;
+}
+
+void
+ShardedDatabase::WaitForCompactions()
+{
+    for (auto& shard : shards_)
+    {
+        shard->WaitForCompactions();
+    }
+}
+
+int
+ShardedDatabase::GetNumShards() const
+{
+    return shards_.size();
+}
+
+int
+ShardedDatabase::GetShardIndex(int key) const
+{
+    if (scheme_ == ShardingScheme::HASH)
+    {
+        return HashKey(key) % shards_.size();
+    }
+    return std::upper_bound(range_boundaries_.begin(),
+                            range_boundaries_.end(), key) -
+           range_boundaries_.begin();
+}
+
+Database&
+ShardedDatabase::GetShard(int index)
+{
+    return *shards_[index];
+}
@@ -0,0 +1,73 @@
+#ifndef SHARDED_DATABASE_H
+#define SHARDED_DATABASE_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "buffer_pool/buffer_pool.h"
+#include "database.h"
+#include "options.h"
+
+// How keys are assigned to the shards of a ShardedDatabase.
+enum class ShardingScheme
+{
+    HASH,   // by a hash of the key, spreads any key pattern evenly
+    RANGE,  // by key range, so a Scan only visits the shards it overlaps
+};
+
+struct ShardedDatabaseOptions
+{
+    int num_shards = 4;
+    ShardingScheme scheme = ShardingScheme::HASH;
+    // For RANGE, the first key of every shard after the first, in ascending
+    // order. Empty splits the whole int range into equal parts.
+    std::vector<int> range_boundaries;
+    // The options of every shard.
+    DatabaseOptions shard_options;
+};
+
+/** A key-value store split into independent Database shards.
+ *
+ *  Every shard has its own memtable, SST files and compaction threads in a
+ *  subdirectory shard_NNNN of the database, so writes to different shards
+ *  never wait for each other and ingest scales with the number of cores.
+ *  The shards share one buffer pool of MAX_BUFFER_POOL_SIZE pages. Each
+ *  operation is routed to the shards that hold its keys. Safe to use from
+ *  several threads, like Database.
+ */
+class ShardedDatabase
+{
+   public:
+    ShardedDatabase(const std::string& name,
+                    const ShardedDatabaseOptions& options);
+
+    void Open();
+    void Close();
+    void Put(int key, int value);
+    int Get(int key);
+    // Get a batch of keys, one MultiGet per shard. Returns the value of each
+    // key in the same order, or -1 for keys that are not found.
+    std::vector<int> MultiGet(const std::vector<int>& keys);
+    void Delete(int key);
+    // The pairs of the range from every shard, in key order.
+    std::vector<std::pair<int, int>> Scan(int key1, int key2);
+    // Block until no shard has a compaction running or due.
+    void WaitForCompactions();
+
+    int GetNumShards() const;
+    // The shard that holds a key
+    int GetShardIndex(int key) const;
+    // A shard, for its stats and snapshots
+    Database& GetShard(int index);
+
+   private:
+    std::string name_;
+    ShardingScheme scheme_;
+    std::vector<int> range_boundaries_;
+    std::shared_ptr<BufferPool> buffer_pool_;
+    std::vector<std::unique_ptr<Database>> shards_;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "statistics.h"
+
+#include <algorithm>
+#include <sstream>
+
+void
+Statistics::Record(Ticker ticker, uint64_t count)
+{
+    ThreadStripe()
+        .tickers[static_cast<int>(ticker)]
+        .fetch_add(count, std::memory_order_relaxed);
+}
+
+void
+Statistics::RecordLevel(LevelTicker ticker, int level, uint64_t count)
+{
+    level = std::min(level, MAX_STATS_LEVELS - 1);
+    ThreadStripe()
+        .level_tickers[static_cast<int>(ticker)][level]
+        .fetch_add(count, std::memory_order_relaxed);
+}
+
+void
+Statistics::RecordCompactionMicros(uint64_t micros)
+{
+    Record(Ticker::COMPACTION_MICROS, micros);
+    uint64_t max_micros = max_compaction_micros_.load();
+    while (micros > max_micros &&
+           !max_compaction_micros_.compare_exchange_weak(max_micros, micros))
+    {
+    }
+}
+
+uint64_t
+Statistics::Get(Ticker ticker) const
+{
+    uint64_t total = 0;
+    for (const Stripe& stripe : stripes_)
+    {
+        total += stripe.tickers[static_cast<int>(ticker)].load(
+            std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t
+Statistics::GetLevel(LevelTicker ticker, int level) const
+{
+    uint64_t total = 0;
+    for (const Stripe& stripe : stripes_)
+    {
+        total += stripe.level_tickers[static_cast<int>(ticker)][level].load(
+            std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t
+Statistics::GetMaxCompactionMicros() const
+{
+    return max_compaction_micros_.load();
+}
+
+Statistics::Stripe&
+Statistics::ThreadStripe()
+{
+    // Threads take the stripes in turn the first time they count
+    static std::atomic<int> next_stripe{0};
+    thread_local int stripe = next_stripe.fetch_add(1) % STATS_STRIPES;
+    return stripes_[stripe];
+}
+
+std::string
+DatabaseStats::ToJson() const
+{
+    std::stringstream json;
+    json << "{\"user_bytes_written\": " << user_bytes_written
+         << ", \"flush_bytes_written\": " << flush_bytes_written
+         << ", \"compaction_bytes_read\": " << compaction_bytes_read
+         << ", \"compaction_bytes_written\": " << compaction_bytes_written
+         << ", \"write_amplification\": " << write_amplification
+         << ", \"gets\": " << gets << ", \"get_pages_read\": " << get_pages_read
+         << ", \"multiget_keys\": " << multiget_keys
+         << ", \"multiget_pages_read\": " << multiget_pages_read
+         << ", \"scans\": " << scans
+         << ", \"scan_pages_read\": " << scan_pages_read
+         << ", \"read_amplification\": " << read_amplification
+         << ", \"buffer_pool_hits\": " << buffer_pool_hits
+         << ", \"buffer_pool_misses\": " << buffer_pool_misses
+         << ", \"bloom_filter_negatives\": " << bloom_filter_negatives
+         << ", \"bloom_filter_true_positives\": " << bloom_filter_true_positives
+         << ", \"bloom_filter_false_positives\": "
+         << bloom_filter_false_positives
+         << ", \"bloom_filter_false_positive_rate\": "
+         << bloom_filter_false_positive_rate
+         << ", \"leaf_filter_negatives\": " << leaf_filter_negatives
+         << ", \"flushes\": " << flushes << ", \"compactions\": " << compactions
+         << ", \"trivial_moves\": " << trivial_moves
+         << ", \"compaction_micros\": " << compaction_micros
+         << ", \"max_compaction_micros\": " << max_compaction_micros
+         << ", \"levels\": [";
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        const LevelStats& level = levels[i];
+        json << (i > 0 ? ", " : "") << "{\"level\": " << level.level
+             << ", \"num_files\": " << level.num_files
+             << ", \"file_bytes\": " << level.file_bytes
+             << ", \"bytes_read\": " << level.bytes_read
+             << ", \"bytes_written\": " << level.bytes_written << "}";
+    }
+    json << "]}";
+    return json.str();
+}
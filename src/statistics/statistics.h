@@ -0,0 +1,129 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+static constexpr int MAX_STATS_LEVELS = 16;  // deeper levels count as the last
+static constexpr int STATS_STRIPES = 16;     // counter copies, one per thread
+
+// Database-wide event counters.
+enum class Ticker
+{
+    USER_BYTES_WRITTEN,  // keys and values of Puts and Deletes
+    GETS,
+    GET_PAGES_READ,  // pages read from disk by Gets
+    MULTIGET_KEYS,
+    MULTIGET_PAGES_READ,
+    SCANS,
+    SCAN_PAGES_READ,
+    BUFFER_POOL_HITS,
+    BUFFER_POOL_MISSES,
+    BLOOM_FILTER_NEGATIVES,        // the filter skipped the file
+    BLOOM_FILTER_TRUE_POSITIVES,   // the file held the key
+    BLOOM_FILTER_FALSE_POSITIVES,  // the file was searched for nothing
+    LEAF_FILTER_NEGATIVES,         // the leaf filter skipped the leaf read
+    FLUSHES,
+    COMPACTIONS,
+    TRIVIAL_MOVES,
+    COMPACTION_MICROS,
+    NUM_TICKERS
+};
+
+// Counters kept for every level.
+enum class LevelTicker
+{
+    BYTES_READ,     // compaction input read from the level
+    BYTES_WRITTEN,  // flush or compaction output written to the level
+    NUM_LEVEL_TICKERS
+};
+
+/** Cheap counters that any thread can bump.
+ *
+ *  Each thread adds to one of STATS_STRIPES copies of the counters, each on
+ *  its own cache lines, with relaxed atomic adds. Threads rarely share a
+ *  copy, so counting does not bounce cache lines between cores. Reading a
+ *  counter sums all the copies, which is only done on demand.
+ */
+class Statistics
+{
+   public:
+    void Record(Ticker ticker, uint64_t count = 1);
+    void RecordLevel(LevelTicker ticker, int level, uint64_t count);
+    void RecordCompactionMicros(uint64_t micros);
+
+    uint64_t Get(Ticker ticker) const;
+    uint64_t GetLevel(LevelTicker ticker, int level) const;
+    uint64_t GetMaxCompactionMicros() const;
+
+   private:
+    static constexpr int kNumTickers = static_cast<int>(Ticker::NUM_TICKERS);
+    static constexpr int kNumLevelTickers =
+        static_cast<int>(LevelTicker::NUM_LEVEL_TICKERS);
+
+    struct alignas(64) Stripe
+    {
+        std::atomic<uint64_t> tickers[kNumTickers] = {};
+        std::atomic<uint64_t> level_tickers[kNumLevelTickers]
+                                           [MAX_STATS_LEVELS] = {};
+    };
+
+    Stripe& ThreadStripe();
+
+    Stripe stripes_[STATS_STRIPES];
+    std::atomic<uint64_t> max_compaction_micros_{0};
+};
+
+// Counters and current size of one level.
+struct LevelStats
+{
+    int level = 0;
+    uint64_t num_files = 0;
+    uint64_t file_bytes = 0;
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+};
+
+// A snapshot of the statistics of a Database, with the derived ratios.
+struct DatabaseStats
+{
+    uint64_t user_bytes_written = 0;
+    uint64_t flush_bytes_written = 0;
+    uint64_t compaction_bytes_read = 0;
+    uint64_t compaction_bytes_written = 0;
+    // Bytes written to disk per byte written by the user
+    double write_amplification = 0;
+
+    uint64_t gets = 0;
+    uint64_t get_pages_read = 0;
+    uint64_t multiget_keys = 0;
+    uint64_t multiget_pages_read = 0;
+    uint64_t scans = 0;
+    uint64_t scan_pages_read = 0;
+    // Pages read from disk per lookup
+    double read_amplification = 0;
+
+    uint64_t buffer_pool_hits = 0;
+    uint64_t buffer_pool_misses = 0;
+    uint64_t bloom_filter_negatives = 0;
+    uint64_t bloom_filter_true_positives = 0;
+    uint64_t bloom_filter_false_positives = 0;
+    // Share of the files a filter let through that did not hold the key
+    double bloom_filter_false_positive_rate = 0;
+    uint64_t leaf_filter_negatives = 0;
+
+    uint64_t flushes = 0;
+    uint64_t compactions = 0;
+    uint64_t trivial_moves = 0;
+    uint64_t compaction_micros = 0;
+    uint64_t max_compaction_micros = 0;
+
+    std::vector<LevelStats> levels;
+
+    std::string ToJson() const;
+};
+
+#endif
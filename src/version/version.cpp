@@ -0,0 +1,105 @@
+#include "version.h"
+
+#include <algorithm>
+#include <filesystem>
+
+int
+GetSstLevel(const std::string& filename)
+{
+    // search for "sst_" and get the next 4 characters
+    return std::stoi(filename.substr(filename.find("sst_") + 4, 4));
+}
+
+SstFile::SstFile(const std::string& filename, const SstFooter& footer,
+                 const BloomFilter& bloom_filter)
+    : filename(filename),
+      level(GetSstLevel(filename)),
+      footer(footer),
+      bloom_filter(bloom_filter)
+{
+}
+
+SstFile::~SstFile()
+{
+    if (!obsolete)
+    {
+        return;
+    }
+
+    // Files written before the footer existed keep their leaf filters in a
+    // separate file. Errors are ignored, a leftover file is only wasted space.
+    std::error_code error;
+    std::filesystem::remove(filename, error);
+    std::filesystem::remove(filename + ".filter", error);
+    std::filesystem::remove(filename + ".leaf_filter", error);
+}
+
+bool
+IsOlderSst(const SstFile& a, const SstFile& b)
+{
+    if (a.level != b.level)
+    {
+        return a.level > b.level;
+    }
+    if (a.footer.max_sequence != b.footer.max_sequence)
+    {
+        return a.footer.max_sequence < b.footer.max_sequence;
+    }
+    return a.filename < b.filename;
+}
+
+const std::vector<std::shared_ptr<SstFile>>&
+Version::GetFiles() const
+{
+    return files_;
+}
+
+std::shared_ptr<SstFile>
+Version::FindFile(const std::string& filename) const
+{
+    for (const auto& file : files_)
+    {
+        if (file->filename == filename)
+        {
+            return file;
+        }
+    }
+    return nullptr;
+}
+
+int
+Version::GetLargestLevel() const
+{
+    return files_.empty() ? 0 : files_.front()->level;
+}
+
+std::shared_ptr<const Version>
+Version::Apply(const std::vector<std::string>& removed,
+               const std::vector<std::shared_ptr<SstFile>>& added) const
+{
+    auto version = std::make_shared<Version>();
+    version->files_.reserve(files_.size() + added.size());
+    for (const auto& file : files_)
+    {
+        if (std::find(removed.begin(), removed.end(), file->filename) !=
+            removed.end())
+        {
+            file->obsolete = true;
+            continue;
+        }
+        version->files_.push_back(file);
+    }
+
+    // add the new files in age order
+    for (const auto& file : added)
+    {
+        version->files_.insert(
+            std::upper_bound(version->files_.begin(), version->files_.end(),
+                             file,
+                             [](const std::shared_ptr<SstFile>& a,
+                                const std::shared_ptr<SstFile>& b)
+                             { return IsOlderSst(*a, *b); }),
+            file);
+    }
+    return version;
+}
@@ -0,0 +1,80 @@
+#ifndef VERSION_H
+#define VERSION_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../b_tree/sst_footer.h"
+#include "../bloom_filter/bloom_filter.h"
+#include "../bloom_filter/leaf_filter_block.h"
+#include "../io/io_engine.h"
+#include "../io/mapped_file.h"
+
+// The level of an SST file, from its name sst_LLLL_<timestamp>.sst. The
+// filename may include the path.
+int GetSstLevel(const std::string& filename);
+
+/** An SST file together with the footer and filters kept in memory for it.
+ *
+ *  Versions share the files they have in common. When a flush or compaction
+ *  installs a version without the file, the file is marked obsolete, and it
+ *  is deleted from disk with its filter files once the last version that
+ *  holds it is released. Reads that started before the compaction can keep
+ *  using it until then.
+ */
+struct SstFile
+{
+    SstFile(const std::string& filename, const SstFooter& footer,
+            const BloomFilter& bloom_filter);
+    ~SstFile();
+
+    std::string filename;
+    int level;
+    SstFooter footer;
+    BloomFilter bloom_filter;
+    bool has_leaf_filters = false;
+    LeafFilterBlock leaf_filter_block;
+    // Kept open for all the reads of the file
+    std::shared_ptr<IoFile> io_file;
+    // Set if the database reads its files through memory mappings
+    std::shared_ptr<MappedFile> mapped_file;
+
+    std::atomic<bool> obsolete{false};
+};
+
+// Higher levels hold older data. Within a level, the file with the smaller
+// largest sequence number is older. Files written before sequence numbers
+// existed are ordered by the timestamp in their filename.
+bool IsOlderSst(const SstFile& a, const SstFile& b);
+
+/** The SST files of the database at one point in time.
+ *
+ *  A version never changes once it is installed. Flushes and compactions
+ *  build a new version from the current one, so a reader that holds a
+ *  version sees a consistent set of files without taking any lock.
+ */
+class Version
+{
+   public:
+    Version() = default;
+
+    // The files from the oldest to the newest.
+    const std::vector<std::shared_ptr<SstFile>>& GetFiles() const;
+    // The file with the given name, or nullptr if it is not in this version.
+    std::shared_ptr<SstFile> FindFile(const std::string& filename) const;
+    // The level of the oldest file, or 0 if there are no files.
+    int GetLargestLevel() const;
+
+    // A copy of this version without the removed files and with the added
+    // ones, kept in age order. The removed files are marked obsolete.
+    std::shared_ptr<const Version> Apply(
+        const std::vector<std::string>& removed,
+        const std::vector<std::shared_ptr<SstFile>>& added) const;
+
+   private:
+    std::vector<std::shared_ptr<SstFile>> files_;
+};
+
+#endif
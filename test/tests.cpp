@@ -1,16 +1,38 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <set>
+#include <thread>
 
 #include "../src/avl_tree.h"
 #include "../src/b_tree/b_tree.h"
+#include "../src/b_tree/b_tree_builder.h"
 #include "../src/b_tree/b_tree_manager.h"
 #include "../src/b_tree/b_tree_page.h"
+#include "../src/b_tree/key_search.h"
+#include "../src/b_tree/leaf_compression.h"
+#include "../src/b_tree/merge_kernel.h"
+#include "../src/b_tree/sequential_page_reader.h"
+#include "../src/b_tree/sst_footer.h"
 #include "../src/buffer_pool/buffer_pool.h"
+#include "../src/compaction/rate_limiter.h"
 #include "../src/config.h"
 #include "../src/database.h"
+#include "../src/io/io_engine.h"
+#include "../src/io/mapped_file.h"
+#include "../src/scheduler/task_scheduler.h"
+#include "../src/sharded_database.h"
+#include "../src/version/version.h"
 
 /*
 
@@ -234,6 +256,875 @@ TestDatabaseScan(int &totalPassed, int &totalFailed)
     std::filesystem::remove_all("test_db");
 }
 
+void
+TestDatabaseMultiGet(int &totalPassed, int &totalFailed)
+{
+    printf("\n  MULTIGET\n");
+    Database db("test_db", MEMTABLE_SIZE);
+    db.Open();
+    int testsPassed = 0;
+    int testsFailed = 0;
+
+    // Spread the data over a merged SST, a level 0 SST and the memtable
+    for (int i = 0; i < 400000; i++)
+    {
+        db.Put(i, i * 10);
+    }
+    db.Delete(7);
+    db.Put(8, 1);
+
+    std::vector<int> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.push_back(rand() % 500000);
+    }
+    keys.push_back(7);
+    keys.push_back(8);
+    keys.push_back(8);
+    keys.push_back(-5);
+
+    auto values = db.MultiGet(keys);
+    AssertEqual(keys.size(), values.size(), "MultiGet returns every key",
+                testsPassed, testsFailed);
+
+    int mismatches = 0;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (values[i] != db.Get(keys[i]))
+        {
+            mismatches++;
+        }
+    }
+    AssertEqual(0, mismatches, "MultiGet matches Get for every key",
+                testsPassed, testsFailed);
+    AssertEqual(-1, values[1000], "MultiGet of a deleted key", testsPassed,
+                testsFailed);
+    AssertEqual(1, values[1002], "MultiGet of a duplicate updated key",
+                testsPassed, testsFailed);
+
+    db.Close();
+    totalPassed += testsPassed;
+    totalFailed += testsFailed;
+
+    std::filesystem::remove_all("test_db");
+}
+
+void
+TestCompactionPolicies(int &totalPassed, int &totalFailed)
+{
+    printf("\n  COMPACTION POLICIES\n");
+    CompactionTask task;
+
+    // Tiering merges the runs of a full level into the next level
+    auto tiering = CompactionPolicy::Create(CompactionStyle::TIERING, 3, 1000);
+    std::vector<SstFileInfo> files = {{"sst_0001_1", 1, 3000, "1", 0, 2999},
+                                      {"sst_0000_2", 0, 1000, "2", 0, 999},
+                                      {"sst_0000_3", 0, 1000, "3", 0, 999}};
+    AssertEqual(0, tiering->PickCompaction(files, task),
+                "Tiering waits for a full level", totalPassed, totalFailed);
+    files.push_back({"sst_0000_4", 0, 1000, "4", 0, 999});
+    tiering->PickCompaction(files, task);
+    AssertEqual(3, task.inputs.size(), "Tiering merges a full level",
+                totalPassed, totalFailed);
+    AssertEqual(1, task.inputs.front() == "sst_0000_4", "Newest input first",
+                totalPassed, totalFailed);
+    AssertEqual(1, task.output_level, "Tiering output level", totalPassed,
+                totalFailed);
+    AssertEqual(0, task.drop_tombstones, "Keep tombstones above older runs",
+                totalPassed, totalFailed);
+
+    // Lazy leveling merges into the single run of the last level
+    auto lazy =
+        CompactionPolicy::Create(CompactionStyle::LAZY_LEVELING, 3, 1000);
+    lazy->PickCompaction(files, task);
+    AssertEqual(4, task.inputs.size(), "Lazy leveling merges the last level",
+                totalPassed, totalFailed);
+    AssertEqual(1, task.output_level, "Lazy leveling output level",
+                totalPassed, totalFailed);
+    AssertEqual(1, task.drop_tombstones, "Drop tombstones on the last level",
+                totalPassed, totalFailed);
+
+    // Leveling merges level 0 with the overlapping files of level 1
+    auto leveling =
+        CompactionPolicy::Create(CompactionStyle::LEVELING, 2, 1000);
+    files = {{"sst_0001_1_0000", 1, 1000, "1", 0, 999},
+             {"sst_0001_1_0001", 1, 1000, "1", 1000, 1999},
+             {"sst_0000_2", 0, 1000, "2", 0, 999},
+             {"sst_0000_3", 0, 1000, "3", 500, 800}};
+    leveling->PickCompaction(files, task);
+    AssertEqual(3, task.inputs.size(), "Leveling merges overlapping files",
+                totalPassed, totalFailed);
+    AssertEqual(1, task.inputs.back() == "sst_0001_1_0000",
+                "Leveling skips disjoint files", totalPassed, totalFailed);
+    AssertEqual(1, task.output_level, "Leveling output level", totalPassed,
+                totalFailed);
+
+    // A full level pushes its oldest file down. Nothing on level 2 overlaps
+    // it, so it is moved instead of merged.
+    files = {{"sst_0002_1", 2, 1000, "1", 5000, 5999},
+             {"sst_0001_2_0000", 1, 1000, "2", 0, 999},
+             {"sst_0001_2_0001", 1, 1000, "2", 1000, 1999},
+             {"sst_0001_2_0002", 1, 1000, "2", 2000, 2999}};
+    leveling->PickCompaction(files, task);
+    AssertEqual(1, task.trivial_move, "Move a disjoint file", totalPassed,
+                totalFailed);
+    AssertEqual(1,
+                task.inputs.size() == 1 && task.inputs[0] == files[1].filename,
+                "Move the first file of the level", totalPassed, totalFailed);
+    AssertEqual(2, task.output_level, "Move to the next level", totalPassed,
+                totalFailed);
+
+    // The level furthest past its limit is merged first
+    files.push_back({"sst_0000_3", 0, 1000, "3", 0, 999});
+    files.push_back({"sst_0000_4", 0, 1000, "4", 0, 999});
+    std::vector<CompactionTask> tasks = leveling->PickCompactions(files);
+    AssertEqual(2, tasks.size(), "One merge per full level", totalPassed,
+                totalFailed);
+    AssertEqual(2, tasks[0].output_level, "Highest score first", totalPassed,
+                totalFailed);
+
+    // Every policy keeps the database readable
+    for (auto style : {CompactionStyle::LEVELING, CompactionStyle::TIERING,
+                       CompactionStyle::LAZY_LEVELING})
+    {
+        DatabaseOptions options;
+        options.memtable_size = 8 * 1000;
+        options.compaction_style = style;
+        options.size_ratio = 3;
+        Database db("test_db_policy", options);
+        db.Open();
+        for (int i = 0; i < 20000; i++)
+        {
+            db.Put(i % 7000, i);
+        }
+        for (int i = 0; i < 7000; i += 10)
+        {
+            db.Delete(i);
+        }
+        db.Close();
+
+        // Reopen to read the files back in age order
+        Database reopened_db("test_db_policy", options);
+        reopened_db.Open();
+        bool all_correct = true;
+        for (int i = 1; i < 7000; i += 3)
+        {
+            int expected = i % 10 == 0 ? -1 : i + 14000 - (i >= 6000) * 7000;
+            all_correct &= reopened_db.Get(i) == expected;
+        }
+        AssertEqual(1, all_correct, "Get after compactions", totalPassed,
+                    totalFailed);
+        reopened_db.Close();
+        std::filesystem::remove_all("test_db_policy");
+    }
+}
+
+void
+TestBackgroundCompaction(int &totalPassed, int &totalFailed)
+{
+    printf("\n  BACKGROUND COMPACTION\n");
+    // The bucket starts full, then refills at the given rate
+    RateLimiter rate_limiter(1024 * 1024);
+    auto start = std::chrono::steady_clock::now();
+    rate_limiter.Request(1024 * 1024);
+    rate_limiter.Request(512 * 1024);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start);
+    AssertEqual(1, elapsed.count() >= 400 && elapsed.count() < 2000,
+                "Rate limiter waits for its tokens", totalPassed, totalFailed);
+
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.background_compaction_threads = 2;
+    options.level0_stall_files = 2;
+    options.compaction_bytes_per_second = 64 * 1024 * 1024;
+    Database db("test_db_background", options);
+    db.Open();
+
+    // Read while the merges run behind the writes
+    bool all_correct = true;
+    for (int i = 0; i < 50000; i++)
+    {
+        db.Put(i, i * 10);
+        if (i % 97 == 0)
+        {
+            all_correct &= db.Get(i / 2) == i / 2 * 10;
+        }
+    }
+    AssertEqual(1, all_correct, "Get during background compactions",
+                totalPassed, totalFailed);
+
+    db.WaitForCompactions();
+    int num_level_0_files = 0;
+    for (const auto &entry :
+         std::filesystem::directory_iterator("test_db_background"))
+    {
+        num_level_0_files += entry.path().extension() == ".sst" &&
+                             entry.path().string().find("sst_0000_") !=
+                                 std::string::npos;
+    }
+    AssertEqual(1, num_level_0_files < 2, "Level 0 is merged in the background",
+                totalPassed, totalFailed);
+    db.Close();
+
+    Database reopened_db("test_db_background", options);
+    reopened_db.Open();
+    all_correct = true;
+    for (int i = 0; i < 50000; i += 7)
+    {
+        all_correct &= reopened_db.Get(i) == i * 10;
+    }
+    AssertEqual(1, all_correct, "Get after background compactions",
+                totalPassed, totalFailed);
+    reopened_db.Close();
+    std::filesystem::remove_all("test_db_background");
+}
+
+void
+TestDatabaseStats(int &totalPassed, int &totalFailed)
+{
+    printf("\n  STATISTICS\n");
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.background_compaction_threads = 0;
+    Database db("test_db_stats", options);
+    db.Open();
+    for (int i = 0; i < 20000; i++)
+    {
+        db.Put(i * 100, i * 10);
+    }
+    // Keys between the written ones fall inside the key range of the files
+    for (int i = 0; i < 1000; i++)
+    {
+        db.Get(i * 2000);
+        db.Get(i * 2000 + 50);
+    }
+    db.Scan(0, 500);
+
+    DatabaseStats stats = db.GetStats();
+    AssertEqual(20000 * 2 * sizeof(int), stats.user_bytes_written,
+                "User bytes are counted", totalPassed, totalFailed);
+    AssertEqual(2000, stats.gets, "Gets are counted", totalPassed,
+                totalFailed);
+    AssertEqual(1, stats.scans, "Scans are counted", totalPassed, totalFailed);
+    AssertEqual(1, stats.flushes > 0 && stats.compactions > 0,
+                "Flushes and compactions are counted", totalPassed,
+                totalFailed);
+    AssertEqual(1, stats.write_amplification > 1.0,
+                "Compactions add to write amplification", totalPassed,
+                totalFailed);
+    AssertEqual(1, stats.get_pages_read > 0 && stats.read_amplification > 0,
+                "Pages read per lookup are counted", totalPassed, totalFailed);
+    AssertEqual(1,
+                stats.buffer_pool_hits + stats.buffer_pool_misses > 0 &&
+                    stats.bloom_filter_negatives > 0,
+                "Buffer pool and filter counters are recorded", totalPassed,
+                totalFailed);
+
+    uint64_t file_bytes = 0;
+    for (const auto &level : stats.levels)
+    {
+        file_bytes += level.file_bytes;
+    }
+    AssertEqual(1, file_bytes > 0, "Level sizes are reported", totalPassed,
+                totalFailed);
+
+    std::string json = stats.ToJson();
+    AssertEqual(1,
+                json.find("\"write_amplification\"") != std::string::npos &&
+                    json.find("\"levels\"") != std::string::npos,
+                "Statistics export as JSON", totalPassed, totalFailed);
+    db.Close();
+    std::filesystem::remove_all("test_db_stats");
+}
+
+void
+TestConcurrentReads(int &totalPassed, int &totalFailed)
+{
+    printf("\n  CONCURRENT READS\n");
+    // A replaced file stays on disk while an older version holds it
+    std::filesystem::create_directory("test_db_versions");
+    std::string filename = "test_db_versions/sst_0000_1.sst";
+    std::ofstream(filename) << "data";
+    auto file = std::make_shared<SstFile>(filename, SstFooter(),
+                                          BloomFilter(64));
+    std::shared_ptr<const Version> old_version =
+        std::make_shared<Version>()->Apply({}, {file});
+    file.reset();
+    std::shared_ptr<const Version> new_version =
+        old_version->Apply({filename}, {});
+    AssertEqual(1,
+                std::filesystem::exists(filename) &&
+                    new_version->GetFiles().empty(),
+                "Replaced file is kept for older versions", totalPassed,
+                totalFailed);
+    old_version.reset();
+    AssertEqual(0, std::filesystem::exists(filename),
+                "Replaced file is deleted with its last version", totalPassed,
+                totalFailed);
+    std::filesystem::remove_all("test_db_versions");
+
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.background_compaction_threads = 2;
+    Database db("test_db_concurrent", options);
+    db.Open();
+    for (int i = 0; i < 10000; i++)
+    {
+        db.Put(i, i * 10);
+    }
+
+    // Readers check the loaded keys while a writer flushes and the
+    // background threads compact
+    std::atomic<bool> writing{true};
+    std::atomic<int> wrong_reads{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++)
+    {
+        readers.emplace_back(
+            [&, t]()
+            {
+                for (int i = t; writing || i < 20000; i += 13)
+                {
+                    int key = i % 10000;
+                    wrong_reads += db.Get(key) != key * 10;
+                    if (i % 100 == t)
+                    {
+                        auto results = db.Scan(key, key + 9);
+                        wrong_reads += results.size() < 1;
+                    }
+                }
+            });
+    }
+    for (int i = 10000; i < 60000; i++)
+    {
+        db.Put(i, i * 10);
+    }
+    writing = false;
+    for (auto &reader : readers)
+    {
+        reader.join();
+    }
+    AssertEqual(0, wrong_reads, "Gets during flushes and compactions",
+                totalPassed, totalFailed);
+
+    db.WaitForCompactions();
+    bool all_correct = true;
+    for (int i = 0; i < 60000; i += 7)
+    {
+        all_correct &= db.Get(i) == i * 10;
+    }
+    AssertEqual(1, all_correct, "Get after concurrent reads", totalPassed,
+                totalFailed);
+    db.Close();
+    std::filesystem::remove_all("test_db_concurrent");
+}
+
+void
+TestSnapshots(int &totalPassed, int &totalFailed)
+{
+    printf("\n  SNAPSHOTS\n");
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.background_compaction_threads = 0;
+    Database db("test_db_snapshots", options);
+    db.Open();
+    for (int i = 0; i < 1000; i++)
+    {
+        db.Put(i, i);
+    }
+    std::shared_ptr<const Snapshot> snapshot = db.GetSnapshot();
+    AssertEqual(1000, snapshot->GetSequence(),
+                "Snapshot is at the last write", totalPassed, totalFailed);
+
+    // Overwrite and delete the keys in the memtable and, after flushes and
+    // compactions, in the SST files
+    for (int i = 0; i < 1000; i++)
+    {
+        db.Put(i, i * 10);
+    }
+    db.Delete(7);
+    for (int i = 1000; i < 20000; i++)
+    {
+        db.Put(i, i);
+    }
+    for (int i = 0; i < 1000; i += 2)
+    {
+        db.Put(i, i * 100);
+    }
+
+    bool all_correct = true;
+    for (int i = 0; i < 1000; i++)
+    {
+        all_correct &= db.Get(i, *snapshot) == i;
+        all_correct &= db.Get(i) == (i == 7 ? -1 : i * (i % 2 ? 10 : 100));
+    }
+    all_correct &= db.Get(5000, *snapshot) == -1 && db.Get(5000) == 5000;
+    AssertEqual(1, all_correct, "Get reads the snapshot", totalPassed,
+                totalFailed);
+
+    std::vector<int> values = db.MultiGet({3, 7, 5000}, *snapshot);
+    AssertEqual(1, values[0] == 3 && values[1] == 7 && values[2] == -1,
+                "MultiGet reads the snapshot", totalPassed, totalFailed);
+
+    auto results = db.Scan(0, 30000, *snapshot);
+    std::sort(results.begin(), results.end());
+    all_correct = results.size() == 1000;
+    for (size_t i = 0; all_correct && i < results.size(); i++)
+    {
+        all_correct &= results[i].first == static_cast<int>(i) &&
+                       results[i].second == static_cast<int>(i);
+    }
+    AssertEqual(1, all_correct, "Scan reads the snapshot", totalPassed,
+                totalFailed);
+
+    // The files the snapshot kept are deleted with it
+    auto count_sst_files = []()
+    {
+        int num_files = 0;
+        for (const auto &entry :
+             std::filesystem::directory_iterator("test_db_snapshots"))
+        {
+            num_files += entry.path().extension() == ".sst";
+        }
+        return num_files;
+    };
+    int num_files_with_snapshot = count_sst_files();
+    snapshot.reset();
+    AssertEqual(1, count_sst_files() < num_files_with_snapshot,
+                "Released snapshot frees its files", totalPassed, totalFailed);
+    db.Close();
+
+    // Sequence numbers continue after a reopen
+    Database reopened_db("test_db_snapshots", options);
+    reopened_db.Open();
+    AssertEqual(1000 + 1000 + 1 + 19000 + 500,
+                reopened_db.GetSnapshot()->GetSequence(),
+                "Sequence numbers survive a reopen", totalPassed,
+                totalFailed);
+    reopened_db.Put(7, 77);
+    AssertEqual(77, reopened_db.Get(7), "Get after reopen", totalPassed,
+                totalFailed);
+    reopened_db.Close();
+    std::filesystem::remove_all("test_db_snapshots");
+}
+
+void
+TestAsyncReads(int &totalPassed, int &totalFailed)
+{
+    printf("\n  ASYNC READS\n");
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.async_read_threads = 2;
+    Database db("test_db_async_reads", options);
+    db.Open();
+    for (int i = 0; i < 20000; i++)
+    {
+        db.Put(i, i * 5);
+    }
+    db.Delete(100);
+
+    // Keep many Gets in flight from one thread
+    std::vector<int> keys;
+    std::vector<std::future<int>> futures;
+    for (int key = -10; key < 20010; key += 3)
+    {
+        keys.push_back(key);
+        futures.push_back(db.GetAsync(key));
+    }
+    auto scan_future = db.ScanAsync(500, 599);
+    int wrong_values = 0;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        int key = keys[i];
+        int expected = key >= 0 && key < 20000 && key != 100 ? key * 5 : -1;
+        wrong_values += futures[i].get() != expected;
+    }
+    AssertEqual(0, wrong_values, "GetAsync returns the values", totalPassed,
+                totalFailed);
+    AssertEqual(1, db.GetStats().multiget_keys > 0,
+                "Queued Gets are served as a batch", totalPassed,
+                totalFailed);
+    AssertEqual(100, scan_future.get().size(), "ScanAsync returns the range",
+                totalPassed, totalFailed);
+
+    // Reads queued when the database closes are still served
+    std::future<int> last_get = db.GetAsync(42);
+    db.Close();
+    AssertEqual(210, last_get.get(), "Queued Get is served on Close",
+                totalPassed, totalFailed);
+
+    // Without read threads the async calls read right away
+    options.async_read_threads = 0;
+    Database sync_db("test_db_async_reads", options);
+    sync_db.Open();
+    std::future<int> ready = sync_db.GetAsync(7);
+    AssertEqual(1,
+                ready.wait_for(std::chrono::seconds(0)) ==
+                    std::future_status::ready,
+                "GetAsync without read threads is ready", totalPassed,
+                totalFailed);
+    AssertEqual(35, ready.get(), "GetAsync without read threads",
+                totalPassed, totalFailed);
+    sync_db.Close();
+    std::filesystem::remove_all("test_db_async_reads");
+}
+
+void
+TestParallelScan(int &totalPassed, int &totalFailed)
+{
+    printf("\n  PARALLEL SCAN\n");
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.background_compaction_threads = 0;
+    options.parallel_scan_min_keys = 100;
+    Database db("test_db_parallel_scan", options);
+    db.Open();
+    DatabaseOptions sequential_options = options;
+    sequential_options.parallel_scan_min_keys = 0;
+    Database sequential_db("test_db_sequential_scan", sequential_options);
+    sequential_db.Open();
+
+    // Spread versions of the keys over several levels and the memtable
+    std::map<int, int> expected;
+    for (int round = 0; round < 4; round++)
+    {
+        for (int i = round; i < 6000; i += round + 1)
+        {
+            db.Put(i, i * 10 + round);
+            sequential_db.Put(i, i * 10 + round);
+            expected[i] = i * 10 + round;
+        }
+    }
+    for (int i = 0; i < 6000; i += 11)
+    {
+        db.Delete(i);
+        sequential_db.Delete(i);
+        expected[i] = INT_MAX;
+    }
+
+    auto results = db.Scan(1000, 4999);
+    std::vector<std::pair<int, int>> expected_results(
+        expected.lower_bound(1000), expected.upper_bound(4999));
+    AssertEqual(1, results == expected_results,
+                "Parallel scan returns the newest pairs in key order",
+                totalPassed, totalFailed);
+    AssertEqual(1, results == sequential_db.Scan(1000, 4999),
+                "Sequential scan returns the same pairs", totalPassed,
+                totalFailed);
+
+    // A short range is scanned one file after another
+    AssertEqual(1,
+                db.Scan(1000, 1009) == std::vector<std::pair<int, int>>(
+                                           expected.lower_bound(1000),
+                                           expected.upper_bound(1009)),
+                "Short scan matches", totalPassed, totalFailed);
+    db.Close();
+    sequential_db.Close();
+    std::filesystem::remove_all("test_db_parallel_scan");
+    std::filesystem::remove_all("test_db_sequential_scan");
+}
+
+void
+TestShardedDatabase(int &totalPassed, int &totalFailed)
+{
+    printf("\n  SHARDED DATABASE\n");
+    for (ShardingScheme scheme : {ShardingScheme::HASH, ShardingScheme::RANGE})
+    {
+        printf("    %s sharding\n",
+               scheme == ShardingScheme::HASH ? "Hash" : "Range");
+        ShardedDatabaseOptions options;
+        options.num_shards = 4;
+        options.scheme = scheme;
+        if (scheme == ShardingScheme::RANGE)
+        {
+            options.range_boundaries = {10000, 20000, 30000};
+        }
+        options.shard_options.memtable_size = 8 * 1000;
+        ShardedDatabase db("test_db_sharded", options);
+        db.Open();
+
+        // Writers on several threads fill the shards at the same time
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; t++)
+        {
+            writers.emplace_back(
+                [&db, t]()
+                {
+                    for (int i = t; i < 40000; i += 4)
+                    {
+                        db.Put(i, i * 2);
+                    }
+                });
+        }
+        for (auto &writer : writers)
+        {
+            writer.join();
+        }
+        db.Delete(15000);
+
+        int keys_per_shard[4] = {};
+        for (int i = 0; i < 40000; i += 100)
+        {
+            keys_per_shard[db.GetShardIndex(i)]++;
+        }
+        AssertEqual(1,
+                    keys_per_shard[0] > 0 && keys_per_shard[1] > 0 &&
+                        keys_per_shard[2] > 0 && keys_per_shard[3] > 0,
+                    "Keys spread over every shard",
+                    totalPassed, totalFailed);
+
+        int wrong_gets = 0;
+        for (int i = 0; i < 40000; i += 7)
+        {
+            wrong_gets += db.Get(i) != (i == 15000 ? -1 : i * 2);
+        }
+        AssertEqual(0, wrong_gets, "Gets route to shards",
+                    totalPassed, totalFailed);
+        AssertEqual(1,
+                    db.MultiGet({35000, 5, 15000, 40000, 12345}) ==
+                        std::vector<int>{70000, 10, -1, -1, 24690},
+                    "MultiGet across shards",
+                    totalPassed, totalFailed);
+
+        auto results = db.Scan(9990, 20009);
+        bool all_correct = std::is_sorted(results.begin(), results.end());
+        int num_live = 0;
+        for (const auto &r : results)
+        {
+            all_correct &= r.first >= 9990 && r.first <= 20009;
+            num_live += r.second != INT_MAX;
+        }
+        AssertEqual(1, all_correct && num_live == 10019,
+                    "Scan across shards in key order",
+                    totalPassed, totalFailed);
+        db.Close();
+
+        // Each shard reopens from its own directory
+        ShardedDatabase reopened_db("test_db_sharded", options);
+        reopened_db.Open();
+        AssertEqual(39998, reopened_db.Get(19999),
+                    "Get after reopen", totalPassed,
+                    totalFailed);
+        reopened_db.Close();
+        std::filesystem::remove_all("test_db_sharded");
+    }
+
+    // Shards compact in the background at the same time, each writing its
+    // merge outputs into its own directory
+    ShardedDatabaseOptions options;
+    options.num_shards = 4;
+    options.shard_options.memtable_size = 8 * 1000;
+    options.shard_options.background_compaction_threads = 2;
+    options.shard_options.max_subcompactions = 2;
+    ShardedDatabase db("test_db_sharded_compactions", options);
+    db.Open();
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++)
+    {
+        writers.emplace_back(
+            [&db, t]()
+            {
+                for (int i = t; i < 80000; i += 4)
+                {
+                    db.Put(i, i * 3);
+                }
+            });
+    }
+
+    // No merge output ever appears in the working directory
+    std::atomic<bool> writing(true);
+    int stray_files = 0;
+    std::thread watcher(
+        [&writing, &stray_files]()
+        {
+            while (writing)
+            {
+                for (const auto &entry :
+                     std::filesystem::directory_iterator("."))
+                {
+                    stray_files += entry.path().extension() == ".sst";
+                }
+            }
+        });
+    for (auto &writer : writers)
+    {
+        writer.join();
+    }
+    db.WaitForCompactions();
+    writing = false;
+    watcher.join();
+
+    int wrong_gets = 0;
+    for (int i = 0; i < 80000; i += 13)
+    {
+        wrong_gets += db.Get(i) != i * 3;
+    }
+    AssertEqual(0, wrong_gets, "Gets after concurrent shard compactions",
+                totalPassed, totalFailed);
+    AssertEqual(0, stray_files, "Merges write into the shard directories",
+                totalPassed, totalFailed);
+    db.Close();
+    std::filesystem::remove_all("test_db_sharded_compactions");
+}
+
+// Run a task on a worker of the scheduler and return its future
+template <typename F>
+std::future<std::invoke_result_t<F>>
+RunOnWorker(TaskScheduler &scheduler, TaskPriority priority, F f)
+{
+    auto task =
+        std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(f);
+    auto future = task->get_future();
+    scheduler.Submit(priority, [task]() { (*task)(); });
+    return future;
+}
+
+void
+TestTaskScheduler(int &totalPassed, int &totalFailed)
+{
+    printf("\n  TASK SCHEDULER\n");
+    {
+        // Hold the only worker while tasks of every priority queue up
+        TaskScheduler scheduler(1);
+        std::promise<void> started;
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        scheduler.Submit(TaskPriority::COMPACTION,
+                         [&started, released]()
+                         {
+                             started.set_value();
+                             released.wait();
+                         });
+        started.get_future().wait();
+
+        int order = 0;
+        scheduler.Submit(TaskPriority::COMPACTION,
+                         [&order]() { order = order * 10 + 3; });
+        scheduler.Submit(TaskPriority::FLUSH,
+                         [&order]() { order = order * 10 + 2; });
+        scheduler.Submit(TaskPriority::READ,
+                         [&order]() { order = order * 10 + 1; });
+        release.set_value();
+        RunOnWorker(scheduler, TaskPriority::COMPACTION, []() {}).wait();
+        AssertEqual(123, order, "Tasks run by priority", totalPassed,
+                    totalFailed);
+
+        // A task that waits for its subtask runs it on the only worker
+        auto parent = RunOnWorker(scheduler, TaskPriority::FLUSH,
+                                  [&scheduler]()
+                                  {
+                                      TaskGroup group(scheduler,
+                                                      TaskPriority::FLUSH);
+                                      auto child =
+                                          group.Async([]() { return 41; });
+                                      group.Wait();
+                                      return child.get() + 1;
+                                  });
+        AssertEqual(42, parent.get(), "Wait runs subtasks on a worker",
+                    totalPassed, totalFailed);
+
+        // A waiting task runs its own subtasks, but leaves the other tasks,
+        // even the reads queued after them, to the workers
+        std::atomic<bool> read_ran(false);
+        std::atomic<bool> compaction_ran(false);
+        auto read = RunOnWorker(
+            scheduler, TaskPriority::READ,
+            [&]()
+            {
+                TaskGroup group(scheduler, TaskPriority::READ);
+                auto child = group.Async([]() { return 1; });
+                scheduler.Submit(TaskPriority::READ, [&]() { read_ran = true; });
+                scheduler.Submit(TaskPriority::COMPACTION,
+                                 [&]() { compaction_ran = true; });
+                group.Wait();
+                return child.get() == 1 && !read_ran && !compaction_ran;
+            });
+        AssertEqual(1, read.get(), "Wait runs only its own subtasks",
+                    totalPassed, totalFailed);
+        RunOnWorker(scheduler, TaskPriority::COMPACTION, []() {}).wait();
+        AssertEqual(1, read_ran && compaction_ran,
+                    "Other tasks run after the wait", totalPassed,
+                    totalFailed);
+    }
+    {
+        // Idle workers steal the subtasks of a busy one, which sleeps until
+        // they finish
+        TaskScheduler scheduler(4);
+        std::mutex mutex;
+        std::set<std::thread::id> thread_ids;
+        int finished = 0;
+        auto parent = RunOnWorker(
+            scheduler, TaskPriority::COMPACTION,
+            [&]()
+            {
+                TaskGroup group(scheduler, TaskPriority::COMPACTION);
+                for (int i = 0; i < 8; i++)
+                {
+                    group.Submit(
+                        [&]()
+                        {
+                            std::this_thread::sleep_for(
+                                std::chrono::milliseconds(20));
+                            std::lock_guard<std::mutex> lock(mutex);
+                            thread_ids.insert(std::this_thread::get_id());
+                            finished++;
+                        });
+                }
+                group.Wait();
+                std::lock_guard<std::mutex> lock(mutex);
+                return finished;
+            });
+        AssertEqual(8, parent.get(), "Wait returns after every subtask",
+                    totalPassed, totalFailed);
+        AssertEqual(1, thread_ids.size() > 1, "Subtasks are stolen",
+                    totalPassed, totalFailed);
+    }
+
+    // Two databases flush, compact and read on the same two workers
+    TaskScheduler scheduler(2);
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.background_compaction_threads = 2;
+    options.max_subcompactions = 2;
+    options.parallel_scan_min_keys = 100;
+    options.scheduler = &scheduler;
+    Database db1("test_db_scheduler_1", options);
+    Database db2("test_db_scheduler_2", options);
+    db1.Open();
+    db2.Open();
+    for (int i = 0; i < 30000; i++)
+    {
+        db1.Put(i, i * 2);
+        db2.Put(i, i * 3);
+    }
+    db1.WaitForCompactions();
+    db2.WaitForCompactions();
+
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 30000; i += 101)
+    {
+        futures.push_back(db1.GetAsync(i));
+        futures.push_back(db2.GetAsync(i));
+    }
+    int wrong_values = 0;
+    for (size_t i = 0; i < futures.size(); i += 2)
+    {
+        int key = i / 2 * 101;
+        wrong_values += futures[i].get() != key * 2;
+        wrong_values += futures[i + 1].get() != key * 3;
+    }
+    AssertEqual(0, wrong_values, "Databases share a scheduler", totalPassed,
+                totalFailed);
+    AssertEqual(1000, db2.Scan(5000, 5999).size(),
+                "Parallel scan on a shared scheduler", totalPassed,
+                totalFailed);
+    db1.Close();
+    db2.Close();
+    std::filesystem::remove_all("test_db_scheduler_1");
+    std::filesystem::remove_all("test_db_scheduler_2");
+}
+
 void
 TestDatabase(int &overallPassed, int &overallFailed)
 {
@@ -244,6 +1135,16 @@ TestDatabase(int &overallPassed, int &overallFailed)
     TestDatabaseOpenClose(totalTestsPassed, totalTestsFailed);
     TestDatabasePutGet(totalTestsPassed, totalTestsFailed);
     TestDatabaseScan(totalTestsPassed, totalTestsFailed);
+    TestDatabaseMultiGet(totalTestsPassed, totalTestsFailed);
+    TestCompactionPolicies(totalTestsPassed, totalTestsFailed);
+    TestBackgroundCompaction(totalTestsPassed, totalTestsFailed);
+    TestDatabaseStats(totalTestsPassed, totalTestsFailed);
+    TestConcurrentReads(totalTestsPassed, totalTestsFailed);
+    TestSnapshots(totalTestsPassed, totalTestsFailed);
+    TestAsyncReads(totalTestsPassed, totalTestsFailed);
+    TestParallelScan(totalTestsPassed, totalTestsFailed);
+    TestShardedDatabase(totalTestsPassed, totalTestsFailed);
+    TestTaskScheduler(totalTestsPassed, totalTestsFailed);
 
     printf("\n  SUMMARY\n");
     printf("    PASSED: %d\n", totalTestsPassed);
@@ -386,7 +1287,7 @@ TestBTreeFiles(int &totalPassed, int &totalFailed)
     // load in the merged btree file and check for the updated value
     BufferPool bp(1);
     BTreeManager btm(filename, 1, bp);
-    BTreePage page = btm.TraverseToKey(1);
+    BTreePageView page = btm.TraverseToKey(1);
     AssertEqual(100, page.Get(1), "Update a key", totalPassed, totalFailed);
 
     // check that the deleted key is not in the btree
@@ -489,6 +1390,1024 @@ TestBTreeGetsCorrectness(int &totalPassed, int &totalFailed)
     std::filesystem::remove_all("test_db2");
 }
 
+void
+TestBTreePageView(int &totalPassed, int &totalFailed)
+{
+    printf("\n  BTREE PAGE VIEW\n");
+    std::vector<std::pair<int, int>> data;
+    for (int i = 0; i < 1000; i++)
+    {
+        data.push_back({i * 2, i * 10});
+    }
+    BTree btree(data);
+    btree.SaveBTreeToDisk("page_view_test.sst");
+
+    // The pages are searched in place in their on-disk frames
+    BufferPool bp(8);
+    BTreeManager btm("page_view_test.sst", 0, bp);
+    BTreePageView page = btm.TraverseToKey(600);
+    AssertEqual(1, page.IsLeafPage(), "Traverse to a leaf page view",
+                totalPassed, totalFailed);
+    AssertEqual(3000, page.Get(600), "Get a key from a page view", totalPassed,
+                totalFailed);
+    AssertEqual(-1, page.Get(601), "Get a missing key from a page view",
+                totalPassed, totalFailed);
+    AssertEqual(6, page.Scan(600, 610).size(), "Scan a page view",
+                totalPassed, totalFailed);
+    AssertEqual(1, page.GetMinKey() <= 600 && page.GetMaxKey() >= 600,
+                "Page view min and max keys", totalPassed, totalFailed);
+    AssertEqual(3000, btm.Get(600), "Get through the buffer pool",
+                totalPassed, totalFailed);
+
+    std::filesystem::remove("page_view_test.sst");
+}
+
+void
+TestBTreeBuilder(int &totalPassed, int &totalFailed)
+{
+    printf("\n  BTREE BUILDER\n");
+
+    // Enough leaves for two levels of internal nodes below the root
+    const int num_keys = 300000;
+    LeafFilterBlock leaf_filter_block;
+    BTreeBuilder builder("builder_test.sst", false, &leaf_filter_block);
+    for (int i = 0; i < num_keys; i++)
+    {
+        builder.Add(i * 3, i);
+    }
+    builder.Finish();
+    AssertEqual(num_keys, builder.GetNumEntries(), "Builder entry count",
+                totalPassed, totalFailed);
+
+    BufferPool bp(64);
+    BTreeManager btm("builder_test.sst", 0, bp);
+    BTreePageView first_leaf = btm.TraverseToKey(INT_MIN);
+    AssertEqual(0, first_leaf.GetPageId(), "Leaves start at page 0",
+                totalPassed, totalFailed);
+
+    // The footer in the last page points at the root after the leaves
+    SstFooter footer;
+    AssertEqual(1, footer.ReadFromFile("builder_test.sst"), "Read the footer",
+                totalPassed, totalFailed);
+    AssertEqual(builder.GetFooter().root_page_id, footer.root_page_id,
+                "Footer root page", totalPassed, totalFailed);
+    AssertEqual(footer.num_leaf_pages + footer.num_internal_pages - 1,
+                footer.root_page_id, "Root is the last internal page",
+                totalPassed, totalFailed);
+    AssertEqual(num_keys, static_cast<int>(footer.num_entries),
+                "Footer entry count", totalPassed, totalFailed);
+    AssertEqual((num_keys - 1) * 3, footer.max_key, "Footer max key",
+                totalPassed, totalFailed);
+
+    bool all_found = true;
+    for (int i = 0; i < num_keys; i += 997)
+    {
+        all_found &= btm.Get(i * 3) == i && btm.BinarySearchGet(i * 3) == i;
+    }
+    AssertEqual(1, all_found, "Get keys from a built tree", totalPassed,
+                totalFailed);
+    AssertEqual(-1, btm.Get(4), "Get a missing key from a built tree",
+                totalPassed, totalFailed);
+    AssertEqual(-1, btm.BinarySearchGet(num_keys * 3),
+                "Binary search past the last leaf", totalPassed, totalFailed);
+
+    auto scan = btm.Scan(1497, 1497 + 3 * 1000);
+    AssertEqual(1001, scan.size(), "Scan across leaves of a built tree",
+                totalPassed, totalFailed);
+
+    int leaf_page_id = leaf_filter_block.FindLeafPage(150000);
+    AssertEqual(50000, btm.GetFromLeafPage(leaf_page_id, 150000),
+                "Builder fills the leaf filters", totalPassed, totalFailed);
+
+    // The leaf filter block is embedded before the footer
+    std::ifstream sst_file("builder_test.sst", std::ios::binary);
+    std::vector<char> filter_block(footer.filter_block_size);
+    sst_file.seekg(footer.filter_block_offset);
+    sst_file.read(filter_block.data(), filter_block.size());
+    LeafFilterBlock embedded_block;
+    embedded_block.DeserializeFromBuffer(filter_block.data(),
+                                         filter_block.size());
+    AssertEqual(leaf_page_id, embedded_block.FindLeafPage(150000),
+                "Read the embedded leaf filter block", totalPassed,
+                totalFailed);
+
+    // A single leaf still gets an internal root
+    BTreeBuilder small_builder("builder_small_test.sst");
+    small_builder.Add(1, 10);
+    small_builder.Add(2, 20);
+    small_builder.Finish();
+    BTreeManager small_btm("builder_small_test.sst", 0, bp);
+    AssertEqual(20, small_btm.Get(2), "Get from a single leaf tree",
+                totalPassed, totalFailed);
+    AssertEqual(3 * PAGE_SIZE,
+                static_cast<int>(
+                    std::filesystem::file_size("builder_small_test.sst")),
+                "Single leaf tree is a leaf, a root and a footer", totalPassed,
+                totalFailed);
+
+    // Files without a footer have the root at page 0 and the leaves last
+    BTreePage legacy_root(std::vector<std::pair<int, int>>{{5, 1}});
+    legacy_root.SetPageType(BTreePageType::INTERNAL_PAGE);
+    legacy_root.SetSize(1);
+    legacy_root.WriteToDisk("sst_0000_1.sst");
+    BTreePage legacy_leaf(std::vector<std::pair<int, int>>{{3, 30}, {5, 50}});
+    legacy_leaf.SetPageType(BTreePageType::LEAF_PAGE);
+    legacy_leaf.SetSize(2);
+    legacy_leaf.WriteToDisk("sst_0000_1.sst");
+
+    BTreeManager legacy_btm("sst_0000_1.sst", 1, bp);
+    AssertEqual(50, legacy_btm.Get(5), "Get from a file without a footer",
+                totalPassed, totalFailed);
+    AssertEqual(30, legacy_btm.BinarySearchGet(3),
+                "Binary search a file without a footer", totalPassed,
+                totalFailed);
+
+    std::filesystem::rename("builder_small_test.sst", "sst_0000_2.sst");
+    BTreeManager merge_btm("sst_0000_2.sst", 1, bp);
+    std::string merged = merge_btm.Merge("sst_0000_1.sst");
+    BTreeManager merged_btm(merged, 1, bp);
+    AssertEqual(4, static_cast<int>(merged_btm.Scan(INT_MIN, INT_MAX).size()),
+                "Merge with a file without a footer", totalPassed,
+                totalFailed);
+
+    std::filesystem::remove("builder_test.sst");
+    std::filesystem::remove("sst_0000_1.sst");
+    std::filesystem::remove("sst_0000_2.sst");
+    std::filesystem::remove(merged);
+}
+
+void
+TestMultiWayMerge(int &totalPassed, int &totalFailed)
+{
+    printf("\n  MULTI-WAY MERGE\n");
+
+    // Three overlapping files, newest first. The newest deletes key 6.
+    std::vector<std::string> filenames = {"sst_0000_3.sst", "sst_0000_2.sst",
+                                          "sst_0000_1.sst"};
+    for (int f = 0; f < 3; f++)
+    {
+        BTreeBuilder builder(filenames[f]);
+        for (int key = 0; key < 1000; key += 3 - f)
+        {
+            builder.Add(key, key == 6 && f == 0 ? INT_MAX : f + 1);
+        }
+        builder.Finish();
+    }
+
+    BufferPool bp(16);
+    BTreeManager btm(filenames[0], 0, bp);
+    std::string merged =
+        btm.MergeMany({filenames[1], filenames[2]}, 2, true).front().filename;
+    AssertEqual(0, merged.find("sst_0002_"), "Merge into the given level",
+                totalPassed, totalFailed);
+
+    BTreeManager merged_btm(merged, 2, bp);
+    AssertEqual(999, merged_btm.Scan(INT_MIN, INT_MAX).size(),
+                "Merge three files into one", totalPassed, totalFailed);
+    AssertEqual(1, merged_btm.Get(3), "Newest file wins", totalPassed,
+                totalFailed);
+    AssertEqual(2, merged_btm.Get(4), "Middle file wins over the oldest",
+                totalPassed, totalFailed);
+    AssertEqual(3, merged_btm.Get(5), "Keys only in the oldest file",
+                totalPassed, totalFailed);
+    AssertEqual(-1, merged_btm.Get(6), "Drop tombstones on the last level",
+                totalPassed, totalFailed);
+
+    for (const auto &filename : filenames)
+    {
+        std::filesystem::remove(filename);
+    }
+    std::filesystem::remove(merged);
+
+    // A cascade of levels 1, 0, 0 is merged straight into level 2. Compact
+    // after every flush, so the levels fill up in a known order.
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.background_compaction_threads = 0;
+    Database db("test_db_merge", options);
+    db.Open();
+    for (int i = 0; i < 4000; i++)
+    {
+        db.Put(i, i * 10);
+    }
+
+    int num_sst_files = 0;
+    int num_level_2_files = 0;
+    for (const auto &entry :
+         std::filesystem::directory_iterator("test_db_merge"))
+    {
+        if (entry.path().extension() == ".sst")
+        {
+            num_sst_files++;
+            num_level_2_files +=
+                entry.path().string().find("sst_0002_") != std::string::npos;
+        }
+    }
+    AssertEqual(1, num_sst_files, "Cascade leaves a single file",
+                totalPassed, totalFailed);
+    AssertEqual(1, num_level_2_files, "Cascade writes the last level",
+                totalPassed, totalFailed);
+    bool all_found = true;
+    for (int i = 0; i < 4000; i += 7)
+    {
+        all_found &= db.Get(i) == i * 10;
+    }
+    AssertEqual(1, all_found, "Get keys after a cascade", totalPassed,
+                totalFailed);
+
+    db.Close();
+    std::filesystem::remove_all("test_db_merge");
+}
+
+void
+TestPartitionedMerge(int &totalPassed, int &totalFailed)
+{
+    printf("\n  PARTITIONED MERGE\n");
+    std::vector<std::string> filenames = {"sst_0000_partition_newer.sst",
+                                          "sst_0000_partition_older.sst"};
+    for (int f = 0; f < 2; f++)
+    {
+        BTreeBuilder builder(filenames[f]);
+        for (int key = f; key < 2000; key += 2)
+        {
+            builder.Add(key, key);
+        }
+        builder.Finish();
+    }
+
+    BufferPool bp(16);
+    BTreeManager btm(filenames[0], 0, bp);
+    MergeOptions merge_options;
+    merge_options.max_file_entries = 300;
+    std::vector<MergeOutput> outputs =
+        btm.MergeMany({filenames[1]}, 1, true, merge_options);
+    AssertEqual(7, outputs.size(), "Split the merge into partitions",
+                totalPassed, totalFailed);
+
+    bool disjoint = true;
+    bool bloom_filters_match = true;
+    int total_entries = 0;
+    int previous_max_key = INT_MIN;
+    for (const auto &output : outputs)
+    {
+        SstFooter footer;
+        footer.ReadFromFile(output.filename);
+        disjoint &= footer.min_key > previous_max_key;
+        previous_max_key = footer.max_key;
+        total_entries += footer.num_entries;
+        bloom_filters_match &= output.bloom_filter.MayContain(footer.min_key) &&
+                               output.bloom_filter.MayContain(footer.max_key);
+        std::filesystem::remove(output.filename);
+    }
+    AssertEqual(1, disjoint, "Partitions have disjoint key ranges",
+                totalPassed, totalFailed);
+    AssertEqual(2000, total_entries, "Partitions hold every key", totalPassed,
+                totalFailed);
+    AssertEqual(1, bloom_filters_match, "Bloom filter per partition",
+                totalPassed, totalFailed);
+    for (const auto &filename : filenames)
+    {
+        std::filesystem::remove(filename);
+    }
+
+    // Leveling with partitions only rewrites the overlapping files
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.compaction_style = CompactionStyle::LEVELING;
+    options.sst_partition_entries = 500;
+    Database db("test_db_partition", options);
+    db.Open();
+    for (int i = 0; i < 12000; i++)
+    {
+        db.Put(i, i * 10);
+    }
+    for (int i = 0; i < 12000; i += 100)
+    {
+        db.Delete(i);
+    }
+
+    int num_level_1_files = 0;
+    for (const auto &entry :
+         std::filesystem::directory_iterator("test_db_partition"))
+    {
+        num_level_1_files += entry.path().extension() == ".sst" &&
+                             entry.path().string().find("sst_0001_") !=
+                                 std::string::npos;
+    }
+    AssertEqual(1, num_level_1_files > 1, "Levels hold several partitions",
+                totalPassed, totalFailed);
+
+    bool all_correct = true;
+    for (int i = 0; i < 12000; i += 7)
+    {
+        all_correct &= db.Get(i) == (i % 100 == 0 ? -1 : i * 10);
+    }
+    AssertEqual(1, all_correct, "Get from partitioned levels", totalPassed,
+                totalFailed);
+    AssertEqual(101, db.Scan(5000, 5100).size(),
+                "Scan across partitions", totalPassed, totalFailed);
+
+    db.Close();
+    std::filesystem::remove_all("test_db_partition");
+
+    // Merges whose pairs are all dropped tombstones leave no empty file
+    Database deleted_db("test_db_partition_deleted", options);
+    deleted_db.Open();
+    for (int i = 0; i < 4000; i++)
+    {
+        deleted_db.Put(i, i);
+    }
+    for (int i = 0; i < 4000; i++)
+    {
+        deleted_db.Delete(i);
+    }
+    for (int i = 10000; i < 14000; i++)
+    {
+        deleted_db.Put(i, i);
+    }
+    deleted_db.Close();
+    int num_empty_files = 0;
+    for (const auto &entry :
+         std::filesystem::directory_iterator("test_db_partition_deleted"))
+    {
+        SstFooter footer;
+        num_empty_files += entry.path().extension() == ".sst" &&
+                           footer.ReadFromFile(entry.path().string()) &&
+                           footer.num_entries == 0;
+    }
+    AssertEqual(0, num_empty_files, "No empty files after deletes",
+                totalPassed, totalFailed);
+    std::filesystem::remove_all("test_db_partition_deleted");
+}
+
+void
+TestSubcompactions(int &totalPassed, int &totalFailed)
+{
+    printf("\n  SUBCOMPACTIONS\n");
+    // The newer file overwrites every third key of the older one
+    std::vector<std::string> filenames = {"sst_0000_subcompaction_newer.sst",
+                                          "sst_0000_subcompaction_older.sst"};
+    {
+        BTreeBuilder newer(filenames[0]);
+        for (int key = 0; key < 300000; key += 3)
+        {
+            newer.Add(key, key % 2 == 0 ? -key : INT_MAX);
+        }
+        newer.Finish();
+        BTreeBuilder older(filenames[1]);
+        for (int key = 0; key < 300000; key++)
+        {
+            older.Add(key, key);
+        }
+        older.Finish();
+    }
+
+    BufferPool bp(16);
+    BTreeManager btm(filenames[0], 0, bp);
+    MergeOptions options;
+    options.max_subcompactions = 4;
+    std::vector<MergeOutput> outputs =
+        btm.MergeMany({filenames[1]}, 1, true, options);
+    AssertEqual(4, outputs.size(), "One output per key range", totalPassed,
+                totalFailed);
+
+    bool disjoint = true;
+    bool all_correct = true;
+    int total_entries = 0;
+    int previous_max_key = INT_MIN;
+    for (const auto &output : outputs)
+    {
+        SstFooter footer;
+        footer.ReadFromFile(output.filename);
+        disjoint &= footer.min_key > previous_max_key;
+        previous_max_key = footer.max_key;
+        total_entries += footer.num_entries;
+
+        BTreeManager output_btm(output.filename, 1, bp, footer);
+        for (int key = footer.min_key; key <= footer.max_key; key += 7)
+        {
+            int expected = key % 3 != 0 ? key : key % 2 == 0 ? -key : -1;
+            all_correct &= output_btm.Get(key) == expected;
+        }
+        std::filesystem::remove(output.filename);
+    }
+    AssertEqual(1, disjoint, "Key ranges are disjoint", totalPassed,
+                totalFailed);
+    AssertEqual(250000, total_entries, "Every key merged once", totalPassed,
+                totalFailed);
+    AssertEqual(1, all_correct, "Newest values after a parallel merge",
+                totalPassed, totalFailed);
+
+    // Small merges are not split
+    options.max_subcompactions = 10000;
+    outputs = btm.MergeMany({filenames[1]}, 1, true, options);
+    AssertEqual(1, outputs.size() <= 10000 / MIN_SUBCOMPACTION_LEAF_PAGES,
+                "Key ranges hold enough leaves", totalPassed, totalFailed);
+    for (const auto &output : outputs)
+    {
+        std::filesystem::remove(output.filename);
+    }
+    for (const auto &filename : filenames)
+    {
+        std::filesystem::remove(filename);
+    }
+}
+
+void
+TestBTreePageFormats(int &totalPassed, int &totalFailed)
+{
+    printf("\n  BTREE PAGE FORMATS\n");
+
+    // Build a page in the original interleaved (key, value) format by hand
+    PageFrame frame = AllocatePageFrame();
+    int header[2] = {static_cast<int>(BTreePageType::LEAF_PAGE), 100};
+    std::memcpy(frame.get(), header, sizeof(header));
+    for (int i = 0; i < 100; i++)
+    {
+        int pair[2] = {i * 3, i};
+        std::memcpy(frame.get() + sizeof(header) + i * sizeof(pair), pair,
+                    sizeof(pair));
+    }
+
+    BTreePageView legacy_page(frame, 0);
+    AssertEqual(1, legacy_page.IsLeafPage(), "Read an interleaved page",
+                totalPassed, totalFailed);
+    AssertEqual(50, legacy_page.Get(150), "Get from an interleaved page",
+                totalPassed, totalFailed);
+    AssertEqual(297, legacy_page.GetMaxKey(), "Max key of an interleaved page",
+                totalPassed, totalFailed);
+
+    // The same data written by BTreePage uses the PAX layout
+    std::vector<std::pair<int, int>> pairs = legacy_page.GetKeyValues();
+    BTreePage page(pairs);
+    page.SetPageType(BTreePageType::LEAF_PAGE);
+    PageFrame pax_frame = AllocatePageFrame();
+    page.SerializeToBuffer(pax_frame.get());
+    BTreePageView pax_page(pax_frame, 0);
+    AssertEqual(50, pax_page.Get(150), "Get from a PAX page", totalPassed,
+                totalFailed);
+    AssertEqual(-1, pax_page.Get(151), "Get a missing key from a PAX page",
+                totalPassed, totalFailed);
+    AssertEqual(33, pax_page.Scan(0, 98).size(), "Scan a PAX page",
+                totalPassed, totalFailed);
+
+    // The vectorized lower bound must agree with std::lower_bound
+    int mismatches = 0;
+    std::vector<int> keys;
+    for (int n = 0; n <= MAX_PAGE_KV_PAIRS; n += 17)
+    {
+        keys.clear();
+        for (int i = 0; i < n; i++)
+        {
+            keys.push_back(i * 4 - 1000);
+        }
+        for (int key = -1010; key < n * 4 - 990; key += 3)
+        {
+            int expected =
+                std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            if (LowerBoundKeys(keys.data(), n, key) != expected)
+            {
+                mismatches++;
+            }
+        }
+    }
+    AssertEqual(0, mismatches, "Vectorized lower bound over the keys",
+                totalPassed, totalFailed);
+}
+
+void
+TestSequentialPageReader(int &totalPassed, int &totalFailed)
+{
+    printf("\n  SEQUENTIAL PAGE READER\n");
+    std::string filename = "sst_0000_sequential_reader.sst";
+    {
+        BTreeBuilder builder(filename);
+        for (int key = 0; key < 100000; key++)
+        {
+            builder.Add(key, key * 2);
+        }
+        builder.Finish();
+    }
+    SstFooter footer;
+    footer.ReadFromFile(filename);
+
+    // Small chunks, so the reader switches buffers many times. The first
+    // page is held on to while its buffer would be reused.
+    SequentialPageReader reader(filename, footer.first_leaf_page_id,
+                                footer.num_leaf_pages, nullptr, 3);
+    BTreePageView first_page = reader.NextPage();
+    int num_leaves = 1;
+    int num_entries = first_page.GetSize();
+    int previous_max_key = first_page.GetMaxKey();
+    bool in_order = true;
+    for (BTreePageView page = reader.NextPage(); page.IsLeafPage();
+         page = reader.NextPage())
+    {
+        in_order &= page.GetMinKey() == previous_max_key + 1 &&
+                    page.GetPageId() == num_leaves;
+        previous_max_key = page.GetMaxKey();
+        num_entries += page.GetSize();
+        num_leaves++;
+    }
+    AssertEqual(footer.num_leaf_pages, num_leaves, "Read every leaf",
+                totalPassed, totalFailed);
+    AssertEqual(100000, num_entries, "Read every pair", totalPassed,
+                totalFailed);
+    AssertEqual(1, in_order, "Leaves come in order", totalPassed, totalFailed);
+    AssertEqual(0, first_page.GetMinKey(), "Held pages are not overwritten",
+                totalPassed, totalFailed);
+    AssertEqual(INVALID_PAGE_ID, reader.NextPage().GetPageId(),
+                "Stop at the end of the range", totalPassed, totalFailed);
+
+    // Without an end page, read to the end of the file
+    SequentialPageReader whole_file(filename, 0, -1);
+    int num_pages = 0;
+    while (whole_file.NextPage().GetPageId() != INVALID_PAGE_ID)
+    {
+        num_pages++;
+    }
+    AssertEqual(std::filesystem::file_size(filename) / PAGE_SIZE, num_pages,
+                "Read to the end of the file", totalPassed, totalFailed);
+    std::filesystem::remove(filename);
+}
+
+void
+TestScanReadahead(int &totalPassed, int &totalFailed)
+{
+    printf("\n  SCAN READAHEAD\n");
+    std::string filename = "sst_0000_scan_readahead.sst";
+    {
+        BTreeBuilder builder(filename);
+        for (int key = 0; key < 200000; key++)
+        {
+            builder.Add(key, key + 1);
+        }
+        builder.Finish();
+    }
+    SstFooter footer;
+    footer.ReadFromFile(filename);
+
+    // A long scan reads every leaf it needs once, most of them ahead
+    BufferPool bp(64);
+    BTreeManager btm(filename, 0, bp, footer);
+    auto results = btm.Scan(1000, 150999);
+    bool all_correct = results.size() == 150000;
+    for (size_t i = 0; all_correct && i < results.size(); i++)
+    {
+        all_correct &= results[i].first == static_cast<int>(i) + 1000 &&
+                       results[i].second == static_cast<int>(i) + 1001;
+    }
+    AssertEqual(1, all_correct, "Scan with readahead returns the range",
+                totalPassed, totalFailed);
+    uint64_t leaves_in_range = 150000 / MAX_PAGE_KV_PAIRS + 2;
+    AssertEqual(1,
+                btm.GetPagesRead() <=
+                    leaves_in_range + SCAN_READAHEAD_MAX_PAGES + 8,
+                "Readahead stays close to the scanned leaves", totalPassed,
+                totalFailed);
+
+    // A scan that ends just after readahead starts reads no leaf past its
+    // range
+    BufferPool short_bp(64);
+    BTreeManager short_btm(filename, 0, short_bp, footer);
+    int short_scan_keys =
+        (SCAN_READAHEAD_TRIGGER_LEAVES + 1) * MAX_PAGE_KV_PAIRS;
+    AssertEqual(short_scan_keys,
+                short_btm.Scan(100000, 100000 + short_scan_keys - 1).size(),
+                "Scan just past the readahead trigger", totalPassed,
+                totalFailed);
+    AssertEqual(1,
+                short_btm.GetPagesRead() <=
+                    static_cast<uint64_t>(SCAN_READAHEAD_TRIGGER_LEAVES) + 6,
+                "Readahead stops at the end key", totalPassed, totalFailed);
+
+    // Scans that end early and scans to the last leaf
+    AssertEqual(10, btm.Scan(5000, 5009).size(), "Short scan", totalPassed,
+                totalFailed);
+    AssertEqual(1000, btm.Scan(199000, 250000).size(),
+                "Scan to the last leaf", totalPassed, totalFailed);
+    std::filesystem::remove(filename);
+}
+
+void
+TestIoEngines(int &totalPassed, int &totalFailed)
+{
+    printf("\n  IO ENGINES\n");
+    std::string filename = "sst_0000_io_engines.sst";
+    {
+        BTreeBuilder builder(filename);
+        for (int key = 0; key < 100000; key++)
+        {
+            builder.Add(key, key * 2);
+        }
+        builder.Finish();
+    }
+    SstFooter footer;
+    footer.ReadFromFile(filename);
+    size_t file_size = std::filesystem::file_size(filename);
+    int num_pages = file_size / PAGE_SIZE;
+
+    // Read every page backwards in one batch, plus a read across the end of
+    // the file and one past it. io_uring falls back to pread where it is not
+    // supported, and both must read the same bytes.
+    std::unique_ptr<IoEngine> uring = IoEngine::Create(IoEngineType::IO_URING, 8);
+    std::vector<std::vector<char>> contents;
+    std::vector<std::vector<ssize_t>> results;
+    for (IoEngine *engine : {&IoEngine::Default(), uring.get()})
+    {
+        std::shared_ptr<IoFile> file = engine->OpenFile(filename, true);
+        std::vector<char> buffer((num_pages + 2) * PAGE_SIZE);
+        std::vector<IoRequest> requests;
+        for (int page = num_pages - 1; page >= 0; page--)
+        {
+            requests.push_back({file.get(), &buffer[page * PAGE_SIZE],
+                                PAGE_SIZE,
+                                static_cast<off_t>(page) * PAGE_SIZE});
+        }
+        requests.push_back({file.get(), &buffer[num_pages * PAGE_SIZE],
+                            2 * PAGE_SIZE,
+                            static_cast<off_t>(file_size - PAGE_SIZE / 2)});
+        requests.push_back({file.get(), &buffer[0], PAGE_SIZE,
+                            static_cast<off_t>(file_size)});
+        engine->Read(requests);
+        contents.push_back(buffer);
+        results.emplace_back();
+        for (const IoRequest &request : requests)
+        {
+            results.back().push_back(request.result);
+        }
+    }
+    AssertEqual(1, contents[0] == contents[1], "Engines read the same bytes",
+                totalPassed, totalFailed);
+    AssertEqual(1, results[0] == results[1], "Engines return the same sizes",
+                totalPassed, totalFailed);
+    AssertEqual(PAGE_SIZE / 2, results[1][num_pages],
+                "Short read at the end of the file", totalPassed,
+                totalFailed);
+    AssertEqual(0, results[1][num_pages + 1], "Empty read past the end",
+                totalPassed, totalFailed);
+
+    // Lookups and compaction reads through the io_uring engine
+    BufferPool bp(16);
+    BTreeManager btm(filename, 0, bp, footer, uring->OpenFile(filename, true));
+    std::vector<int> keys;
+    for (int key = -50; key < 100050; key += 37)
+    {
+        keys.push_back(key);
+    }
+    std::vector<int> values = btm.MultiGet(keys);
+    int wrong_values = 0;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        int expected = keys[i] >= 0 && keys[i] < 100000 ? keys[i] * 2 : -1;
+        wrong_values += values[i] != expected;
+    }
+    AssertEqual(0, wrong_values, "Batched MultiGet through io_uring",
+                totalPassed, totalFailed);
+
+    SequentialPageReader reader(
+        uring->OpenFile(filename), footer.first_leaf_page_id,
+        footer.first_leaf_page_id + footer.num_leaf_pages, nullptr, 200);
+    int num_entries = 0;
+    for (BTreePageView page = reader.NextPage(); page.IsLeafPage();
+         page = reader.NextPage())
+    {
+        num_entries += page.GetSize();
+    }
+    AssertEqual(100000, num_entries, "Read every pair through io_uring",
+                totalPassed, totalFailed);
+    std::filesystem::remove(filename);
+
+    // A database that reads through io_uring
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.io_engine = IoEngineType::IO_URING;
+    options.io_queue_depth = 4;
+    options.use_leaf_filters = true;
+    {
+        Database db("test_db_io_uring", options);
+        db.Open();
+        for (int i = 0; i < 20000; i++)
+        {
+            db.Put(i, i * 3);
+        }
+        db.WaitForCompactions();
+        int wrong_gets = 0;
+        for (int i = 0; i < 20000; i += 7)
+        {
+            wrong_gets += db.Get(i) != i * 3;
+        }
+        AssertEqual(0, wrong_gets, "Database gets through io_uring",
+                    totalPassed, totalFailed);
+        std::vector<int> db_keys = {5, 19999, 20000, 12345, -1};
+        std::vector<int> db_values = db.MultiGet(db_keys);
+        AssertEqual(1,
+                    db_values == std::vector<int>{15, 59997, -1, 37035, -1},
+                    "Database MultiGet through io_uring", totalPassed,
+                    totalFailed);
+        AssertEqual(1000, db.Scan(5000, 5999).size(),
+                    "Database scan through io_uring", totalPassed,
+                    totalFailed);
+        db.Close();
+    }
+    std::filesystem::remove_all("test_db_io_uring");
+}
+
+void
+TestDirectIo(int &totalPassed, int &totalFailed)
+{
+    printf("\n  DIRECT IO\n");
+    std::string filename = "sst_0000_direct_io.sst";
+    {
+        BTreeBuilder builder(filename, false, nullptr, nullptr, true);
+        for (int key = 0; key < 50000; key++)
+        {
+            builder.Add(key, key * 4);
+        }
+        builder.Finish();
+    }
+    SstFooter footer;
+    AssertEqual(1, footer.ReadFromFile(filename),
+                "Footer of a file written with O_DIRECT", totalPassed,
+                totalFailed);
+
+    // Unaligned reads of a direct file go through an aligned buffer
+    std::unique_ptr<IoEngine> engine =
+        IoEngine::Create(IoEngineType::PREAD, 1, true);
+    std::shared_ptr<IoFile> direct_file = engine->OpenFile(filename);
+    std::shared_ptr<IoFile> buffered_file =
+        IoEngine::Default().OpenFile(filename);
+    std::vector<char> direct_bytes(10000);
+    std::vector<char> buffered_bytes(10000);
+    ssize_t direct_read =
+        direct_file->Read(direct_bytes.data(), direct_bytes.size(), 1234);
+    ssize_t buffered_read =
+        buffered_file->Read(buffered_bytes.data(), buffered_bytes.size(), 1234);
+    AssertEqual(1,
+                direct_read == 10000 && buffered_read == 10000 &&
+                    direct_bytes == buffered_bytes,
+                "Unaligned direct read", totalPassed, totalFailed);
+    size_t file_size = std::filesystem::file_size(filename);
+    AssertEqual(100,
+                direct_file->Read(direct_bytes.data(), 1000, file_size - 100),
+                "Unaligned direct read at the end of the file", totalPassed,
+                totalFailed);
+
+    BufferPool bp(16);
+    BTreeManager btm(filename, 0, bp, footer, direct_file);
+    AssertEqual(4 * 31337, btm.Get(31337), "Get through a direct file",
+                totalPassed, totalFailed);
+    AssertEqual(20000, btm.Scan(10000, 29999).size(),
+                "Scan through a direct file", totalPassed, totalFailed);
+    std::filesystem::remove(filename);
+
+    // A database that flushes, compacts and reads with O_DIRECT
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.use_direct_io = true;
+    options.use_leaf_filters = true;
+    Database db("test_db_direct_io", options);
+    db.Open();
+    for (int i = 0; i < 20000; i++)
+    {
+        db.Put(i, i + 7);
+    }
+    db.WaitForCompactions();
+    int wrong_gets = 0;
+    for (int i = 0; i < 20000; i += 13)
+    {
+        wrong_gets += db.Get(i) != i + 7;
+    }
+    AssertEqual(0, wrong_gets, "Database gets with direct I/O", totalPassed,
+                totalFailed);
+    AssertEqual(500, db.Scan(100, 599).size(), "Database scan with direct I/O",
+                totalPassed, totalFailed);
+    db.Close();
+    std::filesystem::remove_all("test_db_direct_io");
+}
+
+void
+TestMmapReads(int &totalPassed, int &totalFailed)
+{
+    printf("\n  MMAP READS\n");
+    std::string filename = "sst_0000_mmap_reads.sst";
+    {
+        BTreeBuilder builder(filename);
+        for (int key = 0; key < 50000; key++)
+        {
+            builder.Add(key, key * 6);
+        }
+        builder.Finish();
+    }
+    SstFooter footer;
+    footer.ReadFromFile(filename);
+
+    // Pages are read in place, without the buffer pool
+    std::shared_ptr<MappedFile> mapped_file = MappedFile::Open(filename);
+    AssertEqual(std::filesystem::file_size(filename) / PAGE_SIZE,
+                mapped_file->GetNumPages(), "Mapping covers the file",
+                totalPassed, totalFailed);
+    BufferPool bp(16);
+    BTreeManager btm(filename, 0, bp, footer, nullptr, mapped_file);
+    AssertEqual(6 * 4321, btm.Get(4321), "Get through a mapping",
+                totalPassed, totalFailed);
+    std::vector<int> values = btm.MultiGet({-1, 0, 49999, 50000});
+    AssertEqual(1, values == std::vector<int>{-1, 0, 6 * 49999, -1},
+                "MultiGet through a mapping", totalPassed, totalFailed);
+    AssertEqual(30000, btm.Scan(10000, 39999).size(),
+                "Scan through a mapping", totalPassed, totalFailed);
+    BTreePageView cached;
+    AssertEqual(0, bp.TryGetPage(filename, footer.root_page_id, &cached),
+                "Mapped pages skip the buffer pool", totalPassed,
+                totalFailed);
+    AssertEqual(0, btm.GetPagesRead(), "Mapped pages are not read",
+                totalPassed, totalFailed);
+
+    // The mapping outlives the file
+    std::filesystem::remove(filename);
+    AssertEqual(6 * 777, btm.Get(777), "Get after the file is removed",
+                totalPassed, totalFailed);
+
+    // A database that reads through mappings
+    DatabaseOptions options;
+    options.memtable_size = 8 * 1000;
+    options.use_mmap_reads = true;
+    options.use_leaf_filters = true;
+    Database db("test_db_mmap_reads", options);
+    db.Open();
+    for (int i = 0; i < 20000; i++)
+    {
+        db.Put(i, i * 9);
+    }
+    db.Delete(1234);
+    db.WaitForCompactions();
+    int wrong_gets = 0;
+    for (int i = 0; i < 20000; i += 11)
+    {
+        wrong_gets += db.Get(i) != (i == 1234 ? -1 : i * 9);
+    }
+    AssertEqual(0, wrong_gets, "Database gets through mappings", totalPassed,
+                totalFailed);
+    AssertEqual(1, db.MultiGet({3, 19999}) == std::vector<int>{27, 179991},
+                "Database MultiGet through mappings", totalPassed,
+                totalFailed);
+    AssertEqual(2000, db.Scan(2000, 3999).size(),
+                "Database scan through mappings", totalPassed, totalFailed);
+    db.Close();
+    std::filesystem::remove_all("test_db_mmap_reads");
+}
+
+void
+TestMergeKernel(int &totalPassed, int &totalFailed)
+{
+    printf("\n  MERGE KERNEL\n");
+    int merge_mismatches = 0;
+    int dedupe_mismatches = 0;
+    for (int n = 0; n < 300; n += 7)
+    {
+        // Two runs with shared keys and some tombstones in the older one
+        std::vector<int> a_keys, a_values, b_keys, b_values;
+        for (int i = 0; i < n; i++)
+        {
+            a_keys.push_back(i * 3);
+            a_values.push_back(i);
+            b_keys.push_back(i * 2);
+            b_values.push_back(i % 5 == 0 ? INT_MAX : -i);
+        }
+
+        std::vector<int> keys(2 * n), values(2 * n);
+        size_t size =
+            MergeSortedRuns(a_keys.data(), a_values.data(), n, b_keys.data(),
+                            b_values.data(), n, keys.data(), values.data());
+        std::vector<std::pair<int, int>> expected;
+        std::map<int, int> newest;
+        for (int i = n - 1; i >= 0; i--)
+        {
+            newest[b_keys[i]] = b_values[i];
+        }
+        for (int i = 0; i < n; i++)
+        {
+            newest[a_keys[i]] = a_values[i];
+        }
+        merge_mismatches += size != static_cast<size_t>(2 * n) ||
+                            !std::is_sorted(keys.begin(), keys.end());
+
+        for (bool drop_tombstones : {false, true})
+        {
+            std::vector<int> out_keys(size), out_values(size);
+            size_t num_pairs =
+                DedupeMergedRun(keys.data(), values.data(), size,
+                                drop_tombstones, out_keys.data(),
+                                out_values.data());
+            size_t i = 0;
+            for (const auto &pair : newest)
+            {
+                if (drop_tombstones && pair.second == INT_MAX)
+                {
+                    continue;
+                }
+                dedupe_mismatches += i >= num_pairs ||
+                                     out_keys[i] != pair.first ||
+                                     out_values[i] != pair.second;
+                i++;
+            }
+            dedupe_mismatches += i != num_pairs;
+        }
+    }
+    AssertEqual(0, merge_mismatches, "Merge two sorted runs", totalPassed,
+                totalFailed);
+    AssertEqual(0, dedupe_mismatches, "Keep the newest value of each key",
+                totalPassed, totalFailed);
+}
+
+void
+TestCompressedLeafPages(int &totalPassed, int &totalFailed)
+{
+    printf("\n  COMPRESSED LEAF PAGES\n");
+
+    // Round trip pages with narrow and full width keys and values,
+    // including negative keys and tombstones
+    int mismatches = 0;
+    for (int step : {1, 3, 1000, 1 << 20})
+    {
+        std::vector<std::pair<int, int>> pairs;
+        CompressedLeafSizer sizer;
+        for (int i = 0; sizer.TryAdd(i * step - 5000, i % 7 == 0 ? INT_MAX : i);
+             i++)
+        {
+            pairs.push_back({i * step - 5000, i % 7 == 0 ? INT_MAX : i});
+        }
+
+        BTreePage page(pairs);
+        page.SetPageType(BTreePageType::LEAF_PAGE);
+        page.SetPageFormat(BTreePageFormat::COMPRESSED);
+        PageFrame frame = AllocatePageFrame();
+        page.SerializeToBuffer(frame.get());
+        BTreePageView view(frame, 0);
+        if (!view.IsLeafPage() || view.GetKeyValues() != pairs)
+        {
+            mismatches++;
+        }
+    }
+    AssertEqual(0, mismatches, "Compressed leaf pages round trip",
+                totalPassed, totalFailed);
+
+    // Dense keys with small values fit several times more pairs per page
+    CompressedLeafSizer sizer;
+    int dense_pairs = 0;
+    while (sizer.TryAdd(dense_pairs, dense_pairs % 1000))
+    {
+        dense_pairs++;
+    }
+    AssertEqual(1, dense_pairs >= 2 * MAX_PAGE_KV_PAIRS,
+                "Dense keys pack at least 2x more pairs per page", totalPassed,
+                totalFailed);
+
+    // A database with compressed leaves returns the same results and writes
+    // smaller files
+    DatabaseOptions options;
+    options.compress_leaf_pages = true;
+    Database db("test_db", options);
+    db.Open();
+    for (int i = 0; i < 270000; i++)
+    {
+        db.Put(i, i % 1000);
+    }
+    db.Delete(5);
+
+    int failed = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        int key = rand() % 270000;
+        int expected = key == 5 ? -1 : key % 1000;
+        if (db.Get(key) != expected)
+        {
+            failed = 1;
+            break;
+        }
+    }
+    AssertEqual(0, failed, "Database gets are correct with compressed leaves",
+                totalPassed, totalFailed);
+    AssertEqual(1000, db.Scan(1000, 1999).size(),
+                "Database scans are correct with compressed leaves",
+                totalPassed, totalFailed);
+
+    uintmax_t sst_bytes = 0;
+    for (const auto &entry : std::filesystem::directory_iterator("test_db"))
+    {
+        if (entry.path().extension() == ".sst")
+        {
+            sst_bytes += entry.file_size();
+        }
+    }
+    AssertEqual(1, sst_bytes < 270000 * 8 / 2,
+                "Compressed SST files are less than half the raw size",
+                totalPassed, totalFailed);
+
+    db.Close();
+    std::filesystem::remove_all("test_db");
+}
+
 void
 BTreeTests(int &overallPassed, int &overallFailed)
 {
@@ -499,6 +2418,19 @@ BTreeTests(int &overallPassed, int &overallFailed)
     TestConvertMemtableToBTree(totalPassed, totalFailed);
     TestBTreeFiles(totalPassed, totalFailed);
     TestBTreeGetsCorrectness(totalPassed, totalFailed);
+    TestBTreePageView(totalPassed, totalFailed);
+    TestBTreeBuilder(totalPassed, totalFailed);
+    TestMultiWayMerge(totalPassed, totalFailed);
+    TestPartitionedMerge(totalPassed, totalFailed);
+    TestSubcompactions(totalPassed, totalFailed);
+    TestBTreePageFormats(totalPassed, totalFailed);
+    TestCompressedLeafPages(totalPassed, totalFailed);
+    TestMergeKernel(totalPassed, totalFailed);
+    TestSequentialPageReader(totalPassed, totalFailed);
+    TestScanReadahead(totalPassed, totalFailed);
+    TestIoEngines(totalPassed, totalFailed);
+    TestDirectIo(totalPassed, totalFailed);
+    TestMmapReads(totalPassed, totalFailed);
 
     printf("\n  SUMMARY\n");
     printf("    PASSED: %d\n", totalPassed);
@@ -601,6 +2533,106 @@ TestBloomFilterSerialization(int &totalPassed, int &totalFailed)
     totalFailed += testsFailed;
 }
 
+/* Test the per-leaf filters and fence pointers of an SST */
+void
+TestLeafFilterBlock(int &totalPassed, int &totalFailed)
+{
+    printf("\n  LEAF FILTER BLOCK\n");
+    int testsPassed = 0;
+    int testsFailed = 0;
+
+    // Two leaves holding the even keys 0..98 and 100..198, starting at page 3
+    LeafFilterBlock block(3);
+    std::vector<std::pair<int, int>> leaf;
+    for (int i = 0; i < 200; i += 2)
+    {
+        leaf.push_back({i, i * 10});
+        if (leaf.size() == 50)
+        {
+            block.AddLeaf(leaf);
+            leaf.clear();
+        }
+    }
+
+    AssertEqual(2, block.GetNumLeaves(), "Block has 2 leaves", testsPassed,
+                testsFailed);
+    AssertEqual(3, block.FindLeafPage(10), "Key 10 is in the first leaf",
+                testsPassed, testsFailed);
+    AssertEqual(4, block.FindLeafPage(150), "Key 150 is in the second leaf",
+                testsPassed, testsFailed);
+    AssertEqual(INVALID_PAGE_ID, block.FindLeafPage(500),
+                "Key past the last fence has no leaf", testsPassed,
+                testsFailed);
+
+    // Most of the odd keys should be ruled out by the leaf filters
+    int false_positives = 0;
+    for (int i = 1; i < 200; i += 2)
+    {
+        if (block.FindLeafPage(i) != INVALID_PAGE_ID)
+        {
+            false_positives++;
+        }
+    }
+    AssertEqual(1, false_positives < 10, "Leaf filters rule out absent keys",
+                testsPassed, testsFailed);
+
+    block.SerializeToDisk("leaf_filter_test.leaf_filter");
+    LeafFilterBlock deserialized("leaf_filter_test.leaf_filter");
+    AssertEqual(4, deserialized.FindLeafPage(150),
+                "Key 150 is found after deserialization", testsPassed,
+                testsFailed);
+    std::filesystem::remove("leaf_filter_test.leaf_filter");
+
+    // A database using leaf filters must return the same results after a
+    // flush and a merge
+    DatabaseOptions options;
+    options.use_leaf_filters = true;
+    Database db("test_db", options);
+    db.Open();
+    for (int i = 0; i < 270000; i++)
+    {
+        db.Put(i * 2, i);
+    }
+    db.Delete(20);
+
+    int failed = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        int key = (rand() % 270000) * 2;
+        int expected = key == 20 ? -1 : key / 2;
+        if (db.Get(key) != expected || db.Get(key + 1) != -1)
+        {
+            failed = 1;
+            break;
+        }
+    }
+    AssertEqual(0, failed, "Database gets are correct with leaf filters",
+                testsPassed, testsFailed);
+
+    std::vector<int> keys;
+    for (int i = 0; i < 500; i++)
+    {
+        keys.push_back(rand() % 540000);
+    }
+    auto values = db.MultiGet(keys);
+    failed = 0;
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (values[i] != db.Get(keys[i]))
+        {
+            failed = 1;
+            break;
+        }
+    }
+    AssertEqual(0, failed, "Database MultiGet is correct with leaf filters",
+                testsPassed, testsFailed);
+    db.Close();
+    std::filesystem::remove_all("test_db");
+
+    totalPassed += testsPassed;
+    totalFailed += testsFailed;
+}
+
 /* Top-level function to run all Bloom Filter tests */
 void
 TestBloomFilter(int &overallPassed, int &overallFailed)
@@ -612,6 +2644,7 @@ TestBloomFilter(int &overallPassed, int &overallFailed)
     TestBloomFilterInsertAndMembership(totalTestsPassed, totalTestsFailed);
     TestBloomFilterUnion(totalTestsPassed, totalTestsFailed);
     TestBloomFilterSerialization(totalTestsPassed, totalTestsFailed);
+    TestLeafFilterBlock(totalTestsPassed, totalTestsFailed);
 
     printf("\n  SUMMARY\n");
     printf("    PASSED: %d\n", totalTestsPassed);